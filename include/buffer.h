@@ -0,0 +1,55 @@
+/* Pool of growable I/O buffers, shared by the HTTP layer and plugins
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_BUFFER_H_
+#define INADYN_BUFFER_H_
+
+#include <stddef.h>
+#include "queue.h"
+
+#define BUF_DEFAULT_SIZE  4096		/* Initial size of a buffer */
+#define BUF_DEFAULT_MAX   262144	/* Default max size of a response */
+#define BUF_KEEP_MAX      65536		/* Larger buffers are shrunk when returned */
+#define BUF_POOL_MAX      32		/* Max idle buffers kept for reuse */
+
+typedef struct buf {
+	LIST_ENTRY(buf) link;
+	char           *data;
+	size_t          size;
+} buf_t;
+
+/* Set in .conf file, max size a buffer can grow to */
+extern int max_response_size;
+
+buf_t *buf_get   (size_t size);
+int    buf_grow  (buf_t *buf, size_t size);
+void   buf_put   (buf_t *buf);
+void   buf_flush (void);
+
+#endif /* INADYN_BUFFER_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -23,6 +23,7 @@
 #ifndef INADYN_COMPAT_H_
 #define INADYN_COMPAT_H_
 
+#include <ctype.h>
 #include <errno.h>
 #include <string.h>
 #include <stdint.h>
@@ -103,4 +104,17 @@ static inline int string_compare(const char *a, const char *b)
    return strlen(a) == strlen(b) && !strcmp(a, b);
 }
 
+/* FNV-1a hash of at most @len chars, case insensitive, for name lookups */
+static inline size_t string_hash(const char *s, size_t len)
+{
+	uint32_t hash = 2166136261u;
+
+	while (len-- && *s) {
+		hash ^= (unsigned char)tolower((unsigned char)*s++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
 #endif /* INADYN_COMPAT_H_ */
@@ -30,8 +30,11 @@
 #include "error.h"
 #include "http.h"
 #include "log.h"
+#include "loop.h"
+#include "match.h"
 #include "plugin.h"
 #include "queue.h"		/* BSD sys/queue.h API */
+#include "template.h"
 
 #define VERSION_STRING	PACKAGE_NAME " version " VERSION " -- Dynamic DNS update client."
 #define DDNS_USER_AGENT "inadyn/" VERSION " " PACKAGE_BUGREPORT
@@ -52,12 +55,17 @@
 #define DDNS_MAX_PERIOD                   (10 * 24 * 3600)        /* 10 days in sec */
 #define DDNS_ERROR_UPDATE_PERIOD          600     /* 10 min */
 #define DDNS_FORCED_UPDATE_PERIOD         (30 * 24 * 3600)        /* 30 days in sec */
-#define DDNS_DEFAULT_CMD_CHECK_PERIOD     1       /* sec */
+#define DDNS_FAKE_ADDRESS_DELAY           3       /* sec */
+#define DDNS_IFACE_CHANGE_DELAY           1       /* sec */
+#define DDNS_STATE_COMMIT_DELAY           1       /* sec, batch updates to disk */
+#define DDNS_ADDRESS_CACHE_TTL            10      /* sec, address shared by providers */
 #define DDNS_DEFAULT_ITERATIONS           0       /* Forever */
+#define DDNS_DEFAULT_CONCURRENCY          4       /* Providers updated in parallel */
+#define DDNS_ZONE_REFRESH                 3600    /* sec, provider zone snapshot, e.g. Cloudflare */
 #define DDNS_HTTP_RESPONSE_BUFFER_SIZE	  (BUFSIZ < 8192 ? 8192 : BUFSIZ) /* at least 8 Kib */
 #define DDNS_HTTP_REQUEST_BUFFER_SIZE     2500    /* Bytes */
-#define DDNS_MAX_ALIAS_NUMBER             50      /* maximum number of aliases per server that can be maintained */
 #define DDNS_MAX_SERVER_NUMBER            5       /* maximum number of servers that can be maintained */
+#define DDNS_MAX_BATCH_NUMBER             20      /* maximum number of aliases per batch request */
 
 /* SSL support status in plugin definition */
 #define DDNS_CHECKIP_SSL_UNSUPPORTED     -1       /* HTTPS not supported by checkip-server (default) */
@@ -75,9 +83,6 @@
 # define MAX_ADDRESS_LEN                  46
 #endif
 
-#define MAX_NUM_RESPONSES                 6
-#define MAX_RESPONSE_LEN                  32
-
 typedef enum {
 	NO_CMD = 0,
 	CMD_STOP,
@@ -105,22 +110,45 @@ typedef struct {
 	int            port;
 } ddns_name_t;
 
-typedef struct {
+struct di;
+struct da;
+
+TAILQ_HEAD(alias_list, da);
+
+/*
+ * Per-hostname state, kept in one array per provider, sized to the
+ * number of hostnames.  The name is only read when composing requests
+ * and logging, so it lives in the provider's names[] block instead.
+ */
+typedef struct da {
+	TAILQ_ENTRY(da) link;	/* On provider's due list */
+
 	int            force_addr_update;
 	int            ip_has_changed;
-	char           address[MAX_ADDRESS_LEN];
-
-	char           name[SERVER_NAME_LEN];
 	int            update_required;
 	time_t         last_update;
+
+	/* Next forced update, or retry after a failed update */
+	loop_timer_t   timer;
+	struct di     *info;
+
+	/* Outcome of last update job, handled by main thread */
+	int            queued;
+	int            reschedule;
+	int            result;
+	char          *event;
+
+	char           address[MAX_ADDRESS_LEN];
+	char          *name;	/* In info->names[] */
 } ddns_alias_t;
 
 typedef struct di {
-	LIST_ENTRY(di) link;
-	int            id;
+	size_t         id;	/* Index in provider table, see conf_info_get() */
+	const char    *name;	/* .conf section, e.g., default@no-ip.com:1 */
 
 	ddns_creds_t   creds;
 	ddns_system_t *system;
+	struct tmpl   *tmpl;	/* Compiled server_req, see template.h */
 
 	/* Per provider custom user agent */
 	char          *user_agent;
@@ -130,9 +158,8 @@ typedef struct di {
 	char           server_url[SERVER_URL_LEN];
 	http_t         server;
 
-	/* Possble "OK" responses from DDNS provider */
-	char           server_response[MAX_NUM_RESPONSES][MAX_RESPONSE_LEN];
-	size_t         server_response_num;
+	/* Compiled ddns-response rules of custom provider, see match.h */
+	struct match  *responses;
 
 	/* Interface for IP */
 	char           *ifname;
@@ -150,9 +177,10 @@ typedef struct di {
 	tcp_proxy_type_t proxy_type;
 	ddns_name_t    proxy_name;
 
-	/* Your aliases/names to update */
-	ddns_alias_t   alias[DDNS_MAX_ALIAS_NUMBER];
+	/* Your aliases/names to update, allocated when parsing .conf */
+	ddns_alias_t  *alias;
 	size_t         alias_count;
+	char          *names;	/* NUL separated hostnames of all aliases */
 
 	/* Use wildcard, *.foo.bar */
 	int            wildcard;
@@ -163,6 +191,9 @@ typedef struct di {
 	/* CDN proxied option */
 	int            proxied;
 
+	/* Max age of provider's zone snapshot, 0: refresh only on 404 */
+	long int       zone_refresh;
+
 	/*
 	 * Provider specific data, per-conf-entry.  E.g., the Cloudflare
 	 * plugin stores zone_id and hostname_id here.  Set up by the
@@ -173,6 +204,29 @@ typedef struct di {
 	/* Does the provider support SSL? */
 	int            ssl_enabled;
 	int            append_myip; /* For custom setups! */
+
+	/*
+	 * Scheduler state, each provider checks its address on its own
+	 * period, which is the error period after a temporary failure.
+	 * Aliases are only visited on address change or forced update,
+	 * otherwise they run on their own timers.
+	 */
+	loop_timer_t   timer;
+	loop_timer_t   defer;	/* Actual update after fake-address */
+	int            period;
+	int            num_iterations;
+	int            force_addr_update;
+	char           address[MAX_ADDRESS_LEN];
+
+	/*
+	 * Checks and updates run as jobs in worker threads, at most one
+	 * job per provider at a time.  While it runs the worker owns the
+	 * provider and its aliases, new work is held back until done.
+	 */
+	struct alias_list due;
+	int            busy;
+	int            check_pending;
+	int            update_pending;
 } ddns_info_t;
 
 /* Client context */
@@ -180,14 +234,13 @@ typedef struct {
 	char          *cfgfile;
 
 	ddns_cmd_t     cmd;
-	int            update_period; /* time between 2 updates */
 	int            normal_update_period_sec;
 	int            error_update_period_sec;
 	int            forced_update_period_sec;
 	int            forced_update_fake_addr;
-	int            cmd_check_period; /*time to wait for a command */
 	int            total_iterations;
 	int            num_iterations;
+	int            concurrency;
 	int            initialized;
 	int            change_persona;
 	int            use_proxy;
@@ -195,10 +248,10 @@ typedef struct {
 
 	http_trans_t   http_transaction;
 
-	char          *work_buf; /* for HTTP responses */
-	int            work_buflen;
+	buf_t         *work;	/* for HTTP responses, grows as needed */
 
-	char          *request_buf; /* for HTTP requests */
+	buf_t         *request;
+	char          *request_buf; /* for HTTP requests, in request */
 	size_t         request_buflen;
 } ddns_t;
 
@@ -224,9 +277,17 @@ extern gid_t gid;
 int ddns_main_loop (ddns_t *ctx);
 int ddns_get_tcp_force(const ddns_info_t *info);
 
-int common_request (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
+/* Provider table, read-only between parsing .conf and cleanup */
+size_t       conf_info_count (void);
+ddns_info_t *conf_info_get   (size_t id);
+ddns_info_t *conf_info_find  (const char *name);
+
+#define CONF_INFO_FOREACH(info, id) for ((id) = 0; ((info) = conf_info_get(id)); (id)++)
+
 int common_response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
+int common_batch_response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t **alias, int *result, size_t num);
+
 #endif /* DDNS_H_ */
 
 /**
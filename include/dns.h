@@ -0,0 +1,46 @@
+/* Interface to the in-process DNS resolver cache
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_DNS_H_
+#define INADYN_DNS_H_
+
+#include <netdb.h>
+#include <sys/socket.h>
+
+#define DNS_MAX_ADDRS     8
+#define DNS_DEFAULT_TTL   60		/* sec, when record TTL is unknown */
+#define DNS_MAX_TTL       3600		/* sec */
+
+int  dns_resolve (const char *host, int port, int family, struct addrinfo **result);
+void dns_free    (struct addrinfo *result);
+void dns_prefer  (const char *host, const struct sockaddr *sa);
+
+int  dns_pin     (const char *host, const char *address);
+void dns_flush   (void);
+
+#endif /* INADYN_DNS_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -56,6 +56,7 @@
 #define RC_DDNS_RSP_RETRY_LATER         49
 #define RC_DDNS_RSP_AUTH_FAIL           50
 #define RC_DDNS_RSP_TOO_FREQUENT        51
+#define RC_DDNS_RSP_UNCHANGED           52
 
 #define RC_OS_INVALID_IP_ADDRESS        61
 #define RC_OS_FORK_FAILURE              62
@@ -63,6 +64,7 @@
 #define RC_OS_INVALID_UID               64
 #define RC_OS_INVALID_GID               65
 #define RC_OS_INSTALL_SIGHANDLER_FAILED 66
+#define RC_OS_EVENT_LOOP_FAILED         67
 
 #define RC_FILE_IO_ACCESS_ERROR         73
 #define RC_FILE_IO_MISSING_FILE         74
@@ -40,13 +40,20 @@
 #include <gnutls/gnutls.h>
 #endif
 
+#include "buffer.h"
 #include "error.h"
 #include "os.h"
 #include "tcp.h"
 
+struct tls_conf;
+
 #define HTTP_DEFAULT_TIMEOUT	10000	/* msec */
 #define	HTTP_DEFAULT_PORT	80
 #define	HTTPS_DEFAULT_PORT	443
+#define HTTP_DEFAULT_KEEPALIVE	60	/* sec, max idle time of persistent connections */
+
+/* Set in .conf file, 0 disables persistent connections */
+extern int keepalive_timeout;
 
 typedef struct {
 	tcp_sock_t tcp;
@@ -55,35 +62,49 @@ typedef struct {
 #if defined(ENABLE_SSL)
 #if defined(CONFIG_OPENSSL)
 	SSL       *ssl;
-	SSL_CTX   *ssl_ctx;
 #elif defined(CONFIG_MBEDTLS)
 	mbedtls_ssl_context      ssl;
 	mbedtls_net_context      server_fd;
-	mbedtls_ssl_config       conf;
-	mbedtls_x509_crt         cacert;
-	mbedtls_ctr_drbg_context ctr_drbg;
-	mbedtls_entropy_context  entropy;
+	struct tls_conf         *tls;	/* Shared config and CA store */
 #else
 	gnutls_session_t ssl;
+	struct tls_conf *tls;		/* Shared credentials */
 #endif
 #endif
 
 	int        initialized;
 	int        connected;
+
+	/* Opt-in, HTTP/1.1 persistent connection, see http_exit() */
+	int        keepalive;
+	int        reused;
+	int        persistent;	/* Last response allows reuse */
+	char      *msg;
+	int        force;
 } http_t;
 
 typedef struct {
 	char *req;
 	int   req_len;
+	const struct iovec *iov; /* Optional, req_len bytes gathered from iov[] */
+	int   iovcnt;
 
 	char *rsp;
 	int   rsp_len;
 	int   max_rsp_len;
+	buf_t *buf;		/* Optional, backs rsp, grown for large responses */
 
 	char *rsp_body;
+	int   rsp_body_len;	/* After chunked decoding */
 
 	int   status;
 	char  status_desc[256];
+
+	/* Response headers of interest, spans in rsp, not NUL terminated */
+	long        content_length;	/* -1 if not sent */
+	int         retry_after;	/* sec, -1 if not sent or not in seconds */
+	const char *etag;		/* NULL if not sent */
+	int         etag_len;
 } http_trans_t;
 
 int http_construct          (http_t *client);
@@ -93,6 +114,8 @@ int http_init               (http_t *client, char *msg, int force);
 int http_exit               (http_t *client);
 
 int http_transaction        (http_t *client, http_trans_t *trans);
+void http_pool_flush        (void);
+long long http_pool_expire  (void);
 int http_status_valid       (int status);
 
 int http_set_port           (http_t *client, int  porg);
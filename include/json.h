@@ -1,6 +1,7 @@
 /* JSON helpers
  *
  * Copyright (C) 2019-2020 Simon Pilkington
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License
@@ -25,8 +26,50 @@
 #define JSMN_HEADER
 #include "jsmn.h"
 
-int parse_json(const char *json, jsmntok_t *out_tokens[]);
-int jsoneq(const char *json, const jsmntok_t *tok, const char *s);
-int json_bool(const char *json, const jsmntok_t *token, int *out_value);
+#include <stddef.h>
+
+#define JSON_MAX_TOKENS   256	/* Tokens on stack, grows on heap if needed */
+#define JSON_MAX_PATH     8	/* Max steps in a path, e.g. result[0].id is 3 */
+#define JSON_ANY          -1	/* Path step [*], any array element */
+
+/* Parsed document, tokens are in the caller's buffer or on the heap */
+typedef struct {
+	const char *js;
+	jsmntok_t  *tok;
+	int         num;
+	jsmntok_t  *heap;
+} json_t;
+
+/* Compiled path query, keys point into the path expression */
+typedef struct {
+	int num;
+	struct {
+		const char *key;	/* NULL for array element */
+		size_t      len;
+		int         index;	/* Array index, or JSON_ANY */
+	} step[JSON_MAX_PATH];
+} json_path_t;
+
+int  json_parse   (json_t *doc, const char *js, jsmntok_t *buf, int max);
+void json_free    (json_t *doc);
+
+int  json_compile (json_path_t *path, const char *expr);
+int  json_find    (const json_t *doc, int from, const json_path_t *path, int match[], int max);
+int  json_query   (const json_t *doc, int from, const char *expr);
+int  json_next    (const json_t *doc, int i);
+
+int  json_copy    (const json_t *doc, int tok, char *buf, size_t len);
+int  json_get     (const json_t *doc, int from, const char *expr, char *buf, size_t len);
+int  json_is      (const json_t *doc, int from, const char *expr, const char *value);
+
+int  jsoneq       (const char *json, const jsmntok_t *tok, const char *s);
+int  json_bool    (const char *json, const jsmntok_t *token, int *out_value);
 
 #endif
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -33,6 +33,7 @@ void log_init  (char *ident, int log, int bg);
 void log_exit  (void);
 
 int  log_level (char *level);
+int  log_enabled (int prio);
 
 void logitf     (int prio, const char *fmt, ...);
 void vlogit    (int prio, const char *fmt, va_list args);
@@ -0,0 +1,73 @@
+/* Interface to the main event loop
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_LOOP_H_
+#define INADYN_LOOP_H_
+
+#include <stddef.h>
+#include <time.h>
+
+#define LOOP_MAX_FDS  32
+#define LOOP_FOREVER  -1
+
+typedef struct loop_timer loop_timer_t;
+
+typedef void (*loop_io_fn_t)   (int fd,          void *arg);
+typedef void (*loop_sig_fn_t)  (int signo,       void *arg);
+typedef void (*loop_timer_fn_t)(loop_timer_t *t, void *arg);
+
+/*
+ * One-shot timer, embedded in the object it schedules.  Kept in a
+ * min-heap ordered by deadline, @index is its position in the heap,
+ * or zero when not queued.
+ */
+struct loop_timer {
+	long long        deadline;	/* Monotonic time, in msec */
+	size_t           index;
+	loop_timer_fn_t  cb;
+	void            *arg;
+};
+
+int  loop_init   (void);
+void loop_exit   (void);
+
+int  loop_add    (int fd, loop_io_fn_t cb, void *arg);
+int  loop_del    (int fd);
+int  loop_signal (int signo, loop_sig_fn_t cb, void *arg);
+
+void loop_timer_init    (loop_timer_t *t, loop_timer_fn_t cb, void *arg);
+int  loop_timer_add     (loop_timer_t *t, long long msec);
+void loop_timer_del     (loop_timer_t *t);
+int  loop_timer_pending (loop_timer_t *t);
+
+int  loop_run    (time_t timeout);
+void loop_break  (void);
+
+long long loop_now (void);
+
+#endif /* INADYN_LOOP_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,44 @@
+/* Interface to the netlink interface address monitor
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_NETLINK_H_
+#define INADYN_NETLINK_H_
+
+/* Called in main thread when an address is added to, or removed from, @ifname */
+typedef void (*netlink_change_fn_t)(const char *ifname, void *arg);
+
+/* Called for each address of an interface, @host is in numeric form */
+typedef void (*netlink_addr_fn_t)(int family, const char *host, void *arg);
+
+int  netlink_init    (void);
+void netlink_exit    (void);
+
+void netlink_notify  (netlink_change_fn_t cb, void *arg);
+int  netlink_foreach (const char *ifname, netlink_addr_fn_t cb, void *arg);
+
+#endif /* INADYN_NETLINK_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
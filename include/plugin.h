@@ -25,6 +25,7 @@
 #define INADYN_PLUGIN_H_
 
 #include "config.h"
+#include <stddef.h>
 #include "queue.h"		/* BSD sys/queue.h API */
 
 #define GENERIC_HTTP_REQUEST                                      	\
@@ -40,9 +41,14 @@
 /* Types used for DNS system specific configuration */
 /* Function to prepare DNS system specific server requests */
 typedef int (*setup_fn_t) (void* this, void* info, void* alias);
+/* Optional, without it server_req is a request template, see template.h */
 typedef int (*req_fn_t) (void *this, void *info, void *alias);
 typedef int (*rsp_fn_t) (void *this, void *info, void *alias);
 
+/* Optional, update many aliases in one request, @alias is an array */
+typedef int (*batch_req_fn_t) (void *this, void *info, void *alias, size_t num);
+typedef int (*batch_rsp_fn_t) (void *this, void *info, void *alias, int *result, size_t num);
+
 typedef struct ddns_system {
 	TAILQ_ENTRY(ddns_system) link; /* BSD sys/queue.h linked list node. */
 
@@ -55,7 +61,11 @@ typedef struct ddns_system {
 	req_fn_t       request;
 	rsp_fn_t       response;
 
+	batch_req_fn_t batch_request;
+	batch_rsp_fn_t batch_response;
+
 	const int      nousername;    /* Provider does not require username='' */
+	const int      keepalive;     /* HTTP/1.1 requests, reuse connections */
 
 	const char    *checkip_name;
 	const char    *checkip_url;
@@ -0,0 +1,48 @@
+/* Interface to the worker thread pool
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_POOL_H_
+#define INADYN_POOL_H_
+
+#define POOL_MAX_THREADS  32
+
+/*
+ * The @work callback runs in a worker thread, the @done callback runs
+ * in the main thread, from the event loop, when @work has completed.
+ * If the pool is stopped before @work has started, only @done is
+ * called, with @ran set to zero.
+ */
+typedef void (*pool_work_fn_t)(void *arg);
+typedef void (*pool_done_fn_t)(void *arg, int ran);
+
+int  pool_init   (int num);
+void pool_exit   (void);
+
+int  pool_submit (pool_work_fn_t work, pool_done_fn_t done, void *arg);
+
+#endif /* INADYN_POOL_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
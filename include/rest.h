@@ -0,0 +1,43 @@
+/* Helpers for REST API style plugins
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_REST_H_
+#define INADYN_REST_H_
+
+#include "ddns.h"
+
+#define REST_MAX_ID       64		/* Including NUL */
+
+int  rest_call    (ddns_t *ctx, ddns_info_t *info, const char *msg, http_trans_t *trans, int len);
+
+int  rest_id_get  (ddns_info_t *info, ddns_alias_t *alias, const char *key, char *id, size_t len);
+int  rest_id_set  (ddns_info_t *info, ddns_alias_t *alias, const char *key, const char *id);
+void rest_id_drop (ddns_info_t *info, ddns_alias_t *alias);
+
+#endif /* INADYN_REST_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,42 @@
+/* TLS session cache for resumed HTTPS handshakes
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_SESSION_H_
+#define INADYN_SESSION_H_
+
+#include <stddef.h>
+
+#define SESSION_MAX_LEN   8192		/* Max size of a serialized session */
+#define SESSION_LIFETIME  7200		/* sec, servers rarely keep them longer */
+
+int  session_get   (const char *host, int port, void **data, size_t *len);
+void session_put   (const char *host, int port, const void *data, size_t len);
+void session_flush (void);
+
+#endif /* INADYN_SESSION_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -33,6 +33,9 @@ extern char *ca_trust_file;
 extern int secure_ssl;
 extern int broken_rtc;
 
+/* Resumed TLS sessions can be saved in the cache dir, disabled by default */
+extern int persist_ssl_sessions;
+
 #ifdef ENABLE_SSL
 int     ssl_init(void);
 void    ssl_exit(void);
@@ -41,6 +44,7 @@ int     ssl_open(http_t *client, char *msg, int force);
 int     ssl_close(http_t *client);
 
 int     ssl_send(http_t *client, const char *buf, int     len);
+int     ssl_sendv(http_t *client, const struct iovec *iov, int iovcnt);
 int     ssl_recv(http_t *client,       char *buf, int buf_len, int *recv_len);
 
 #else
@@ -51,6 +55,7 @@ int     ssl_recv(http_t *client,       char *buf, int buf_len, int *recv_len);
 #define ssl_close(client)                        tcp_exit(&client->tcp)
 
 #define ssl_send(client, buf, len)               tcp_send(&client->tcp, buf, len)
+#define ssl_sendv(client, iov, iovcnt)           tcp_sendv(&client->tcp, iov, iovcnt)
 #define ssl_recv(client, buf, buf_len, recv_len) tcp_recv(&client->tcp, buf, buf_len, recv_len)
 
 #endif /* ENABLE_SSL */
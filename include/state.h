@@ -0,0 +1,47 @@
+/* Interface to the persistent, journaled state store
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_STATE_H_
+#define INADYN_STATE_H_
+
+#include <stddef.h>
+
+#define STATE_FILE        "inadyn.state"
+#define STATE_MAX_VALUE   256		/* Including NUL */
+
+int  state_open   (const char *dir);
+void state_close  (void);
+
+int  state_get    (const char *sysname, const char *alias, const char *key, char *buf, size_t len);
+int  state_set    (const char *sysname, const char *alias, const char *key, const char *value);
+int  state_del    (const char *sysname, const char *alias, const char *key);
+
+int  state_commit (void);
+
+#endif /* INADYN_STATE_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
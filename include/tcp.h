@@ -23,12 +23,17 @@
 #ifndef INADYN_TCP_H_
 #define INADYN_TCP_H_
 
+#include <sys/uio.h>
+#include "dns.h"
 #include "os.h"
 #include "error.h"
 
 #define TCP_DEFAULT_TIMEOUT		5000	/* msec */
 #define TCP_SOCKET_MAX_PORT		65535
 #define TCP_DEFAULT_READ_CHUNK_SIZE	100
+#define TCP_ATTEMPT_DELAY		250	/* msec, RFC 8305 */
+#define TCP_FALLBACK_DELAY		2000	/* msec, before trying non-preferred family */
+#define TCP_MAX_ATTEMPTS		DNS_MAX_ADDRS
 
 #define TCP_AUTO	0
 #define TCP_FORCE_IPV4	1
@@ -64,6 +69,7 @@ int tcp_init               (tcp_sock_t *tcp, char *msg, int force);
 int tcp_exit               (tcp_sock_t *tcp);
 
 int tcp_send               (tcp_sock_t *tcp, const char *buf, int len);
+int tcp_sendv              (tcp_sock_t *tcp, const struct iovec *iov, int iovcnt);
 int tcp_recv               (tcp_sock_t *tcp,       char *buf, int len, int *recv_len);
 
 int tcp_set_port           (tcp_sock_t *tcp, int  port);
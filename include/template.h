@@ -0,0 +1,92 @@
+/* Compiled HTTP request templates
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_TEMPLATE_H_
+#define INADYN_TEMPLATE_H_
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+/*
+ * Request template format specifiers, everything except %h, %H and %i is
+ * expanded when the template is compiled at startup:
+ *
+ * %U - server URL, i.e., ddns-path, as-is
+ * %P - server URL with the custom provider's %u, %p, %h, and %i
+ *      specifiers, URL encoded, hostname or address appended if none
+ * %S - server name, for the Host: header
+ * %C - base64 encoded credentials, for HTTP basic auth
+ * %u - username, as-is
+ * %p - password, as-is
+ * %m - MD5 hex digest of the password
+ * %A - user agent
+ * %W - "&wildcard=ON" if wildcard is enabled, otherwise nothing
+ * %w - "ON" or "OFF", depending on wildcard
+ * %h - hostname, or comma separated list of hostnames in a batch
+ * %H - hostname without the provider's domain, e.g., foo for
+ *      foo.duckdns.org, or all of it if not in that domain
+ * %i - IP address
+ * %% - a single %
+ */
+#define TMPL_MAX_SEGMENTS  32
+#define TMPL_MAX_IOV       (TMPL_MAX_SEGMENTS + 2 * DDNS_MAX_BATCH_NUMBER)
+
+typedef enum {
+	TMPL_LITERAL = 0,
+	TMPL_HOSTNAME,
+	TMPL_SUBDOMAIN,
+	TMPL_ADDRESS,
+} tmpl_type_t;
+
+typedef struct {
+	tmpl_type_t    type;
+	int            encode;	/* URL encode value when rendering */
+	size_t         off;	/* Literal span in text[] */
+	size_t         len;
+} tmpl_seg_t;
+
+typedef struct tmpl {
+	size_t         num;
+	tmpl_seg_t     seg[TMPL_MAX_SEGMENTS];
+
+	size_t         len;
+	char           text[];
+} tmpl_t;
+
+struct di;
+struct da;
+
+int  tmpl_compile (struct di *info);
+void tmpl_free    (struct di *info);
+
+int  tmpl_render  (struct di *info, struct da **alias, size_t num, char *buf, size_t len,
+		   struct iovec *iov, int *iovcnt);
+int  tmpl_copy    (const struct iovec *iov, int iovcnt, char *buf, size_t len);
+
+#endif /* INADYN_TEMPLATE_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
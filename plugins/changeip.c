@@ -24,22 +24,20 @@
 #include "plugin.h"
 
 #define CHANGEIP_UPDATE_IP_HTTP_REQUEST					\
-	"GET %s?"							\
+	"GET %U?"							\
 	"system=dyndns&"						\
-	"hostname=%s&"							\
-	"myip=%s "							\
+	"hostname=%h&"							\
+	"myip=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"Authorization: Basic %s\r\n"					\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"Authorization: Basic %C\r\n"					\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@changeip.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ip.changeip.com",
@@ -52,7 +50,6 @@ static ddns_system_t plugin = {
 static ddns_system_t ovh = {
 	.name         = "default@ovh.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -67,7 +64,6 @@ static ddns_system_t ovh = {
 static ddns_system_t strato = {
 	.name         = "default@strato.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -78,18 +74,6 @@ static ddns_system_t strato = {
 	.server_url   = "/nic/update"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->name,
-			alias->address,
-			info->server_name.name,
-			info->creds.encoded_password,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	return common_response(trans, info, alias);
@@ -19,8 +19,12 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include <pthread.h>
+#include <time.h>
+
 #include "plugin.h"
 #include "json.h"
+#include "rest.h"
 
 #define CHECK(fn)       { rc = (fn); if (rc) goto cleanup; }
 
@@ -28,7 +32,7 @@
 #define API_URL "/client/v4"
 
 /* https://developers.cloudflare.com/api/operations/zones-get */
-static const char *CLOUDFLARE_ZONE_ID_REQUEST = "GET " API_URL "/zones?name=%s HTTP/1.0\r\n"	\
+static const char *CLOUDFLARE_ZONE_ID_REQUEST = "GET " API_URL "/zones?name=%s HTTP/1.1\r\n"	\
 	"Host: " API_HOST "\r\n"		\
 	"User-Agent: %s\r\n"			\
 	"Accept: */*\r\n"				\
@@ -36,7 +40,7 @@ static const char *CLOUDFLARE_ZONE_ID_REQUEST = "GET " API_URL "/zones?name=%s H
 	"Content-Type: application/json\r\n\r\n";
 
 /* https://developers.cloudflare.com/api/operations/dns-records-for-a-zone-dns-record-details */	
-static const char *CLOUDFLARE_HOSTNAME_NAME_REQUEST_BY_ID	= "GET " API_URL "/zones/%s/dns_records/%s HTTP/1.0\r\n"	\
+static const char *CLOUDFLARE_HOSTNAME_NAME_REQUEST_BY_ID	= "GET " API_URL "/zones/%s/dns_records/%s HTTP/1.1\r\n"	\
 	"Host: " API_HOST "\r\n"		\
 	"User-Agent: %s\r\n"			\
 	"Accept: */*\r\n"				\
@@ -44,7 +48,7 @@ static const char *CLOUDFLARE_HOSTNAME_NAME_REQUEST_BY_ID	= "GET " API_URL "/zon
 	"Content-Type: application/json\r\n\r\n";
 
 /* https://developers.cloudflare.com/api/operations/dns-records-for-a-zone-list-dns-records */	
-static const char *CLOUDFLARE_HOSTNAME_ID_REQUEST_BY_NAME	= "GET " API_URL "/zones/%s/dns_records?type=%s&name=%s%s HTTP/1.0\r\n"	\
+static const char *CLOUDFLARE_RECORDS_REQUEST	= "GET " API_URL "/zones/%s/dns_records?per_page=%d&page=%d HTTP/1.1\r\n"	\
 	"Host: " API_HOST "\r\n"		\
 	"User-Agent: %s\r\n"			\
 	"Accept: */*\r\n"				\
@@ -52,7 +56,7 @@ static const char *CLOUDFLARE_HOSTNAME_ID_REQUEST_BY_NAME	= "GET " API_URL "/zon
 	"Content-Type: application/json\r\n\r\n";
 
 /* https://developers.cloudflare.com/api/operations/dns-records-for-a-zone-create-dns-record */	
-static const char *CLOUDFLARE_HOSTNAME_CREATE_REQUEST	= "POST " API_URL "/zones/%s/dns_records HTTP/1.0\r\n"	\
+static const char *CLOUDFLARE_HOSTNAME_CREATE_REQUEST	= "POST " API_URL "/zones/%s/dns_records HTTP/1.1\r\n"	\
 	"Host: " API_HOST "\r\n"		\
 	"User-Agent: %s\r\n"			\
 	"Accept: */*\r\n"				\
@@ -62,7 +66,7 @@ static const char *CLOUDFLARE_HOSTNAME_CREATE_REQUEST	= "POST " API_URL "/zones/
 	"%s";
 
 /* https://developers.cloudflare.com/api/operations/dns-records-for-a-zone-update-dns-record */
-static const char *CLOUDFLARE_HOSTNAME_UPDATE_REQUEST	= "PATCH " API_URL "/zones/%s/dns_records/%s HTTP/1.0\r\n"	\
+static const char *CLOUDFLARE_HOSTNAME_UPDATE_REQUEST	= "PATCH " API_URL "/zones/%s/dns_records/%s HTTP/1.1\r\n"	\
 	"Host: " API_HOST "\r\n"		\
 	"User-Agent: %s\r\n"			\
 	"Accept: */*\r\n"				\
@@ -87,6 +91,7 @@ static ddns_system_t plugin = {
 	.setup        = (setup_fn_t)setup,
 	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
+	.keepalive    = 1,
 
 	/*
 	 * 1.1.1.1 is chosen here due to "allow-ipv6" is default to false
@@ -104,15 +109,59 @@ static ddns_system_t plugin = {
 
 /*
  * filled by the setup() callback and handed to ddns_info_t
- * for use later in the request() callback .
+ * for use later in the request() callback .  The zone id is looked up
+ * once, and saved in the state file to survive a restart.  The A and
+ * AAAA records of the zone are then listed, page by page, into a zone
+ * snapshot indexed by name and type, used to find the record id of
+ * each hostname, and to skip updates of records already pointing to
+ * the address.  Zones are shared by all provider sections using the
+ * same API token.  The snapshot is refreshed when older than the
+ * zone-refresh setting, or when Cloudflare responds 404.
  */
 #define MAX_ID (32 + 1)
+#define ZONE_PAGE_SIZE    100		/* Records per page of zone listing */
+#define ZONE_MAX_PAGES    1000
+
+struct cfrec {
+	const char *type;		/* Record type id was looked up for */
+	int         byid;		/* Round-robin record, given by id */
+	char        id[MAX_ID];		/* Empty, record is created */
+};
+
+struct cfname {
+	char       *name;		/* E.g. host.example.com or *.example.com */
+	const char *type;		/* IPV4_RECORD_TYPE or IPV6_RECORD_TYPE */
+	char        id[MAX_ID];
+	char        content[MAX_ADDRESS_LEN];
+	int         proxied;
+	long int    ttl;
+};
+
+struct cfzone {
+	LIST_ENTRY(cfzone) link;
+	char           *token;
+	char           *name;
+	char            id[MAX_ID];
+
+	pthread_mutex_t lock;		/* Held while listing and looking up records */
+	time_t          fetched;	/* Time of snapshot, zero when stale */
+	struct cfname  *rec;
+	size_t          num;
+	size_t          max;
+	size_t         *index;		/* Index in rec[] + 1, by hash of name and type */
+	size_t          index_size;	/* Power of two, at least 2 * max */
+};
 
 struct cfdata {
-	char zone_id[MAX_ID];
-	char hostname_id[MAX_ID];
+	char           zone_id[MAX_ID];
+	struct cfzone *zone;
+	size_t         num;
+	struct cfrec   rec[];		/* One per hostname */
 };
 
+static LIST_HEAD(, cfzone) zones = LIST_HEAD_INITIALIZER(zones);
+static pthread_mutex_t zones_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static int check_response_code(int status)
 {
 	switch (status)
@@ -141,255 +190,576 @@ static int check_response_code(int status)
 	}
 }
 
-static int check_success(const char *json, const jsmntok_t tokens[], const int num_tokens)
+/* Responses are { "success": true, "result": ... }, fetch value at @path */
+static int json_extract(ddns_t *ctx, char *dest, size_t dest_size, ddns_info_t *info, size_t request_len, const char *path)
 {
-	int i;
+	jsmntok_t     tokens[JSON_MAX_TOKENS];
+	http_trans_t  trans;
+	json_t        doc = { 0 };
+	int           rc = RC_OK;
 
-	for (i = 1; i < num_tokens; i++) {
-		int set;
+	CHECK(rest_call(ctx, info, "Json query", &trans, request_len));
+	CHECK(check_response_code(trans.status));
 
-		if (jsoneq(json, tokens + i, KEY_SUCCESS) != 0)
-			continue;
+	if (json_parse(&doc, trans.rsp_body, tokens, NELEMS(tokens)) < 0) {
+		rc = RC_DDNS_RSP_NOHOST;
+		goto cleanup;
+	}
 
-		if (i < num_tokens - 1 && json_bool(json, tokens + i + 1, &set) == 0)
-			return set ? 0 : -1;
-				
-		return -1;
+	if (!json_is(&doc, 0, KEY_SUCCESS, "true")) {
+		logit(LOG_ERR, "Request was unsuccessful.");
+		rc = RC_DDNS_RSP_NOHOST;
+		goto cleanup;
 	}
-	
-	return -1;
+
+	switch (json_get(&doc, 0, path, dest, dest_size)) {
+	case 0:
+		logit(LOG_DEBUG, "Key '%s' = %s", path, dest);
+		break;
+	case -2:
+		logit(LOG_ERR, "Key value did not fit into buffer.");
+		rc = RC_BUFFER_OVERFLOW;
+		break;
+	default:
+		logit(LOG_INFO, "Could not find key '%s'.", path);
+		rc = RC_DDNS_RSP_NOHOST;
+		break;
+	}
+
+cleanup:
+	json_free(&doc);
+
+	return rc;
 }
 
-static int check_success_only(const char *json)
+static const char* get_record_type(const char *address)
 {
-	jsmntok_t *tokens;
-	int num_tokens;
-	int result;
-	
-	num_tokens = parse_json(json, &tokens);	
-	if (num_tokens == -1)
-		return -1;
-
-	result = check_success(json, tokens, num_tokens);
-	free(tokens);
+	if (strstr(address, ":"))
+		return IPV6_RECORD_TYPE;
 
-	return result;
+	return IPV4_RECORD_TYPE;
 }
 
-static int get_result_value(const char *json, const char *key, jsmntok_t *out_result)
+/* Shared zone of provider section, by API token and zone name */
+static struct cfzone *zone_get(const char *token, const char *name)
 {
-	jsmntok_t *tokens;
-	int i, num_tokens;
-	
-	num_tokens = parse_json(json, &tokens);
-	if (num_tokens < 0)
-		return -1;
-	
-	if (tokens[0].type != JSMN_OBJECT) {
-		logit(LOG_ERR, "JSON response contained no objects.");
-		goto cleanup;
+	struct cfzone *z;
+
+	pthread_mutex_lock(&zones_lock);
+	LIST_FOREACH(z, &zones, link) {
+		if (!strcmp(z->token, token) && !strcasecmp(z->name, name))
+			goto done;
 	}
-	
-	if (check_success(json, tokens, num_tokens) == -1) {
-		logit(LOG_ERR, "Request was unsuccessful.");
-		goto cleanup;
+
+	z = calloc(1, sizeof(*z));
+	if (!z)
+		goto done;
+
+	z->token = strdup(token);
+	z->name  = strdup(name);
+	if (!z->token || !z->name) {
+		free(z->token);
+		free(z->name);
+		free(z);
+		z = NULL;
+		goto done;
 	}
-	
-	for (i = 1; i < num_tokens; i++) {
-		if (jsoneq(json, tokens + i, key) != 0)
-			continue;
-
-		if (i < num_tokens - 1) {
-			*out_result = tokens[i+1];
-			free(tokens);
-			return 0;
-		}
+
+	pthread_mutex_init(&z->lock, NULL);
+	LIST_INSERT_HEAD(&zones, z, link);
+done:
+	pthread_mutex_unlock(&zones_lock);
+
+	return z;
+}
+
+static void zone_clear(struct cfzone *z)
+{
+	size_t i;
+
+	for (i = 0; i < z->num; i++)
+		free(z->rec[i].name);
+	if (z->index)
+		memset(z->index, 0, z->index_size * sizeof(size_t));
+	z->num     = 0;
+	z->fetched = 0;
+}
+
+static void zone_free(struct cfzone *z)
+{
+	zone_clear(z);
+	pthread_mutex_destroy(&z->lock);
+	free(z->index);
+	free(z->rec);
+	free(z->token);
+	free(z->name);
+	free(z);
+}
+
+static size_t zone_slot(const struct cfzone *z, const char *name, const char *type)
+{
+	size_t mask = z->index_size - 1;
+	size_t pos  = (string_hash(name, -1) + (type == IPV6_RECORD_TYPE)) & mask;
+
+	while (z->index[pos]) {
+		const struct cfname *r = &z->rec[z->index[pos] - 1];
+
+		if (r->type == type && !strcasecmp(r->name, name))
+			break;
+		pos = (pos + 1) & mask;
 	}
-	
-	logit(LOG_INFO, "Could not find key '%s'.", key);
 
-cleanup:
-	free(tokens);
-	return -1;
+	return pos;
 }
 
-static int json_copy_value(char *dest, size_t dest_size, const char *json, const jsmntok_t *token)
+static struct cfname *zone_find(const struct cfzone *z, const char *name, const char *type)
 {
-	size_t length;
+	size_t pos;
 
-	if (token->type != JSMN_STRING)
-		return -1;
-	
-	length = token->end - token->start + 1;
-	if (length > dest_size)
-		return -2;
-	
-	strlcpy(dest, json + token->start, length);
+	if (!z->index_size)
+		return NULL;
 
-	return 0;
+	pos = zone_slot(z, name, type);
+	if (!z->index[pos])
+		return NULL;
+
+	return &z->rec[z->index[pos] - 1];
 }
 
-static int json_extract(char *dest, size_t dest_size, const ddns_info_t *info, char *request, size_t request_len, const char *key)
+static struct cfname *zone_add(struct cfzone *z, const char *name, const char *type)
 {
-	const char   *body;
-	http_trans_t  trans;
-	jsmntok_t     key_value;
-	http_t        client;
-	char         *response_buf;
-	size_t        response_buflen = DDNS_HTTP_RESPONSE_BUFFER_SIZE;
-	int           rc = RC_OK;
+	struct cfname *r;
+	size_t i;
+
+	if (z->num == z->max) {
+		size_t max = z->max ? 2 * z->max : 64;
+		size_t *index;
+
+		r = realloc(z->rec, max * sizeof(*r));
+		if (!r)
+			return NULL;
+		z->rec = r;
+
+		index = calloc(2 * max, sizeof(size_t));
+		if (!index)
+			return NULL;
+		free(z->index);
+		z->index      = index;
+		z->index_size = 2 * max;
+		z->max        = max;
+
+		for (i = 0; i < z->num; i++)
+			z->index[zone_slot(z, z->rec[i].name, z->rec[i].type)] = i + 1;
+	}
+
+	r = &z->rec[z->num];
+	memset(r, 0, sizeof(*r));
+	r->name = strdup(name);
+	if (!r->name)
+		return NULL;
+	r->type    = type;
+	r->proxied = -1;
+	r->ttl     = -1;
 
-	response_buf = calloc(response_buflen, sizeof(char));
-	if (!response_buf)
+	z->index[zone_slot(z, name, type)] = ++z->num;
+
+	return r;
+}
+
+/* Add A or AAAA record from zone listing, for round-robin the first wins */
+static int zone_load(struct cfzone *z, const json_t *doc, int tok)
+{
+	struct cfname *r;
+	const char *type;
+	char name[SERVER_NAME_LEN];
+	char buf[16];
+
+	if (json_get(doc, tok, "type", buf, sizeof(buf)))
+		return 0;
+	if (!strcmp(buf, IPV4_RECORD_TYPE))
+		type = IPV4_RECORD_TYPE;
+	else if (!strcmp(buf, IPV6_RECORD_TYPE))
+		type = IPV6_RECORD_TYPE;
+	else
+		return 0;
+
+	if (json_get(doc, tok, "name", name, sizeof(name)) || zone_find(z, name, type))
+		return 0;
+
+	r = zone_add(z, name, type);
+	if (!r)
 		return RC_OUT_OF_MEMORY;
 
-	CHECK(http_construct(&client));
+	json_get(doc, tok, "id", r->id, sizeof(r->id));
+	json_get(doc, tok, "content", r->content, sizeof(r->content));
+	if (!json_get(doc, tok, "proxied", buf, sizeof(buf)))
+		r->proxied = !strcmp(buf, "true");
+	if (!json_get(doc, tok, "ttl", buf, sizeof(buf)))
+		r->ttl = atol(buf);
 
-	http_set_port(&client, info->server_name.port);
-	http_set_remote_name(&client, info->server_name.name);
+	return 0;
+}
 
-	client.ssl_enabled = info->ssl_enabled;
-	CHECK(http_init(&client, "Json query", ddns_get_tcp_force(info)));
+/* List A and AAAA records of zone, one page at a time, into snapshot */
+static int zone_fetch(ddns_t *ctx, ddns_info_t *info, struct cfzone *z)
+{
+	jsmntok_t tokens[JSON_MAX_TOKENS];
+	int page = 1, pages = 1;
+	int rc = RC_OK;
 
-	trans.req = request;
-	trans.req_len = request_len;
-	trans.rsp = response_buf;
-	trans.max_rsp_len = response_buflen - 1; /* Save place for a \0 at the end */
+	zone_clear(z);
+	do {
+		http_trans_t trans;
+		json_t doc;
+		char buf[16];
+		int result, i, k;
+		size_t len;
 
-	logit(LOG_DEBUG, "Request:\n%s", request);
-	CHECK(http_transaction(&client, &trans));
+		len = snprintf(ctx->request_buf, ctx->request_buflen,
+			       CLOUDFLARE_RECORDS_REQUEST,
+			       z->id, ZONE_PAGE_SIZE, page,
+			       info->user_agent,
+			       info->creds.password);
+		if (len >= ctx->request_buflen)
+			return RC_BUFFER_OVERFLOW;
 
-	http_exit(&client);
-	http_destruct(&client, 1);
+		rc = rest_call(ctx, info, "Sending zone records query", &trans, len);
+		if (rc)
+			break;
 
-	logit(LOG_DEBUG, "Response:\n%s", trans.rsp);
-	CHECK(check_response_code(trans.status));
+		/* Zone deleted since we looked it up */
+		if (trans.status == 404) {
+			logit(LOG_WARNING, "HTTP 404: Cloudflare zone %s not found, looking it up again on retry.", z->name);
+			z->id[0] = 0;
+			rc = RC_DDNS_RSP_RETRY_LATER;
+			break;
+		}
 
-	body = trans.rsp_body;
-	if (get_result_value(body, key, &key_value) < 0) {
-		rc = RC_DDNS_RSP_NOHOST;
-		goto cleanup;
-	}
+		rc = check_response_code(trans.status);
+		if (rc)
+			break;
 
-	if (json_copy_value(dest, dest_size, body, &key_value) < 0) {
-		logit(LOG_ERR, "Key value did not fit into buffer.");
-		rc = RC_BUFFER_OVERFLOW;
+		if (json_parse(&doc, trans.rsp_body, tokens, NELEMS(tokens)) < 0) {
+			rc = RC_DDNS_RSP_NOTOK;
+			break;
+		}
+
+		result = json_query(&doc, 0, "result");
+		if (!json_is(&doc, 0, KEY_SUCCESS, "true") || result < 0 || doc.tok[result].type != JSMN_ARRAY) {
+			logit(LOG_ERR, "Request was unsuccessful.");
+			rc = RC_DDNS_RSP_NOTOK;
+		}
+
+		for (i = result + 1, k = 0; !rc && k < doc.tok[result].size; i = json_next(&doc, i), k++)
+			rc = zone_load(z, &doc, i);
+
+		if (!rc && !json_get(&doc, 0, "result_info.total_pages", buf, sizeof(buf)))
+			pages = atoi(buf);
+		json_free(&doc);
+	} while (!rc && page++ < pages && page <= ZONE_MAX_PAGES);
+
+	if (rc) {
+		zone_clear(z);
+		return rc;
 	}
-	logit(LOG_DEBUG, "Key '%s' = %s", key, dest);
 
-cleanup:
-	free(response_buf);
+	z->fetched = time(NULL);
+	logit(LOG_DEBUG, "Cloudflare Zone: '%s', %zu A/AAAA records", z->name, z->num);
 
-	return rc;
+	return RC_OK;
 }
 
-static const char* get_record_type(const char *address)
+static int zone_stale(const ddns_info_t *info, const struct cfzone *z)
 {
-	if (strstr(address, ":"))
-		return IPV6_RECORD_TYPE;
+	if (!z->fetched)
+		return 1;
 
-	return IPV4_RECORD_TYPE;
+	return info->zone_refresh > 0 && time(NULL) - z->fetched >= info->zone_refresh;
 }
 
-static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
+static struct cfrec *get_record(ddns_info_t *info, ddns_alias_t *hostname)
 {
-	const char *record_type;
-	struct cfdata *data;
-	size_t len;
-	const char *zone_name = info->creds.username;
-	int rc = RC_OK;
+	struct cfdata *data = (struct cfdata *)info->data;
+	size_t i = hostname - info->alias;
 
-	if (*zone_name == '\0' || !strchr(zone_name, '.'))
-	{
-		logit(LOG_ERR, "Invalid zone. Enter the Cloudflare zone in the username field.");
-		return RC_DDNS_INVALID_OPTION;
-	}
+	if (!data || i >= data->num)
+		return NULL;
 
-	data = calloc(1, sizeof(struct cfdata));
-	if (!data)
-		return RC_OUT_OF_MEMORY;
+	return &data->rec[i];
+}
 
-	if (info->data)
-		free(info->data);
-	info->data = data;
+/* Saved ids are only valid for the same zone, record type, and name */
+static void record_key(char *buf, size_t len, const ddns_info_t *info, const char *record_type)
+{
+	snprintf(buf, len, "%s/%s/%d", info->creds.username, record_type, info->wildcard);
+}
 
-	record_type = get_record_type(hostname->address);
+static int load_record(ddns_info_t *info, ddns_alias_t *hostname, const char *record_type)
+{
+	struct cfdata *data = (struct cfdata *)info->data;
+	struct cfrec *rec = get_record(info, hostname);
+	char buf[2 * MAX_ID];
+	char key[USERNAME_LEN + 16];
+	char *zone_id, *id;
 
-	logit(LOG_DEBUG, "Zone: %s", zone_name);
+	record_key(key, sizeof(key), info, record_type);
+	if (rest_id_get(info, hostname, key, buf, sizeof(buf)))
+		return -1;
+
+	zone_id = buf;
+	id = strchr(zone_id, '/');
+	if (!id)
+		return -1;
+	*id++ = 0;
+
+	if (strlen(zone_id) >= MAX_ID || !zone_id[0] || strlen(id) >= MAX_ID || !id[0])
+		return -1;
+
+	strlcpy(data->zone_id, zone_id, sizeof(data->zone_id));
+	strlcpy(rec->id, id, sizeof(rec->id));
+	rec->type = record_type;
+
+	return 0;
+}
+
+static void save_record(ddns_info_t *info, ddns_alias_t *hostname)
+{
+	struct cfdata *data = (struct cfdata *)info->data;
+	struct cfrec *rec = get_record(info, hostname);
+	char key[USERNAME_LEN + 16];
+	char buf[2 * MAX_ID];
+
+	record_key(key, sizeof(key), info, rec->type);
+	snprintf(buf, sizeof(buf), "%s/%s", data->zone_id, rec->id);
+	rest_id_set(info, hostname, key, buf);
+}
+
+/* Look up zone and record again on next update */
+static void drop_record(ddns_info_t *info, ddns_alias_t *hostname)
+{
+	struct cfdata *data = (struct cfdata *)info->data;
+	struct cfrec *rec = get_record(info, hostname);
+
+	if (!rec->id[0])
+		data->zone_id[0] = 0;
+	rec->type = NULL;
+	rec->id[0] = 0;
+
+	rest_id_drop(info, hostname);
+}
+
+static int zone_lookup(ddns_t *ctx, ddns_info_t *info, struct cfzone *z)
+{
+	size_t len;
+	int rc;
+
+	logit(LOG_DEBUG, "Zone: %s", z->name);
 
 	len = snprintf(ctx->request_buf, ctx->request_buflen,
 		       CLOUDFLARE_ZONE_ID_REQUEST,
-		       zone_name,
+		       z->name,
 		       info->user_agent,
 		       info->creds.password);
 
 	if (len >= ctx->request_buflen) {
-		logit(LOG_ERR, "Request for zone '%s' did not fit into buffer.", zone_name);
+		logit(LOG_ERR, "Request for zone '%s' did not fit into buffer.", z->name);
 		return RC_BUFFER_OVERFLOW;
 	}
 
-	rc = json_extract(data->zone_id, MAX_ID, info, ctx->request_buf, len, "id");
+	rc = json_extract(ctx, z->id, MAX_ID, info, len, "result[0].id");
 	if (rc != RC_OK) {
-		logit(LOG_ERR, "Zone '%s' not found.", zone_name);
+		logit(LOG_ERR, "Zone '%s' not found.", z->name);
+		z->id[0] = 0;
 		return rc;
 	}
-	
-	logit(LOG_DEBUG, "Cloudflare Zone: '%s' Id: %s", zone_name, data->zone_id);
 
-	if (strlen(hostname->name) == 32 && strtoull(hostname->name, NULL, 16) == ULLONG_MAX) {
-		/* hostname contains a cloudflare id (32 chars and only hex digits). 
+	logit(LOG_DEBUG, "Cloudflare Zone: '%s' Id: %s", z->name, z->id);
 
-		   This is needed to update Round-Robin DNS entries.
-		   https://developers.cloudflare.com/dns/manage-dns-records/how-to/round-robin-dns */
+	return RC_OK;
+}
 
-		/* Use the id already provided by the user */
-		strcpy(data->hostname_id, hostname->name);
+/* hostname contains a cloudflare id (32 chars and only hex digits) */
+static int is_record_id(const char *name)
+{
+	return strlen(name) == 32 && strtoull(name, NULL, 16) == ULLONG_MAX;
+}
 
-		/* Query the hostname */
-		len = snprintf(ctx->request_buf, ctx->request_buflen,
-				CLOUDFLARE_HOSTNAME_NAME_REQUEST_BY_ID,
-				data->zone_id,
-				data->hostname_id,
-				info->user_agent,
-				info->creds.password);
-		if (len >= ctx->request_buflen) {
-			logit(LOG_ERR, "Request for zone '%s', id %s did not fit into buffer.",
-				zone_name, data->zone_id);
-			return RC_BUFFER_OVERFLOW;
-		}
+/*
+ * This is needed to update Round-Robin DNS entries.
+ * https://developers.cloudflare.com/dns/manage-dns-records/how-to/round-robin-dns
+ */
+static int lookup_by_id(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname, const char *record_type)
+{
+	struct cfdata *data = (struct cfdata *)info->data;
+	struct cfrec *rec = get_record(info, hostname);
+	size_t len;
+	int rc;
 
-		rc = json_extract(hostname->name, MAX_ID, info, ctx->request_buf, ctx->request_buflen, "name");
-	} else {
-		/* hostname contains a hostname. This is the default inadyn behavior across all plugins. */
+	/* Use the id already provided by the user */
+	strcpy(rec->id, hostname->name);
 
-		/* Query the unique cloudflare id from hostname.
-		   If more than one record is returned (round-robin dns) use only the first and ignore the others. */
-		len = snprintf(ctx->request_buf, ctx->request_buflen,
-				CLOUDFLARE_HOSTNAME_ID_REQUEST_BY_NAME,
-				data->zone_id,
-				record_type,
-				info->wildcard ? "*." : "",
-				hostname->name,
-				info->user_agent,
-				info->creds.password);
-		if (len >= ctx->request_buflen) {
-			logit(LOG_ERR, "Request for zone '%s', id %s did not fit into buffer.",
-				zone_name, data->zone_id);
-			return RC_BUFFER_OVERFLOW;
+	/* Query the hostname */
+	len = snprintf(ctx->request_buf, ctx->request_buflen,
+		       CLOUDFLARE_HOSTNAME_NAME_REQUEST_BY_ID,
+		       data->zone_id,
+		       rec->id,
+		       info->user_agent,
+		       info->creds.password);
+	if (len >= ctx->request_buflen) {
+		logit(LOG_ERR, "Request for zone '%s', id %s did not fit into buffer.",
+		      info->creds.username, data->zone_id);
+		return RC_BUFFER_OVERFLOW;
+	}
+
+	rc = json_extract(ctx, hostname->name, MAX_ID, info, len, "result.name");
+	if (rc) {
+		logit(LOG_INFO, "Hostname '%s' not found.", hostname->name);
+		return rc;
+	}
+
+	logit(LOG_DEBUG, "Cloudflare Host: '%s' Id: %s", hostname->name, rec->id);
+	rec->type = record_type;
+	rec->byid = 1;
+	save_record(info, hostname);
+
+	return RC_OK;
+}
+
+/* Find record of hostname in zone snapshot, called with zone locked */
+static int zone_setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname, const char *record_type)
+{
+	struct cfdata *data = (struct cfdata *)info->data;
+	struct cfrec *rec = get_record(info, hostname);
+	struct cfzone *z = data->zone;
+	struct cfname *r;
+	char name[SERVER_NAME_LEN];
+	int rc;
+
+	if (!z->id[0]) {
+		if (!load_record(info, hostname, record_type))
+			strlcpy(z->id, data->zone_id, sizeof(z->id));
+		else if ((rc = zone_lookup(ctx, info, z)))
+			return rc;
+	}
+	strlcpy(data->zone_id, z->id, sizeof(data->zone_id));
+	rec->type = NULL;
+
+	if (is_record_id(hostname->name))
+		return lookup_by_id(ctx, info, hostname, record_type);
+
+	if (zone_stale(info, z)) {
+		rc = zone_fetch(ctx, info, z);
+		if (rc) {
+			if (!z->id[0])
+				drop_record(info, hostname);
+			return rc;
 		}
+	}
+
+	/* If more than one record exists (round-robin dns) use only the first */
+	snprintf(name, sizeof(name), "%s%s", info->wildcard ? "*." : "", hostname->name);
+	rec->type = record_type;
+	r = zone_find(z, name, record_type);
+	if (!r || !r->id[0]) {
+		logit(LOG_DEBUG, "Cloudflare Host: '%s' not found, creating it.", name);
+		rec->id[0] = 0;
+		return RC_OK;
+	}
+
+	strlcpy(rec->id, r->id, sizeof(rec->id));
+	logit(LOG_DEBUG, "Cloudflare Host: '%s' Id: %s", name, rec->id);
+	save_record(info, hostname);
+
+	if (!strcmp(r->content, hostname->address) &&
+	    (info->proxied == -1 || info->proxied == r->proxied) &&
+	    (info->ttl == -1 || info->ttl == r->ttl))
+		return RC_DDNS_RSP_UNCHANGED;
+
+	return RC_OK;
+}
+
+/* Record updated, or created, keep the zone snapshot in sync */
+static void zone_update(ddns_info_t *info, ddns_alias_t *hostname)
+{
+	struct cfdata *data = (struct cfdata *)info->data;
+	struct cfrec *rec = get_record(info, hostname);
+	struct cfzone *z = data->zone;
+	struct cfname *r;
+	char name[SERVER_NAME_LEN];
+
+	snprintf(name, sizeof(name), "%s%s", info->wildcard ? "*." : "", hostname->name);
+
+	pthread_mutex_lock(&z->lock);
+	r = zone_find(z, name, rec->type);
+	if (!r && z->fetched)
+		r = zone_add(z, name, rec->type);
+	if (r) {
+		strlcpy(r->id, rec->id, sizeof(r->id));
+		strlcpy(r->content, hostname->address, sizeof(r->content));
+		if (info->proxied != -1)
+			r->proxied = info->proxied;
+		if (info->ttl != -1)
+			r->ttl = info->ttl;
+	}
+	pthread_mutex_unlock(&z->lock);
+}
+
+/* Zone or record deleted, or recreated, look up again on retry */
+static void zone_invalidate(ddns_info_t *info, ddns_alias_t *hostname)
+{
+	struct cfdata *data = (struct cfdata *)info->data;
+	struct cfrec *rec = get_record(info, hostname);
+	struct cfzone *z = data->zone;
+
+	pthread_mutex_lock(&z->lock);
+	if (!rec->id[0])
+		z->id[0] = 0;
+	z->fetched = 0;
+	pthread_mutex_unlock(&z->lock);
+}
+
+static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
+{
+	const char *record_type;
+	struct cfdata *data;
+	struct cfrec *rec;
+	const char *zone_name = info->creds.username;
+	int rc = RC_OK;
+
+	if (*zone_name == '\0' || !strchr(zone_name, '.'))
+	{
+		logit(LOG_ERR, "Invalid zone. Enter the Cloudflare zone in the username field.");
+		return RC_DDNS_INVALID_OPTION;
+	}
 
-		rc = json_extract(data->hostname_id, MAX_ID, info, ctx->request_buf, ctx->request_buflen, "id");
+	if (!info->data) {
+		data = calloc(1, sizeof(struct cfdata) + info->alias_count * sizeof(struct cfrec));
+		if (!data)
+			return RC_OUT_OF_MEMORY;
+
+		data->num = info->alias_count;
+		info->data = data;
 	}
+	data = (struct cfdata *)info->data;
+
+	rec = get_record(info, hostname);
+	if (!rec)
+		return RC_ERROR;
 
-	if (rc == RC_OK) {
-		logit(LOG_DEBUG, "Cloudflare Host: '%s' Id: %s", hostname->name, data->hostname_id);
-	} else if (rc == RC_DDNS_RSP_NOHOST) {
-		strcpy(data->hostname_id, "");
+	record_type = get_record_type(hostname->address);
+	if (rec->byid && rec->type == record_type)
 		return RC_OK;
-	} else {
-		logit(LOG_INFO, "Hostname '%s' not found.", hostname->name);
+
+	if (!data->zone) {
+		data->zone = zone_get(info->creds.password, zone_name);
+		if (!data->zone)
+			return RC_OUT_OF_MEMORY;
 	}
 
+	pthread_mutex_lock(&data->zone->lock);
+	rc = zone_setup(ctx, info, hostname, record_type);
+	pthread_mutex_unlock(&data->zone->lock);
+
 	return rc;
 }
 
@@ -397,6 +767,7 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 {
 	const char *record_type;
 	struct cfdata *data = (struct cfdata *)info->data;
+	struct cfrec *rec = get_record(info, hostname);
 	size_t content_len;
 	char json_data[256];
 	char additional_fields[64] = "";
@@ -421,7 +792,7 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 			hostname->address,
 			additional_fields);
 
-	if (strlen(data->hostname_id) == 0)
+	if (strlen(rec->id) == 0)
 		return snprintf(ctx->request_buf, ctx->request_buflen,
 			CLOUDFLARE_HOSTNAME_CREATE_REQUEST,
 			data->zone_id,
@@ -432,7 +803,7 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 	return snprintf(ctx->request_buf, ctx->request_buflen,
 			info->system->server_req,
 			data->zone_id,
-			data->hostname_id,
+			rec->id,
 			info->user_agent,
 			info->creds.password,
 			content_len, json_data);
@@ -440,15 +811,41 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *hostname)
 {
+	struct cfrec *rec = get_record(info, hostname);
+	jsmntok_t tokens[JSON_MAX_TOKENS];
+	json_t doc;
 	int rc;
 
-	(void)info;
-	(void)hostname;
+	/* Zone or record deleted, or recreated, since we looked it up */
+	if (trans->status == 404) {
+		logit(LOG_WARNING, "HTTP 404: Cloudflare %s of %s not found, looking it up again on retry.",
+		      rec->id[0] ? "record" : "zone", hostname->name);
+		zone_invalidate(info, hostname);
+		drop_record(info, hostname);
+		return RC_DDNS_RSP_RETRY_LATER;
+	}
 
 	rc = check_response_code(trans->status);
-	if (rc == RC_OK && check_success_only(trans->rsp_body) < 0)
+	if (rc != RC_OK)
+		return rc;
+
+	if (json_parse(&doc, trans->rsp_body, tokens, NELEMS(tokens)) < 0)
+		return RC_DDNS_RSP_NOTOK;
+
+	if (!json_is(&doc, 0, KEY_SUCCESS, "true"))
 		rc = RC_DDNS_RSP_NOTOK;
 
+	/* New record created, save its id for the next update */
+	if (rc == RC_OK && !rec->id[0] &&
+	    !json_get(&doc, 0, "result.id", rec->id, sizeof(rec->id))) {
+		logit(LOG_DEBUG, "Cloudflare Host: '%s' Id: %s, created", hostname->name, rec->id);
+		save_record(info, hostname);
+	}
+	json_free(&doc);
+
+	if (rc == RC_OK && !rec->byid)
+		zone_update(info, hostname);
+
 	return rc;
 }
 
@@ -460,6 +857,12 @@ PLUGIN_INIT(plugin_init)
 
 PLUGIN_EXIT(plugin_exit)
 {
+	struct cfzone *z;
+
+	while ((z = LIST_FIRST(&zones))) {
+		LIST_REMOVE(z, link);
+		zone_free(z);
+	}
 	plugin_unregister(&plugin);
 }
 
@@ -24,6 +24,8 @@
 
 #include "md5.h"
 #include "plugin.h"
+#include "json.h"
+#include "rest.h"
 
 /* cloudxns.net specific update request format */
 #define CLOUDXNS_UPDATE_IP_REQUEST		\
@@ -62,7 +64,7 @@ struct cx {
 struct http {
 	ddns_t      *ctx;
 	ddns_info_t *info;
-	char        *response;	/* pointer to ctx->work_buf */
+	char        *response;	/* pointer into ctx->work */
 };
 
 static int setup    (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
@@ -104,9 +106,10 @@ static int string_endswith(const char *str, const char *suffix)
 static char *get_time(char *str, size_t len)
 {
 	time_t rawtime;
+	struct tm tm;
 
 	time(&rawtime);
-	strftime(str, len, "%a %b %d %T %Y", localtime(&rawtime));
+	strftime(str, len, "%a %b %d %T %Y", localtime_r(&rawtime, &tm));
 
 	return str;
 }
@@ -136,82 +139,66 @@ static void hmac(char *dst, size_t sz, char *fmt, ...)
 static int http_send(struct http *http, char *msg, char *fmt, ...)
 {
 	http_trans_t trans;
-	ddns_info_t *info;
 	va_list ap;
-	http_t client;
 	ddns_t *ctx;
-	int rc;
+	int rc, len;
 
-	info = http->info;
 	ctx = http->ctx;
 
 	va_start(ap, fmt);
-	trans.req_len     = vsnprintf(ctx->request_buf, ctx->request_buflen, fmt, ap);
-	trans.req         = ctx->request_buf;
-	trans.rsp         = ctx->work_buf;
-	trans.max_rsp_len = ctx->work_buflen - 1;	/* Save place for a \0 at the end */
+	len = vsnprintf(ctx->request_buf, ctx->request_buflen, fmt, ap);
 	va_end(ap);
 
-	rc = http_construct(&client);
+	rc = rest_call(ctx, http->info, msg, &trans, len);
 	if (rc)
 		return rc;
 
-	http_set_port(&client, info->server_name.port);
-	http_set_remote_name(&client, info->server_name.name);
-	client.ssl_enabled = info->ssl_enabled;
+	http->response = trans.rsp_body;
 
-	rc = http_init(&client, msg, TCP_AUTO);
-	if (rc)
-		goto err;
+	return http_status_valid(trans.status);
+}
 
-	rc = http_transaction(&client, &trans);
-	http_exit(&client);
-err:
-	http_destruct(&client, 1);
-	if (rc)
-		return rc;
+/* Parse list response, returns token index of its "data" array */
+static int list(struct http *http, json_t *doc, jsmntok_t *tokens, int max)
+{
+	int data;
 
-	http->response = trans.rsp_body;
+	if (json_parse(doc, http->response, tokens, max) < 0)
+		return -1;
 
-	return http_status_valid(trans.status);
+	data = json_query(doc, 0, "data");
+	if (data < 0 || doc->tok[data].type != JSMN_ARRAY) {
+		json_free(doc);
+		return -1;
+	}
+
+	return data;
 }
 
-/*
- * API_KEY = info->creds.username
- * SECRET_KEY = info->creds.password
- */
-static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+/* Look up domain and record id of @alias, and its @prefix in the domain */
+static int lookup(struct http *http, struct cx *cx, ddns_alias_t *alias, char *prefix)
 {
-	struct http   http = { ctx, info, NULL };
-	struct cx    *cx;
+	ddns_info_t  *info = http->info;
+	jsmntok_t     tokens[JSON_MAX_TOKENS];
+	json_t        doc;
 	char          str[MD5_DIGEST_BYTES * 2 + 1];
-	char          buffer[256], domain[256], prefix[SERVER_NAME_LEN];
-	char          *tmp, *item;
+	char          buffer[256], domain[256], id[16];
 	size_t        hostlen, domainlen;
 	int           rc = 0;
-
-	if (!info->data) {
-		info->data = malloc(sizeof(struct cx));
-		if (!info->data)
-			return RC_OUT_OF_MEMORY;
-	}
-	cx = (struct cx *)info->data;
-	memset(cx, 0, sizeof(struct cx));
-
-	get_time(cx->date, sizeof(cx->date));
+	int           data, i, k;
 
 	/* HMAC=md5(API_KEY+URL+DATE+SECRET_KEY) */
 	hmac(str, sizeof(str), "%shttp%s://www.cloudxns.net/api2/domain%s%s",
 	     info->creds.username, info->ssl_enabled ? "s" : "",
 	     cx->date, info->creds.password);
 
-	rc = http_send(&http, "Sending domain list query",
+	rc = http_send(http, "Sending domain list query",
 		       CLOUDXNS_GET_REQUEST, "/api2/domain",
 		       info->server_name.name, info->user_agent,
 		       info->creds.username, cx->date, str);
 	if (rc) {
 		logit(LOG_WARNING, "Failed fetching domain list, rc: %d", rc);
-		goto err;
+		return rc;
 	}
 
 	/*
@@ -226,31 +213,26 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 	 *    }]
 	 * }
 	 */
-	tmp = strchr(http.response, '[');
-	if (!tmp) {
-		rc = RC_DDNS_INVALID_OPTION;
-		goto err;
-	}
-
-	for (item = tmp; item; item = strstr(item, ",{")) {
-		unsigned int id;
-		int num;
-
-		item++;
-		num = sscanf(item, "{\"id\":\"%u\",\"domain\":\"%255[^\"]", &id, domain);
-		if (num == 2 && *domain) {
-			domain[strlen(domain) - 1] = 0;  /* Remove trailing dot */
-			if (string_endswith(alias->name, domain)) {
-				cx->domain_id = id;
-				break;
-			}
+	data = list(http, &doc, tokens, NELEMS(tokens));
+	if (data < 0)
+		return RC_DDNS_INVALID_OPTION;
+
+	for (i = data + 1, k = 0; k < doc.tok[data].size; i = json_next(&doc, i), k++) {
+		if (json_get(&doc, i, "id", id, sizeof(id)) ||
+		    json_get(&doc, i, "domain", domain, sizeof(domain)) || !*domain)
+			continue;
+
+		domain[strlen(domain) - 1] = 0;  /* Remove trailing dot */
+		if (string_endswith(alias->name, domain)) {
+			cx->domain_id = strtoul(id, NULL, 10);
+			break;
 		}
 	}
+	json_free(&doc);
 
 	if (cx->domain_id == 0) {
 		logit(LOG_ERR, "Hostname '%s' not found in domains list!", alias->name);
-		rc = RC_DDNS_INVALID_OPTION;
-		goto err;
+		return RC_DDNS_INVALID_OPTION;
 	}
 
 	logit(LOG_DEBUG, "CloudXNS Domain: '%s' ID: %u", domain, cx->domain_id);
@@ -261,20 +243,18 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 	     cx->domain_id, cx->date, info->creds.password);
 
 	snprintf(buffer, sizeof(buffer), "/api2/record/%u", cx->domain_id);
-	rc = http_send(&http, "Sending records list query",
+	rc = http_send(http, "Sending records list query",
 		       CLOUDXNS_GET_REQUEST, buffer,
 		       info->server_name.name, info->user_agent,
 		       info->creds.username, cx->date, str);
 	if (rc) {
 		logit(LOG_WARNING, "Failed fetching record ID, rc: %d", rc);
-		goto err;
+		return rc;
 	}
 
-	tmp = strchr(http.response, '[');
-	if (!tmp) {
-		rc = RC_DDNS_INVALID_OPTION;
-		goto err;
-	}
+	data = list(http, &doc, tokens, NELEMS(tokens));
+	if (data < 0)
+		return RC_DDNS_INVALID_OPTION;
 
 	hostlen = strlen(alias->name);
 	domainlen = strlen(domain);
@@ -284,32 +264,68 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 	} else {
 		size_t num = hostlen - domainlen - 1;
 
-		if (num <= sizeof(prefix))
+		if (num <= SERVER_NAME_LEN)
 			strlcpy(prefix, alias->name, num);
 	}
 	
-	for (item = tmp; item; item = strstr(item, ",{")) {
-		unsigned int id;
+	for (i = data + 1, k = 0; k < doc.tok[data].size; i = json_next(&doc, i), k++) {
 		char _prefix[64];
-		int num;
-
-		item++;
-		num = sscanf(item, "{\"record_id\":\"%u\",\"host_id\":\"%*d\",\"host\":\"%63[^\"]", &id, _prefix);
-		if (num == 2 && *_prefix) {
-			if (string_compare(prefix, _prefix)) {
-				cx->record_id = id;
-				break;
-			}
+
+		if (json_get(&doc, i, "record_id", id, sizeof(id)) ||
+		    json_get(&doc, i, "host", _prefix, sizeof(_prefix)) || !*_prefix)
+			continue;
+
+		if (string_compare(prefix, _prefix)) {
+			cx->record_id = strtoul(id, NULL, 10);
+			break;
 		}
 	}
+	json_free(&doc);
 
 	if (cx->record_id == 0) {
 		logit(LOG_ERR, "Record '%s' not found in records list!", prefix);
-		rc = RC_DDNS_INVALID_OPTION;
-		goto err;
+		return RC_DDNS_INVALID_OPTION;
 	}
 	logit(LOG_DEBUG, "CloudXNS Record: '%s' ID: %u", prefix, cx->record_id);
 
+	return 0;
+}
+
+/*
+ * API_KEY = info->creds.username
+ * SECRET_KEY = info->creds.password
+ *
+ * The domain and record id are only looked up if not already cached,
+ * the cached ids are dropped if CloudXNS responds 404.
+ */
+static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+{
+	struct http   http = { ctx, info, NULL };
+	struct cx    *cx;
+	char          id[SERVER_NAME_LEN], prefix[SERVER_NAME_LEN];
+	int           rc = 0;
+
+	if (!info->data) {
+		info->data = malloc(sizeof(struct cx));
+		if (!info->data)
+			return RC_OUT_OF_MEMORY;
+	}
+	cx = (struct cx *)info->data;
+	memset(cx, 0, sizeof(struct cx));
+
+	get_time(cx->date, sizeof(cx->date));
+
+	if (rest_id_get(info, alias, info->creds.username, id, sizeof(id)) ||
+	    sscanf(id, "%u,%u,%255s", &cx->domain_id, &cx->record_id, prefix) != 3) {
+		cx->domain_id = cx->record_id = 0;
+		rc = lookup(&http, cx, alias, prefix);
+		if (rc)
+			goto err;
+
+		snprintf(id, sizeof(id), "%u,%u,%s", cx->domain_id, cx->record_id, prefix);
+		rest_id_set(info, alias, info->creds.username, id);
+	}
+
 	cx->len = snprintf(cx->body, sizeof(cx->body),
 			   CLOUDXNS_UPDATE_PARAM_BODY,
 			   cx->domain_id, prefix, alias->address);
@@ -363,7 +379,12 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *resp = trans->rsp_body;
 
-	(void)info;
+	if (trans->status == 404) {
+		logit(LOG_WARNING, "CloudXNS record of %s not found, looking it up again on retry.", alias->name);
+		rest_id_drop(info, alias);
+		return RC_DDNS_RSP_RETRY_LATER;
+	}
+
 	DO(http_status_valid(trans->status));
 
 	if (strstr(resp, alias->address))
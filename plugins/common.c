@@ -23,25 +23,35 @@
 
 #include "plugin.h"
 
-/*
- * DynDNS request composer -- common to many other DDNS providers as well
- */
-int common_request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+/* dyndns2 response codes, in order of precedence when several match */
+static const struct {
+	const char *pattern;
+	int         result;
+} rules[] = {
+	{ "good",     0                       },
+	{ "nochg",    0                       },
+	{ "OK",       0                       },
+	{ "dnserr",   RC_DDNS_RSP_RETRY_LATER },
+	{ "911",      RC_DDNS_RSP_RETRY_LATER },
+	{ "abuse",    RC_DDNS_RSP_RETRY_LATER },
+	{ "badauth",  RC_DDNS_RSP_AUTH_FAIL   },
+	{ "!donator", RC_DDNS_RSP_AUTH_FAIL   },
+	/* Loopia responds "[200 OK] nohost" when no DNS record exists */
+	{ "nohost",   RC_DDNS_RSP_NOHOST      },
+	{ "nofqdn",   RC_DDNS_RSP_NOHOST      },
+};
+
+static struct match *common;
+
+/* Result code for a single line of a dyndns2 response */
+static int common_result(const char *body)
 {
-	char wildcard[20] = "";
-
-	if (info->wildcard)
-		strlcpy(wildcard, "&wildcard=ON", sizeof(wildcard));
-
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->name,
-			alias->address,
-			wildcard,
-			info->server_name.name,
-			info->creds.encoded_password,
-			info->user_agent);
+	int rc;
+
+	if (match_find(common, body, &rc))
+		return rc;
+
+	return RC_DDNS_RSP_NOTOK;
 }
 
 /*
@@ -50,30 +60,75 @@ int common_request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
  */
 int common_response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
-	char *body = trans->rsp_body;
+	(void)info;
+	(void)alias;
+
+	DO(http_status_valid(trans->status));
+
+	return common_result(trans->rsp_body);
+}
+
+/*
+ * DynDNS batch response validator, one line per hostname in the same
+ * order as in the request.  A single error line, e.g., 'badauth' or
+ * '911', applies to all hostnames.  Hostnames without a line have failed.
+ */
+int common_batch_response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t **alias, int *result, size_t num)
+{
+	char *line, *ptr = NULL;
+	size_t i = 0;
 
 	(void)info;
 	(void)alias;
 
 	DO(http_status_valid(trans->status));
 
-	if (strstr(body, "good") || strstr(body, "nochg")  || strstr(body, "OK"))
-		return 0;
+	for (line = strtok_r(trans->rsp_body, "\r\n", &ptr); line && i < num;
+	     line = strtok_r(NULL, "\r\n", &ptr)) {
+		while (*line == ' ' || *line == '\t')
+			line++;
+		if (!*line)
+			continue;
 
-	if (strstr(body, "dnserr") || strstr(body, "911") || strstr(body, "abuse"))
-		return RC_DDNS_RSP_RETRY_LATER;
+		result[i++] = common_result(line);
+	}
 
-	if (strstr(body, "badauth") || strstr(body, "!donator"))
-		return RC_DDNS_RSP_AUTH_FAIL;
+	if (i == 1 && result[0]) {
+		while (i < num) {
+			result[i] = result[0];
+			i++;
+		}
+	}
 
-	/* Loopia responds "[200 OK] nohost" when no DNS record exists */
-	if (strstr(body, "nohost"))
-		return RC_DDNS_RSP_NOHOST;
+	while (i < num)
+		result[i++] = RC_DDNS_RSP_NOTOK;
 
-	if (strstr(body, "nofqdn"))
-		return RC_DDNS_RSP_NOHOST;
+	return 0;
+}
 
-	return RC_DDNS_RSP_NOTOK;
+PLUGIN_INIT(common_init)
+{
+	size_t i;
+
+	common = match_new(0);
+	if (!common)
+		return;
+
+	for (i = 0; i < NELEMS(rules); i++) {
+		if (match_add(common, rules[i].pattern, rules[i].result))
+			break;
+	}
+
+	if (i < NELEMS(rules) || match_compile(common)) {
+		match_free(common);
+		common = NULL;
+	}
+}
+
+PLUGIN_EXIT(common_exit)
+{
+	match_free(common);
+	common = NULL;
 }
 
 /**
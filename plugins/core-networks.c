@@ -22,23 +22,31 @@
 #include "plugin.h"
 
 #define CORE_NETWORKS_UPDATE_IP_REQUEST					\
-	"GET %s?"							\
-	"hostname=%s&"							\
-	"myip=%s&"							\
-	"%s "								\
+	"GET %U?"							\
+	"hostname=%h&"							\
+	"myip=%i&"							\
+	"keepipv6=1 "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"Authorization: Basic %s\r\n"					\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"Authorization: Basic %C\r\n"					\
+	"User-Agent: %A\r\n\r\n"
+
+#define CORE_NETWORKS_UPDATE_IP6_REQUEST				\
+	"GET %U?"							\
+	"hostname=%h&"							\
+	"myip=%i&"							\
+	"keepipv4=1 "							\
+	"HTTP/1.0\r\n"							\
+	"Host: %S\r\n"							\
+	"Authorization: Basic %C\r\n"					\
+	"User-Agent: %A\r\n\r\n"
 
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@core-networks.de",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -49,25 +57,6 @@ static ddns_system_t plugin = {
 	.server_url   =  "/"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	char *keepip;
-	if (ddns_get_tcp_force(info) == TCP_FORCE_IPV6)
-		keepip = "keepipv4=1";
-	else
-		keepip = "keepipv6=1";
-
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->name,
-			alias->address,
-			keepip,
-			info->server_name.name,
-			info->creds.encoded_password,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *rsp = trans->rsp_body;
@@ -86,7 +75,7 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 PLUGIN_INIT(plugin_init)
 {
 	plugin_register(&plugin, CORE_NETWORKS_UPDATE_IP_REQUEST);
-	plugin_register_v6(&plugin, CORE_NETWORKS_UPDATE_IP_REQUEST);
+	plugin_register_v6(&plugin, CORE_NETWORKS_UPDATE_IP6_REQUEST);
 }
 
 PLUGIN_EXIT(plugin_exit)
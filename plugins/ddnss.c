@@ -22,22 +22,20 @@
 #include "plugin.h"
 
 #define DDNSS_UPDATE_IP_REQUEST						\
-	"GET %s?"							\
-	"user=%s&"							\
-	"pwd=%s&"							\
-	"host=%s"							\
+	"GET %U?"							\
+	"user=%u&"							\
+	"pwd=%p&"							\
+	"host=%h"							\
 	" "								\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@ddnss.de",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -48,18 +46,6 @@ static ddns_system_t plugin = {
 	.server_url   = "/upd.php"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			info->creds.username,
-			info->creds.password,
-			alias->name,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *resp = trans->rsp_body;
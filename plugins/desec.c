@@ -23,32 +23,30 @@
 
 
 #define DESEC_UPDATE_IP_REQUEST						\
-	"GET %s?"							\
-	"username=%s&"							\
-	"password=%s&"							\
-	"hostname=%s&"							\
-	"myipv4=%s "							\
+	"GET %U?"							\
+	"username=%u&"							\
+	"password=%p&"							\
+	"hostname=%h&"							\
+	"myipv4=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
 #define DESEC_UPDATE_IP6_REQUEST					\
-	"GET %s?"							\
-	"username=%s&"							\
-	"password=%s&"							\
-	"hostname=%s&"							\
-	"myipv6=%s "							\
+	"GET %U?"							\
+	"username=%u&"							\
+	"password=%p&"							\
+	"hostname=%h&"							\
+	"myipv6=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@desec.io",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -62,7 +60,6 @@ static ddns_system_t plugin = {
 static ddns_system_t plugin_v6 = {
 	.name         = "ipv6@desec.io",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "dns64.cloudflare-dns.com",
@@ -74,19 +71,6 @@ static ddns_system_t plugin_v6 = {
 };
 
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			info->creds.username,
-			info->creds.password,
-			alias->name,
-			alias->address,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *body = trans->rsp_body;
@@ -27,22 +27,20 @@
  * https://dhis.org/WebEngine.ipo?context=dhis.website.updating
  */
 #define DHIS_UPDATE_IP_REQUEST						\
-	"GET %s"							\
-	"hostname=%s&"							\
-	"password=%s&"							\
-	"ipaddr=%s&"							\
+	"GET %U"							\
+	"hostname=%h&"							\
+	"password=%p&"							\
+	"ipaddr=%i&"							\
 	"updatetimeout=0 "						\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@dhis.org",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -56,7 +54,6 @@ static ddns_system_t plugin = {
 static ddns_system_t plugin_ipv6 = {
 	.name         = "ipv6@dhis.org",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ipv6@wtfismyip.com",
@@ -66,18 +63,6 @@ static ddns_system_t plugin_ipv6 = {
 	.server_url   =  "/?"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->name,
-			info->creds.password,
-			alias->address,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *rsp = trans->rsp_body;
@@ -22,21 +22,19 @@
 #include "plugin.h"
 
 #define DNSEVER_UPDATE_IP_REQUEST					\
-	"GET %s?"							\
-	"host[%s]=%s "							\
+	"GET %U?"							\
+	"host[%h]=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"Authorization: Basic %s\r\n"					\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"Authorization: Basic %C\r\n"					\
+	"User-Agent: %A\r\n\r\n"
 
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@dnsever.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -47,18 +45,6 @@ static ddns_system_t plugin = {
 	.server_url   =  "/update.php"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->name,
-			alias->address,
-			info->server_name.name,
-			info->creds.encoded_password,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	(void)info;
@@ -22,23 +22,21 @@
 #include "plugin.h"
 
 #define DNSMADEEASY_UPDATE_IP_REQUEST					\
-	"GET %s?"							\
-	"username=%s&"							\
-	"password=%s&"							\
-	"id=%s&"							\
-	"ip=%s "							\
+	"GET %U?"							\
+	"username=%u&"							\
+	"password=%p&"							\
+	"id=%h&"							\
+	"ip=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@dnsmadeeasy.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -49,19 +47,6 @@ static ddns_system_t plugin = {
 	.server_url   =  "/servlet/updateip"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-		return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			info->creds.username,
-			info->creds.password,
-			alias->name,
-			alias->address,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *rsp = trans->rsp_body;
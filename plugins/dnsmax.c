@@ -22,27 +22,25 @@
 #include "plugin.h"
 
 #define DNSMAX_UPDATE_IP_REQUEST					\
-	"GET %s?"							\
-	"username=%s&"							\
-	"password=%s&"							\
+	"GET %U?"							\
+	"username=%u&"							\
+	"password=%p&"							\
 	"resellerid=1&"							\
 	"clientname=" PACKAGE_NAME "&"					\
 	"clientversion=" PACKAGE_VERSION "&"				\
 	"protocolversion=2.0&"						\
-	"updatehostname=%s&"						\
-	"ip=%s "							\
+	"updatehostname=%h&"						\
+	"ip=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t dnsmax_plugin = {
 	.name         = "default@dnsmax.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -56,7 +54,6 @@ static ddns_system_t dnsmax_plugin = {
 static ddns_system_t thatip_plugin = {
 	.name         = "default@thatip.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -68,19 +65,6 @@ static ddns_system_t thatip_plugin = {
 };
 
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			info->creds.username,
-			info->creds.password,
-			alias->name,
-			alias->address,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *rsp = trans->rsp_body;
@@ -20,6 +20,8 @@
  */
 
 #include "plugin.h"
+#include "json.h"
+#include "rest.h"
 
 /* dnspod.cn specific update request format */
 #define DNSPOD_API_REQUEST						\
@@ -64,17 +66,15 @@ static ddns_system_t plugin_v6 = {
 	.server_url   = "/"
 };
 
-static int fetch_record_id(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias, char *domain, char *prefix)
+static int fetch_record_id(ddns_t *ctx, ddns_info_t *info, char *domain, char *prefix)
 {
+	jsmntok_t tokens[JSON_MAX_TOKENS];
 	http_trans_t trans;
-	http_t client;
-	char *tmp;
 	char buffer[256];
-	int record_id = 0;
+	char id[16];
+	json_t doc;
 	int rc, len;
 
-	(void)alias;
-
 	/* login_token=API_ID,API_TOKEN */
 	len = snprintf(buffer, sizeof(buffer),
 		       "login_token=%s%%2C%s&"
@@ -86,29 +86,9 @@ static int fetch_record_id(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias,
 	if (len >= (int)sizeof(buffer))
 		return -RC_BUFFER_OVERFLOW;
 
-	trans.req_len     = snprintf(ctx->request_buf, ctx->request_buflen, DNSPOD_API_REQUEST, "Record.List",
-				     info->server_name.name, info->user_agent, strlen(buffer), buffer);
-	trans.req         = ctx->request_buf;
-	trans.rsp         = ctx->work_buf;
-	trans.max_rsp_len = ctx->work_buflen - 1; /* Save place for a \0 at the end */
-
-	rc = http_construct(&client);
-	if (rc)
-		return -rc;
-
-	http_set_port(&client, info->server_name.port);
-	http_set_remote_name(&client, info->server_name.name);
-	client.ssl_enabled = info->ssl_enabled;
-
-	rc = http_init(&client, "Sending record list query", ddns_get_tcp_force(info));
-	if (rc)
-		return -rc;
-
-	rc = http_transaction(&client, &trans);
-	logit(LOG_DEBUG, "=> %s", trans.rsp_body);
-	http_exit(&client);
-	http_destruct(&client, 1);
-
+	len = snprintf(ctx->request_buf, ctx->request_buflen, DNSPOD_API_REQUEST, "Record.List",
+		       info->server_name.name, info->user_agent, strlen(buffer), buffer);
+	rc = rest_call(ctx, info, "Sending record list query", &trans, len);
 	if (rc || (rc = http_status_valid(trans.status))) {
 		logit(LOG_WARNING, "Failed fetching record ID, rc: %d", rc);
 		return -rc;
@@ -150,25 +130,33 @@ static int fetch_record_id(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias,
 	 *    }]
 	 *}
 	 */
-	tmp = strstr(trans.rsp_body, "[{");
-	if (tmp && 1 == sscanf(tmp, "[{\"id\":\"%d\"", &record_id))
-		return record_id;
+	if (json_parse(&doc, trans.rsp_body, tokens, NELEMS(tokens)) < 0)
+		return -RC_DDNS_INVALID_OPTION;
+
+	rc = json_get(&doc, 0, "records[0].id", id, sizeof(id));
+	json_free(&doc);
+	if (rc || atoi(id) <= 0)
+		return -RC_DDNS_INVALID_OPTION;
 
-	return -RC_DDNS_INVALID_OPTION;
+	return atoi(id);
 }
 
 /*
  * API_ID = info->creds.username
  * API_TOKEN = info->creds.password
+ *
+ * The record id is only looked up if not already cached, the cached
+ * id is dropped if DNSPod responds it is invalid.
  */
 static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *tmp;
 	char buffer[SERVER_NAME_LEN], domain[SERVER_NAME_LEN], prefix[SERVER_NAME_LEN];
+	char id[REST_MAX_ID], key[USERNAME_LEN + 8];
 	int record_id;
 	int len;
 	char *record_type;
-	
+
 	if (ddns_get_tcp_force(info) == TCP_FORCE_IPV6)
 		record_type="AAAA";
 	else
@@ -188,13 +176,21 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 		strlcpy(prefix, "@", sizeof(prefix));
 	}
 
-	record_id = fetch_record_id(ctx, info, alias, domain, prefix);
-	if (record_id <= 0) {
-		logit(LOG_ERR, "Record '%s' not found in records list!", prefix);
-		if (record_id < 0)
-			return -record_id;
+	snprintf(key, sizeof(key), "%s/%s", info->creds.username, record_type);
+	if (!rest_id_get(info, alias, key, id, sizeof(id))) {
+		record_id = atoi(id);
+	} else {
+		record_id = fetch_record_id(ctx, info, domain, prefix);
+		if (record_id <= 0) {
+			logit(LOG_ERR, "Record '%s' not found in records list!", prefix);
+			if (record_id < 0)
+				return -record_id;
 
-		return RC_DDNS_INVALID_OPTION;
+			return RC_DDNS_INVALID_OPTION;
+		}
+
+		snprintf(id, sizeof(id), "%d", record_id);
+		rest_id_set(info, alias, key, id);
 	}
 
 	logit(LOG_DEBUG, "DNSPod Record: '%s' ID: %u", prefix, record_id);
@@ -256,21 +252,32 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
  *    }
  *}
  *
- * We search our own IP address in response and that's enough.
+ * We search our own IP address in response and that's enough.  Status
+ * code 8 means the record id is invalid, e.g., the record is deleted.
  */
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *resp = trans->rsp_body;
-
-	(void)info;
-	(void)alias;
+	jsmntok_t tokens[JSON_MAX_TOKENS];
+	json_t doc;
+	int rc = RC_DDNS_RSP_NOTOK;
 
 	DO(http_status_valid(trans->status));
 
 	if (strstr(resp, alias->address))
 		return 0;
 
-	return RC_DDNS_RSP_NOTOK;
+	if (json_parse(&doc, resp, tokens, NELEMS(tokens)) < 0)
+		return RC_DDNS_RSP_NOTOK;
+
+	if (json_is(&doc, 0, "status.code", "8")) {
+		logit(LOG_WARNING, "DNSPod record of %s not found, looking it up again on retry.", alias->name);
+		rest_id_drop(info, alias);
+		rc = RC_DDNS_RSP_RETRY_LATER;
+	}
+	json_free(&doc);
+
+	return rc;
 }
 
 PLUGIN_INIT(plugin_init)
@@ -22,21 +22,19 @@
 #include "plugin.h"
 
 #define DDC24_UPDATE_IP_REQUEST						\
-	"GET %s?"							\
-	"hostname=%s&"							\
-	"password=%s&"							\
-	"ip=%s "							\
+	"GET %U?"							\
+	"hostname=%h&"							\
+	"password=%p&"							\
+	"ip=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin_ddc24 = {
 	.name         = "default@domaindiscount24.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -50,7 +48,6 @@ static ddns_system_t plugin_ddc24 = {
 static ddns_system_t plugin_moniker = {
 	.name         = "default@moniker.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -62,18 +59,6 @@ static ddns_system_t plugin_moniker = {
 };
 
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->name,
-			info->creds.password,
-			alias->address,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *rsp = trans->rsp_body;
@@ -23,22 +23,20 @@
 
 /* https://api.domeneshop.no/docs/#tag/ddns/paths/~1dyndns~1update/get */
 #define DOMENESHOP_UPDATE_IP_REQUEST						\
-	"GET %s?"							\
-	"hostname=%s&"							\
-	"myip=%s "							\
+	"GET %U?"							\
+	"hostname=%h&"							\
+	"myip=%i "							\
 	"HTTP/1.1\r\n"							\
-	"Host: %s\r\n"							\
-	"Authorization: Basic %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"Authorization: Basic %C\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 static int check_response_code (int status);
 
 static ddns_system_t domeneshop = {
 	.name         = "default@domene.shop",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -49,18 +47,6 @@ static ddns_system_t domeneshop = {
 	.server_url   = "/v0/dyndns/update"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->name,
-			alias->address,
-			info->server_name.name,
-			info->creds.encoded_password,
-			info->user_agent);
-}
-
 static int check_response_code(int status)
 {
     if (status == 204)
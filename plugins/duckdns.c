@@ -27,30 +27,28 @@
  *     https://www.duckdns.org/install.jsp#linux-cron
  */
 #define DUCKDNS_UPDATE_IP_HTTP_REQUEST					\
-	"GET %s?"							\
-	"domains=%s&"							\
-	"token=%s&"							\
-	"ip=%s "   							\
+	"GET %U?"							\
+	"domains=%H&"							\
+	"token=%u&"							\
+	"ip=%i "   							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
 #define DUCKDNS_UPDATE_IP6_HTTP_REQUEST					\
-	"GET %s?"							\
-	"domains=%s&"							\
-	"token=%s&"							\
-	"ipv6=%s "   							\
+	"GET %U?"							\
+	"domains=%H&"							\
+	"token=%u&"							\
+	"ipv6=%i "   							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-static int request (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@duckdns.org",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "wtfismyip.com",
@@ -60,33 +58,6 @@ static ddns_system_t plugin = {
 	.server_url   = "/update"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	char name[SERVER_NAME_LEN], *p;
-
-	/* Handle some.name.duckdns.org properly */
-	p = strstr(alias->name, "duckdns.org");
-	if (p) {
-		size_t len = p - alias->name;
-
-		if (len > sizeof(name))
-			len = sizeof(name);
-
-		strlcpy(name, alias->name, len);
-	} else {
-		snprintf(name, sizeof(name), "%s", alias->name);
-	}
-
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			name,
-			info->creds.username,
-			alias->address,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *resp = trans->rsp_body;
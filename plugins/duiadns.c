@@ -19,36 +19,31 @@
  * Boston, MA  02110-1301, USA.
  */
 
-#include "md5.h"
 #include "plugin.h"
 
 #define DUIADNS_UPDATE_IP_HTTP_REQUEST					\
-	"GET %s?"							\
-	"host=%s&"							\
-	"password=%s&"							\
-	"ip4=%s "							\
+	"GET %U?"							\
+	"host=%h&"							\
+	"password=%m&"							\
+	"ip4=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
 #define DUIADNS_UPDATE_IP6_HTTP_REQUEST					\
-	"GET %s?"							\
-	"host=%s&"							\
-	"password=%s&"							\
-	"ip6=%s "							\
+	"GET %U?"							\
+	"host=%h&"							\
+	"password=%m&"							\
+	"ip6=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-#define MD5_DIGEST_BYTES  16
-
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@duiadns.net",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ipv4.duiadns.net",
@@ -61,7 +56,6 @@ static ddns_system_t plugin = {
 static ddns_system_t plugin_v6 = {
 	.name         = "ipv6@duiadns.net",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ipv6.duiadns.net",
@@ -71,26 +65,6 @@ static ddns_system_t plugin_v6 = {
 	.server_url   = "/dynamic.duia"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	int           i;
-	char          digeststr[MD5_DIGEST_BYTES * 2 + 1] = {0};
-	unsigned char digestbuf[MD5_DIGEST_BYTES] = {0};
-
-	md5((unsigned char *)info->creds.password, strlen(info->creds.password), digestbuf);
-	for (i = 0; i < MD5_DIGEST_BYTES; i++)
-		sprintf(&digeststr[i * 2], "%02x", digestbuf[i]);
-
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->name,
-			digeststr,
-			alias->address,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *resp = trans->rsp_body;
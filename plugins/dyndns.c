@@ -42,35 +42,52 @@
  *
  * Also applies to other dyndns2 api compatible services, like:
  * DNS-O-Matic, no-ip, 3322, HE and nsupdate.info.
+ *
+ * Dyn and No-IP also accept a comma separated list of hostnames, all
+ * updated in one request, with one response line per hostname.  They
+ * are also the only ones sent HTTP/1.1 requests, keeping the connection
+ * open for the next update, the others still get HTTP/1.0.
+ *
+ * The requests are templates, see template.h, compiled at startup.
  */
 #define DYNDNS_UPDATE_IP_HTTP_REQUEST					\
-	"GET %s?"							\
-	"hostname=%s&"							\
-	"myip=%s"							\
-	"%s "      							\
+	"GET %U?"							\
+	"hostname=%h&"							\
+	"myip=%i"							\
+	"%W "      							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"Authorization: Basic %s\r\n"					\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"Authorization: Basic %C\r\n"					\
+	"User-Agent: %A\r\n\r\n"
 
 #define DYNDNS_UPDATE_IPV6_HTTP_REQUEST					\
-	"GET %s?"							\
-	"hostname=%s&"							\
-	"myipv6=%s"							\
-	"%s "      							\
+	"GET %U?"							\
+	"hostname=%h&"							\
+	"myipv6=%i"							\
+	"%W "      							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"Authorization: Basic %s\r\n"					\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"Authorization: Basic %C\r\n"					\
+	"User-Agent: %A\r\n\r\n"
+
+#define DYNDNS_KEEPALIVE_HTTP_REQUEST					\
+	"GET %U?"							\
+	"hostname=%h&"							\
+	"myip=%i"							\
+	"%W "      							\
+	"HTTP/1.1\r\n"							\
+	"Host: %S\r\n"							\
+	"Authorization: Basic %C\r\n"					\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t dyndns = {
 	.name         = "default@dyndns.org",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
+	.batch_response = (batch_rsp_fn_t)common_batch_response,
+	.keepalive    = 1,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -83,7 +100,6 @@ static ddns_system_t dyndns = {
 static ddns_system_t dnsomatic = {
 	.name         = "default@dnsomatic.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "myip.dnsomatic.com",
@@ -97,7 +113,6 @@ static ddns_system_t dnsomatic = {
 static ddns_system_t selfhost = {
 	.name         = "default@selfhost.de",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -111,8 +126,9 @@ static ddns_system_t selfhost = {
 static ddns_system_t no_ip = {
 	.name         = "default@no-ip.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
+	.batch_response = (batch_rsp_fn_t)common_batch_response,
+	.keepalive    = 1,
 
 	.checkip_name = "ip1.dynupdate.no-ip.com",
 	.checkip_url  = "/",
@@ -126,8 +142,9 @@ static ddns_system_t no_ip = {
 static ddns_system_t noip = {
 	.name         = "default@noip.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
+	.batch_response = (batch_rsp_fn_t)common_batch_response,
+	.keepalive    = 1,
 
 	.checkip_name = "ip1.dynupdate.noip.com",
 	.checkip_url  = "/",
@@ -143,7 +160,6 @@ static ddns_system_t _3322 = {
 	.name         = "default@3322.org",
 	.alias        = "dyndns@3322.org",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ip.3322.net",
@@ -158,7 +174,6 @@ static ddns_system_t henet = {
 	.name         = "default@he.net",
 	.alias        = "dyndns@he.net",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "checkip.dns.he.net",
@@ -175,7 +190,6 @@ static ddns_system_t henet = {
 static ddns_system_t tunnelbroker = {
 	.name         = "default@tunnelbroker.net",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -193,7 +207,6 @@ static ddns_system_t tunnelbroker = {
 static ddns_system_t spdyn = {
 	.name         = "default@spdyn.de",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "checkip4.spdyn.de",
@@ -207,7 +220,6 @@ static ddns_system_t spdyn = {
 static ddns_system_t spdyn_v6 = {
 	.name         = "ipv6@spdyn.de",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "checkip6.spdyn.de",
@@ -222,7 +234,6 @@ static ddns_system_t spdyn_v6 = {
 static ddns_system_t nsupdate_info_ipv4 = {
 	.name         = "ipv4@nsupdate.info",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ipv4.nsupdate.info",
@@ -235,7 +246,6 @@ static ddns_system_t nsupdate_info_ipv4 = {
 static ddns_system_t nsupdate_info_ipv6 = {
 	.name         = "ipv6@nsupdate.info",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ipv6.nsupdate.info",
@@ -252,7 +262,6 @@ static ddns_system_t nsupdate_info_ipv6 = {
 static ddns_system_t loopia = {
 	.name         = "default@loopia.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "dns.loopia.se",
@@ -265,7 +274,6 @@ static ddns_system_t loopia = {
 static ddns_system_t googledomains = {
 	.name         = "default@domains.google.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "domains.google.com",
@@ -279,7 +287,6 @@ static ddns_system_t googledomains = {
 static ddns_system_t dynu = {
 	.name         = "default@dynu.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "checkip.dynu.com",
@@ -292,7 +299,6 @@ static ddns_system_t dynu = {
 static ddns_system_t dyfi = {
 	.name         = "default@dy.fi",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "checkip.dy.fi",
@@ -305,7 +311,6 @@ static ddns_system_t dyfi = {
 static ddns_system_t dode = {
 	.name         = "default@do.de",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -319,7 +324,6 @@ static ddns_system_t dode = {
 static ddns_system_t domopoli = {
 	.name         = "default@domopoli",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -333,7 +337,6 @@ static ddns_system_t domopoli = {
 static ddns_system_t inwx = {
 	.name         = "default@inwx.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -347,7 +350,6 @@ static ddns_system_t inwx = {
 static ddns_system_t inwxv6 = {
 	.name         = "ipv6@inwx.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -361,7 +363,6 @@ static ddns_system_t inwxv6 = {
 static ddns_system_t itsdns = {
 	.name         = "default@itsdns.de",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -375,7 +376,6 @@ static ddns_system_t itsdns = {
 static ddns_system_t opendns = {
 	.name         = "default@opendns.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -389,7 +389,6 @@ static ddns_system_t opendns = {
 static ddns_system_t joker = {
 	.name         = "default@joker.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -403,7 +402,6 @@ static ddns_system_t joker = {
 static ddns_system_t schokokeks = {
 	.name         = "default@schokokeks.org",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -417,7 +415,6 @@ static ddns_system_t schokokeks = {
 static ddns_system_t variomedia = {
 	.name         = "default@variomedia.de",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -431,7 +428,6 @@ static ddns_system_t variomedia = {
 static ddns_system_t udmedia = {
 	.name         = "default@udmedia.de",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -445,7 +441,6 @@ static ddns_system_t udmedia = {
 static ddns_system_t dyndnsit = {
 	.name         = "default@dyndns.it",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -459,7 +454,6 @@ static ddns_system_t dyndnsit = {
 static ddns_system_t infomaniak = {
 	.name         = "default@infomaniak.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -473,7 +467,6 @@ static ddns_system_t infomaniak = {
 static ddns_system_t oray = {
 	.name         = "default@oray.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -487,7 +480,6 @@ static ddns_system_t oray = {
 static ddns_system_t simplycom = {
 	.name         = "default@simply.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -498,11 +490,6 @@ static ddns_system_t simplycom = {
 	.server_url   = "/nic/update"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return common_request(ctx, info, alias);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	return common_response(trans, info, alias);
@@ -510,15 +497,15 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 
 PLUGIN_INIT(plugin_init)
 {
-	plugin_register(&dyndns, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+	plugin_register(&dyndns, DYNDNS_KEEPALIVE_HTTP_REQUEST);
 	plugin_register(&dnsomatic, DYNDNS_UPDATE_IP_HTTP_REQUEST);
 	plugin_register_v6(&dnsomatic, DYNDNS_UPDATE_IP_HTTP_REQUEST);
 	plugin_register(&selfhost, DYNDNS_UPDATE_IP_HTTP_REQUEST);
 	plugin_register_v6(&selfhost, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&no_ip, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&no_ip, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&noip, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&noip, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+	plugin_register(&no_ip, DYNDNS_KEEPALIVE_HTTP_REQUEST);
+	plugin_register_v6(&no_ip, DYNDNS_KEEPALIVE_HTTP_REQUEST);
+	plugin_register(&noip, DYNDNS_KEEPALIVE_HTTP_REQUEST);
+	plugin_register_v6(&noip, DYNDNS_KEEPALIVE_HTTP_REQUEST);
 	plugin_register(&_3322, DYNDNS_UPDATE_IP_HTTP_REQUEST);
 	plugin_register_v6(&_3322, DYNDNS_UPDATE_IP_HTTP_REQUEST);
 	plugin_register(&henet, DYNDNS_UPDATE_IP_HTTP_REQUEST);
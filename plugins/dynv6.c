@@ -23,31 +23,29 @@
 #include "plugin.h"
 
 #define DYNV6_UPDATE_IP_REQUEST						\
-	"GET %s?"							\
-	"ipv4=%s&"							\
-	"hostname=%s&"							\
-	"token=%s "							\
+	"GET %U?"							\
+	"ipv4=%i&"							\
+	"hostname=%h&"							\
+	"token=%u "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
 #define DYNV6_UPDATE_IP6_REQUEST					\
-	"GET %s?"							\
-	"ipv6=%s&"							\
-	"hostname=%s&"							\
-	"token=%s "							\
+	"GET %U?"							\
+	"ipv6=%i&"							\
+	"hostname=%h&"							\
+	"token=%u "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin4 = {
 	.name         = "ipv4@dynv6.com",
 	.alias        = "default@ipv4.dynv6.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -62,7 +60,6 @@ static ddns_system_t plugin6 = {
 	.name         = "ipv6@dynv6.com",
 	.alias        = "default@dynv6.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -73,25 +70,6 @@ static ddns_system_t plugin6 = {
 	.server_url   =  "/api/update"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	char *addr;
-
-	if (alias->address[0])
-		addr = alias->address;
-	else
-		addr = "auto";	/* ipv6=auto, or ipv4=auto */
-
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			addr,
-			alias->name,
-			info->creds.username,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *resp = trans->rsp_body;
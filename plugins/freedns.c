@@ -34,6 +34,20 @@
 	"User-Agent: %s\r\n\r\n"
 #define SHA1_DIGEST_BYTES 20
 
+/* Update hash of each name in the account, see parse_keys() */
+struct fkey {
+	const char   *host;
+	const char   *hash;		/* Query string of update URL */
+};
+
+struct fdata {
+	int           stale;		/* Fetch keys again before next update */
+	size_t        num;
+	size_t        index_size;	/* Power of two, at least 2 * lines */
+	size_t       *index;		/* Index in key[] + 1, by hash of host */
+	struct fkey   key[];
+};
+
 static int setup    (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
@@ -81,11 +95,11 @@ static char *fetch_keys(ddns_t *ctx, ddns_info_t *info)
 		sprintf(&digeststr[i * 2], "%02x", digestbuf[i]);
 
 	snprintf(buffer, sizeof(buffer), "/api/?action=getdyndns&v=2&sha=%s", digeststr);
+	memset(&trans, 0, sizeof(trans));
 	trans.req_len     = snprintf(ctx->request_buf, ctx->request_buflen, GENERIC_HTTP_REQUEST,
 				     buffer, info->server_name.name, info->user_agent);
 	trans.req         = ctx->request_buf;
-	trans.rsp         = ctx->work_buf;
-	trans.max_rsp_len = ctx->work_buflen - 1;	/* Save place for a \0 at the end */
+	trans.buf         = ctx->work;
 
 	rc = http_transaction(&client, &trans);
 	if (strstr(trans.rsp_body, "ERROR:"))
@@ -104,59 +118,148 @@ static char *fetch_keys(ddns_t *ctx, ddns_info_t *info)
 	return strdup(trans.rsp_body);
 }
 
-/* FreeDNS requires an API key, the following code fetches yours */
-static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+/*
+ * Index the account's API key list, one "host|address|updateurl" per
+ * line, by hostname.  Everything is kept in a single allocation, with
+ * the strings pointing into a copy of the list, so the key table can
+ * be stored in info->data and freed by Inadyn.
+ */
+static size_t key_slot(const struct fdata *data, const char *host)
 {
-	char         *hash = NULL;
-#ifndef ENABLE_SIMULATION
-	char          host[256], updateurl[256];
-	char         *buf, *tmp, *line;
+	size_t mask = data->index_size - 1;
+	size_t pos  = string_hash(host, -1) & mask;
 
-	tmp = buf = fetch_keys(ctx, info);
-	if (!buf) {
-		logit(LOG_ERR, "Cannot find your FreeDNS account API keys");
-		return RC_ERROR;
+	while (data->index[pos]) {
+		if (!strcasecmp(data->key[data->index[pos] - 1].host, host))
+			break;
+		pos = (pos + 1) & mask;
 	}
 
-	if (strstr(buf, "Failed authenticating to fetch API keys")) {
-		free(buf);
-		return RC_DDNS_RSP_AUTH_FAIL;
+	return pos;
+}
+
+static const struct fkey *find_key(const struct fdata *data, const char *host)
+{
+	size_t pos = key_slot(data, host);
+
+	if (!data->index[pos])
+		return NULL;
+
+	return &data->key[data->index[pos] - 1];
+}
+
+static struct fdata *parse_keys(const char *list)
+{
+	struct fdata *data;
+	size_t        lines = 1, size = 2, len;
+	const char   *ptr;
+	char         *buf, *line;
+
+	for (ptr = list; *ptr; ptr++) {
+		if (*ptr == '\n')
+			lines++;
 	}
+	while (size < 2 * lines)
+		size <<= 1;
+	len = strlen(list) + 1;
 
-	for (line = strsep(&tmp, "\n"); line; line = strsep(&tmp, "\n")) {
-		int num;
+	data = calloc(1, sizeof(*data) + lines * sizeof(struct fkey) + size * sizeof(size_t) + len);
+	if (!data)
+		return NULL;
 
-		num = sscanf(line, "%255[^|\r\n]|%*[^|\r\n]|%255[^|\r\n]", host, updateurl);
-		if (*line && num == 2 && !strcmp(host, alias->name)) {
-			hash = strstr(updateurl, "?");
-			break;
+	data->index      = (size_t *)&data->key[lines];
+	data->index_size = size;
+	buf = memcpy(&data->index[size], list, len);
+
+	while ((line = strsep(&buf, "\n"))) {
+		char  *host, *url, *hash;
+		size_t pos;
+
+		host = strsep(&line, "|");
+		strsep(&line, "|");	/* Current address */
+		url  = strsep(&line, "|\r");
+		if (!*host || !url)
+			continue;
+
+		hash = strchr(url, '?');
+		if (!hash)
+			continue;
+
+		/* Listed more than once, use the first */
+		pos = key_slot(data, host);
+		if (data->index[pos])
+			continue;
+
+		data->key[data->num].host = host;
+		data->key[data->num].hash = hash + 1;
+		data->index[pos] = ++data->num;
+	}
+
+	return data;
+}
+
+/*
+ * FreeDNS requires an API key, the following code fetches yours.  The
+ * list of keys for all names in the account is fetched once, and only
+ * fetched again after an update has failed due to an unknown key/name.
+ */
+static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+{
+#ifndef ENABLE_SIMULATION
+	struct fdata *data = (struct fdata *)info->data;
+	char         *buf;
+
+	if (!data || data->stale) {
+		buf = fetch_keys(ctx, info);
+		if (!buf) {
+			logit(LOG_ERR, "Cannot find your FreeDNS account API keys");
+			return RC_ERROR;
 		}
+
+		if (strstr(buf, "Failed authenticating to fetch API keys")) {
+			free(buf);
+			return RC_DDNS_RSP_AUTH_FAIL;
+		}
+
+		data = parse_keys(buf);
+		free(buf);
+		if (!data)
+			return RC_OUT_OF_MEMORY;
+
+		logit(LOG_DEBUG, "Found %zu API keys in your FreeDNS account", data->num);
+		free(info->data);
+		info->data = data;
 	}
-	free(buf);
 
-	if (!hash) {
+	if (!find_key(data, alias->name)) {
 		logit(LOG_INFO, "Cannot find your DNS name in the list of API keys");
+		data->stale = 1;
 		return 1;
 	}
-	hash++;
 #else
-	hash = "<NIL>";
+	(void)ctx;
+	(void)info;
+	(void)alias;
 #endif /* ENABLE_SIMULATION */
 
-	if (info->data)
-		free(info->data);
-	info->data = strdup(hash);
-
 	return 0;
 }
 
 static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 {
-	char *hash = (char *)info->data;
+	const char *hash = "<NIL>";
+#ifndef ENABLE_SIMULATION
+	const struct fkey *key;
 
-	if (!hash)
+	if (!info->data)
 		return 0;
 
+	key = find_key(info->data, alias->name);
+	if (!key)
+		return 0;
+	hash = key->hash;
+#endif /* ENABLE_SIMULATION */
+
 	return snprintf(ctx->request_buf, ctx->request_buflen,
 			info->system->server_req,
 			info->server_url,
@@ -175,17 +278,20 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
  */
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
+	struct fdata *data = (struct fdata *)info->data;
 	char *resp = trans->rsp_body;
+	int rc;
 
-	(void)info;
-	(void)alias;
-
-	DO(http_status_valid(trans->status));
-
-	if (strstr(resp, alias->address))
+	rc = http_status_valid(trans->status);
+	if (!rc && strstr(resp, alias->address))
 		return 0;
 
-	return RC_DDNS_RSP_NOTOK;
+	/* Key revoked or name removed from account, fetch keys again on retry */
+	if (data && (trans->status == 401 || trans->status == 403 || trans->status == 404 ||
+		     strstr(resp, "Invalid update URL") || strstr(resp, "Unable to locate")))
+		data->stale = 1;
+
+	return rc ? rc : RC_DDNS_RSP_NOTOK;
 }
 
 PLUGIN_INIT(plugin_init)
@@ -26,20 +26,18 @@
  * Maybe add support for "&myip=1.2.3.4"?
  */
 #define FREEMYIP_UPDATE_IP_HTTP_REQUEST				\
-	"GET %s?"						\
-	"token=%s&"						\
-	"domain=%s "						\
+	"GET %U?"						\
+	"token=%p&"						\
+	"domain=%h "						\
 	"HTTP/1.0\r\n"						\
-	"Host: %s\r\n"						\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"						\
+	"User-Agent: %A\r\n\r\n"
 
-static int request (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@freemyip.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.nousername   = 1,	/* Provider does not require username */
@@ -51,16 +49,6 @@ static ddns_system_t plugin = {
 	.server_url   = "/update"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			info->creds.password,
-			alias->name,
-			info->server_name.name, info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	(void)info;
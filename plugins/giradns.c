@@ -22,21 +22,19 @@
 #include "plugin.h"
 
 #define GIRADNS_UPDATE_IP_HTTP_REQUEST				\
-	"GET %s?"						\
-	"u=%s&"							\
-	"p=%s&"							\
-	"ip=%s "						\
+	"GET %U?"						\
+	"u=%u&"							\
+	"p=%p&"							\
+	"ip=%i "						\
 	"HTTP/1.0\r\n"						\
-	"Host: %s\r\n"						\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"						\
+	"User-Agent: %A\r\n\r\n"
 
-static int request (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@gira.de",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ipv4.wtfismyip.com",
@@ -49,7 +47,6 @@ static ddns_system_t plugin = {
 static ddns_system_t plugin_v6 = {
 	.name         = "ipv6@gira.de",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ipv6@wtfismyip.com",
@@ -59,17 +56,6 @@ static ddns_system_t plugin_v6 = {
 	.server_url   = "/hsdyndns.php"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			info->creds.username,
-			info->creds.password,
-			alias->address,
-			info->server_name.name, info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *resp = trans->rsp_body;
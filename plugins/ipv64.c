@@ -22,32 +22,30 @@
 #include "plugin.h"
 
 #define IPV64_UPDATE_IP_REQUEST					\
-	"GET %s?"						\
-	"token=%s&"						\
-	"ip=%s "						\
+	"GET %U?"						\
+	"token=%h&"						\
+	"ip=%i "						\
 	"HTTP/1.0\r\n"					        \
-	"Host: %s\r\n"					        \
-	"Authorization: Basic %s\r\n"				\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"					        \
+	"Authorization: Basic %C\r\n"				\
+	"User-Agent: %A\r\n\r\n"
 
 #define IPV64_UPDATE_IP6_REQUEST				\
-	"GET %s?"						\
-	"token=%s&"		  		  	 	\
-	"ip6=%s "					        \
+	"GET %U?"						\
+	"token=%h&"		  		  	 	\
+	"ip6=%i "					        \
 	"HTTP/1.0\r\n"					        \
-	"Host: %s\r\n"					        \
-	"Authorization: Basic %s\r\n"				\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"					        \
+	"Authorization: Basic %C\r\n"				\
+	"User-Agent: %A\r\n\r\n"
 
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "ipv4@ipv64.net",
 	.alias        = "default@ipv64.net",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ifconfig.me",
@@ -61,7 +59,6 @@ static ddns_system_t plugin = {
 static ddns_system_t plugin_v6 = {
 	.name         = "ipv6@ipv64.net",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ifconfig.me",
@@ -72,18 +69,6 @@ static ddns_system_t plugin_v6 = {
 	.server_url   =  "/nic/update"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->name,
-			alias->address,
-			info->server_name.name,
-			info->creds.encoded_password,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	(void)info;
@@ -22,30 +22,28 @@
 #include "plugin.h"
 
 #define MYDNS_UPDATE_IP_REQUEST						\
-	"GET %s?"							\
-	"MID=%s&"							\
-	"PWD=%s&"							\
-	"IPV4ADDR=%s "							\
+	"GET %U?"							\
+	"MID=%u&"							\
+	"PWD=%p&"							\
+	"IPV4ADDR=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
 #define MYDNS_UPDATE_IP6_REQUEST					\
-	"GET %s?"							\
-	"MID=%s&"							\
-	"PWD=%s&"							\
-	"IPV6ADDR=%s "							\
+	"GET %U?"							\
+	"MID=%u&"							\
+	"PWD=%p&"							\
+	"IPV6ADDR=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@mydns.jp",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -59,7 +57,6 @@ static ddns_system_t plugin = {
 static ddns_system_t plugin_v6 = {
 	.name         = "ipv6@mydns.jp",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "dns64.cloudflare-dns.com",
@@ -70,18 +67,6 @@ static ddns_system_t plugin_v6 = {
 	.server_url   =  "/directip.html"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			info->creds.username,
-			info->creds.password,
-			alias->address,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	(void)info;
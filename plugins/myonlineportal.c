@@ -22,32 +22,30 @@
 #include "plugin.h"
 
 #define MYONLINEPORTAL_UPDATE_IP_REQUEST				\
-	"GET %s?"							\
-	"username=%s&"							\
-	"password=%s&"							\
-	"hostname=%s&"							\
-	"ip=%s "							\
+	"GET %U?"							\
+	"username=%u&"							\
+	"password=%p&"							\
+	"hostname=%h&"							\
+	"ip=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
 #define MYONLINEPORTAL_UPDATE_IP6_REQUEST				\
-	"GET %s?"							\
-	"username=%s&"							\
-	"password=%s&"							\
-	"hostname=%s&"							\
-	"ip6=%s "							\
+	"GET %U?"							\
+	"username=%u&"							\
+	"password=%p&"							\
+	"hostname=%h&"							\
+	"ip6=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@myonlineportal.net",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ipv4.myonlineportal.net",
@@ -60,7 +58,6 @@ static ddns_system_t plugin = {
 static ddns_system_t plugin_v6 = {
 	.name         = "ipv6@myonlineportal.net",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "ipv6.myonlineportal.net",
@@ -70,19 +67,6 @@ static ddns_system_t plugin_v6 = {
 	.server_url   = "/updateddns"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			info->creds.username,
-			info->creds.password,
-			alias->name,
-			alias->address,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *rsp = trans->rsp_body;
@@ -21,6 +21,7 @@
 
 #include "plugin.h"
 #include "json.h"
+#include "rest.h"
 
 #define CHECK(fn)       { rc = (fn); if (rc) goto cleanup; }
 
@@ -116,157 +117,91 @@ static int check_response_code(int status)
 	}
 }
 
-static int check_success(const char *json, const jsmntok_t tokens[], const int num_tokens)
+/* Responses are { "success": true, ... }, fetch value at @path */
+static int json_extract(ddns_t *ctx, char *dest, size_t dest_size, ddns_info_t *info, size_t request_len, const char *path)
 {
-	int i;
-
-	for (i = 1; i < num_tokens; i++) {
-		int set;
-
-		if (jsoneq(json, tokens + i, "success") != 0)
-			continue;
-
-		if (i < num_tokens - 1 && json_bool(json, tokens + i + 1, &set) == 0)
-			return set ? 0 : -1;
-
-		return -1;
-	}
-
-	return -1;
-}
-
-static int check_success_only(const char *json)
-{
-	jsmntok_t *tokens;
-	int num_tokens;
-	int result;
-
-	num_tokens = parse_json(json, &tokens);
-	if (num_tokens == -1)
-		return -1;
-
-	result = check_success(json, tokens, num_tokens);
-	free(tokens);
-
-	return result;
-}
-
-static int get_result_value(const char *json, const char *key, jsmntok_t *out_result)
-{
-	jsmntok_t *tokens;
-	int num_tokens;
-	int i = 0;
+	jsmntok_t     tokens[JSON_MAX_TOKENS];
+	http_trans_t  trans;
+	json_t        doc = { 0 };
+	int           rc = RC_OK;
 
-	num_tokens = parse_json(json, &tokens);
-	if (num_tokens < 0)
-		return -1;
+	CHECK(rest_call(ctx, info, "Json query", &trans, request_len));
+	CHECK(check_response_code(trans.status));
 
-	if (tokens[0].type != JSMN_OBJECT) {
-		logit(LOG_ERR, "JSON response contained no objects.");
+	if (json_parse(&doc, trans.rsp_body, tokens, NELEMS(tokens)) < 0) {
+		rc = RC_DDNS_RSP_NOHOST;
 		goto cleanup;
 	}
 
-	if (check_success(json, tokens + i + 1, num_tokens) == -1) {
+	if (!json_is(&doc, 0, "success", "true")) {
 		logit(LOG_ERR, "Request was unsuccessful.");
+		rc = RC_DDNS_RSP_NOHOST;
 		goto cleanup;
 	}
 
-	for (i = 1; i < num_tokens; i++) {
-		if (jsoneq(json, tokens + i, key) != 0)
-			continue;
-
-		if (i < num_tokens - 1) {
-			*out_result = tokens[i+1];
-			free(tokens);
-			return 0;
-		}
+	switch (json_get(&doc, 0, path, dest, dest_size)) {
+	case 0:
+		logit(LOG_DEBUG, "Key '%s' = %s", path, dest);
+		break;
+	case -2:
+		logit(LOG_ERR, "Key value did not fit into buffer.");
+		rc = RC_BUFFER_OVERFLOW;
+		break;
+	default:
+		logit(LOG_INFO, "Could not find key '%s'.", path);
+		rc = RC_DDNS_RSP_NOHOST;
+		break;
 	}
 
-	logit(LOG_INFO, "Could not find key '%s'.", key);
-
 	cleanup:
-		free(tokens);
-	return -1;
+		json_free(&doc);
+
+	return rc;
 }
 
-static int json_copy_value(char *dest, size_t dest_size, const char *json, const jsmntok_t *token)
+static const char* get_record_type(const char *address)
 {
-	size_t length;
-
-	if (token->type != JSMN_STRING)
-		return -1;
-
-	length = token->end - token->start + 1;
-	if (length > dest_size)
-		return -2;
-
-	strlcpy(dest, json + token->start, length);
+	if (strstr(address, ":"))
+		return IPV6_RECORD_TYPE;
 
-	return 0;
+	return IPV4_RECORD_TYPE;
 }
 
-static int json_extract(char *dest, size_t dest_size, const ddns_info_t *info, char *request, size_t request_len, const char *key)
+/* Cached ids, "zone_id/hostname_id", are only valid for the same record type */
+static int load_ids(ddns_info_t *info, ddns_alias_t *hostname)
 {
-	const char   *body;
-	http_trans_t  trans;
-	jsmntok_t     key_value;
-	http_t        client;
-	char         *response_buf;
-	size_t        response_buflen = DDNS_HTTP_RESPONSE_BUFFER_SIZE;
-	int           rc = RC_OK;
-
-	response_buf = calloc(response_buflen, sizeof(char));
-	if (!response_buf)
-		return RC_OUT_OF_MEMORY;
-
-	CHECK(http_construct(&client));
-
-	http_set_port(&client, info->server_name.port);
-	http_set_remote_name(&client, info->server_name.name);
-
-	client.ssl_enabled = info->ssl_enabled;
-	CHECK(http_init(&client, "Json query", ddns_get_tcp_force(info)));
-
-	trans.req = request;
-	trans.req_len = request_len;
-	trans.rsp = response_buf;
-	trans.max_rsp_len = response_buflen - 1; /* Save place for a \0 at the end */
-
-	logit(LOG_DEBUG, "Request:\n%s", request);
-	CHECK(http_transaction(&client, &trans));
-
-	http_exit(&client);
-	http_destruct(&client, 1);
-
-	logit(LOG_DEBUG, "Response:\n%s", trans.rsp);
-	CHECK(check_response_code(trans.status));
+	struct pbdata *data = (struct pbdata *)info->data;
+	char buf[2 * MAX_ID];
+	char *id;
 
-	body = trans.rsp_body;
-	if (get_result_value(body, key, &key_value) < 0) {
-		rc = RC_DDNS_RSP_NOHOST;
-		goto cleanup;
-	}
+	if (rest_id_get(info, hostname, get_record_type(hostname->address), buf, sizeof(buf)))
+		return -1;
 
-	if (json_copy_value(dest, dest_size, body, &key_value) < 0) {
-		logit(LOG_ERR, "Key value did not fit into buffer.");
-		rc = RC_BUFFER_OVERFLOW;
-	}
-	logit(LOG_DEBUG, "Key '%s' = %s", key, dest);
+	id = strchr(buf, '/');
+	if (!id)
+		return -1;
+	*id++ = 0;
 
-	cleanup:
-		free(response_buf);
+	if (strlcpy(data->zone_id, buf, MAX_ID) >= MAX_ID ||
+	    strlcpy(data->hostname_id, id, MAX_ID) >= MAX_ID)
+		return -1;
 
-	return rc;
+	return 0;
 }
 
-static const char* get_record_type(const char *address)
+static void save_ids(ddns_info_t *info, ddns_alias_t *hostname)
 {
-	if (strstr(address, ":"))
-		return IPV6_RECORD_TYPE;
+	struct pbdata *data = (struct pbdata *)info->data;
+	char buf[2 * MAX_ID];
 
-	return IPV4_RECORD_TYPE;
+	snprintf(buf, sizeof(buf), "%s/%s", data->zone_id, data->hostname_id);
+	rest_id_set(info, hostname, get_record_type(hostname->address), buf);
 }
 
+/*
+ * The zone and hostname ids are only looked up if not already cached,
+ * the cached ids are dropped if an update is rejected.
+ */
 static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 {
 	const char *zone_name = hostname->name;
@@ -280,13 +215,16 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 		return RC_DDNS_INVALID_OPTION;
 	}
 
-	data = calloc(1, sizeof(struct pbdata));
-	if (!data)
-		return RC_OUT_OF_MEMORY;
+	if (!info->data) {
+		info->data = malloc(sizeof(struct pbdata));
+		if (!info->data)
+			return RC_OUT_OF_MEMORY;
+	}
+	data = (struct pbdata *)info->data;
+	memset(data, 0, sizeof(struct pbdata));
 
-	if (info->data)
-		free(info->data);
-	info->data = data;
+	if (!load_ids(info, hostname))
+		return RC_OK;
 
 	logit(LOG_DEBUG, "Zone: %s", zone_name);
 
@@ -303,7 +241,7 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 		return RC_BUFFER_OVERFLOW;
 	}
 
-	rc = json_extract(data->zone_id, MAX_ID, info, ctx->request_buf, len, "id");
+	rc = json_extract(ctx, data->zone_id, MAX_ID, info, len, "records[0].id");
 	if (rc != RC_OK) {
 		logit(LOG_ERR, "Zone '%s' not found.", zone_name);
 		return rc;
@@ -326,10 +264,11 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 		return RC_BUFFER_OVERFLOW;
 	}
 
-	rc = json_extract(data->hostname_id, MAX_ID, info, ctx->request_buf, ctx->request_buflen, "id");
+	rc = json_extract(ctx, data->hostname_id, MAX_ID, info, len, "records[0].id");
 
 	if (rc == RC_OK) {
 		logit(LOG_DEBUG, "PorkBun Host: '%s' Id: %s", hostname->name, data->hostname_id);
+		save_ids(info, hostname);
 	} else if (rc == RC_DDNS_RSP_NOHOST) {
 		strcpy(data->hostname_id, "");
 		return RC_OK;
@@ -375,15 +314,34 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *hostname)
 {
+	struct pbdata *data = (struct pbdata *)info->data;
+	jsmntok_t tokens[JSON_MAX_TOKENS];
+	json_t doc;
 	int rc;
 
-	(void)info;
-	(void)hostname;
+	/* Record, or zone, deleted since we looked it up */
+	if (trans->status == 400 || trans->status == 404) {
+		logit(LOG_WARNING, "HTTP %d: PorkBun rejected update of %s, looking up ids again on retry.",
+		      trans->status, hostname->name);
+		rest_id_drop(info, hostname);
+	}
 
 	rc = check_response_code(trans->status);
-	if (rc == RC_OK && check_success_only(trans->rsp_body) < 0)
+	if (rc != RC_OK)
+		return rc;
+
+	if (json_parse(&doc, trans->rsp_body, tokens, NELEMS(tokens)) < 0)
+		return RC_DDNS_RSP_NOTOK;
+
+	if (!json_is(&doc, 0, "success", "true"))
 		rc = RC_DDNS_RSP_NOTOK;
 
+	/* New record created, cache its id for the next update */
+	if (rc == RC_OK && data && !data->hostname_id[0] &&
+	    !json_get(&doc, 0, "id", data->hostname_id, MAX_ID))
+		save_ids(info, hostname);
+	json_free(&doc);
+
 	return rc;
 }
 
@@ -22,34 +22,32 @@
 #include "plugin.h"
 
 #define REGFISH_UPDATE_IP_HTTP_REQUEST					\
-	"GET %s?"							\
-	"fqdn=%s&"							\
+	"GET %U?"							\
+	"fqdn=%h&"							\
 	"forcehost=1&"							\
 	"authtype=secure&"						\
-	"token=%s&"							\
-	"ip=%s "   							\
+	"token=%u&"							\
+	"ip=%i "   							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
 #define REGFISH_UPDATE_IP6_HTTP_REQUEST					\
-	"GET %s?"							\
-	"fqdn=%s&"							\
+	"GET %U?"							\
+	"fqdn=%h&"							\
 	"forcehost=1&"							\
 	"authtype=secure&"						\
-	"token=%s&"							\
-	"ipv6=%s "   							\
+	"token=%u&"							\
+	"ipv6=%i "   							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-static int request (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@regfish.de",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "wtfismyip.com",
@@ -59,18 +57,6 @@ static ddns_system_t plugin = {
 	.server_url   = "/"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->name,
-			info->creds.username,
-			alias->address,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *resp = trans->rsp_body;
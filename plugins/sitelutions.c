@@ -25,22 +25,20 @@
 
 /* sitelutions.com specific update address format */
 #define SITELUTIONS_UPDATE_IP_HTTP_REQUEST				\
-	"GET %s?"							\
-	"user=%s&"							\
-	"pass=%s&"							\
-	"id=%s&"							\
-	"ip=%s "							\
+	"GET %U?"							\
+	"user=%u&"							\
+	"pass=%p&"							\
+	"id=%h&"							\
+	"ip=%i "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@sitelutions.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -51,19 +49,6 @@ static ddns_system_t plugin = {
 	.server_url   = "/dnsup"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			info->creds.username,
-			info->creds.password,
-			alias->name,
-			alias->address,
-			info->server_name.name,
-			info->user_agent);
-}
-
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *resp = trans->rsp_body;
@@ -21,29 +21,25 @@
  * Boston, MA  02110-1301, USA.
  */
 
-#include "md5.h"
 #include "plugin.h"
 
 /* HE tunnelbroker.com specific update request format */
 #define HE_IPV6TB_UPDATE_IP_REQUEST					\
-	"GET %s?"							\
-	"ip=%s&"							\
-	"apikey=%s&"							\
-	"pass=%s&"							\
-	"tid=%s "							\
+	"GET %U?"							\
+	"ip=%i&"							\
+	"apikey=%u&"							\
+	"pass=%m&"							\
+	"tid=%h "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"User-Agent: %s\r\n\r\n"
-#define MD5_DIGEST_BYTES  16
+	"Host: %S\r\n"							\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "ipv6@he.net",
 	.alias        = "ipv6tb@he.net",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = "checkip.dns.he.net",
@@ -53,27 +49,6 @@ static ddns_system_t plugin = {
 	.server_url   = "/ipv4_end.php"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	int           i;
-	char          digeststr[MD5_DIGEST_BYTES * 2 + 1];
-	unsigned char digestbuf[MD5_DIGEST_BYTES];
-
-	md5((unsigned char *)info->creds.password, strlen(info->creds.password), digestbuf);
-	for (i = 0; i < MD5_DIGEST_BYTES; i++)
-		sprintf(&digeststr[i * 2], "%02x", digestbuf[i]);
-
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->address,
-			info->creds.username,
-			digeststr,
-			alias->name,
-			info->server_name.name,
-			info->user_agent);
-}
-
 /*
  * Hurricate Electric IPv6 tunnelbroker specific response validator
  * Own IP address and 'already in use' are the good answers.
@@ -22,6 +22,7 @@
 
 #include "plugin.h"
 #include "json.h"
+#include "rest.h"
 
 #define YANDEX_GET_REQUEST						\
 	"GET %s "							\
@@ -40,9 +41,6 @@
 	"Content-Type: application/x-www-form-urlencoded\r\n\r\n"	\
 	"%s"
 
-/* XXX: please increase if not enough */
-#define TOKENS_EXPECTED		4096
-
 struct yandex {
 	char url[512];
 	int  len;
@@ -59,6 +57,7 @@ static ddns_system_t plugin = {
 	.setup        = (setup_fn_t)setup,
 	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
+	.keepalive    = 1,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -68,196 +67,94 @@ static ddns_system_t plugin = {
 	.server_url   = "/dynamic/update.php"
 };
 
-/* FIXME: remove and use parse_json() instead */
-static jsmntok_t *get_tokens(const char *response, int *n)
+static int success(const json_t *doc)
 {
-	jsmn_parser *p;
-	jsmntok_t   *t;
-	int	     r;
-
-	p = malloc(sizeof(*p));
-	if (!p) {
-		logit(LOG_ERR, "Not enough memory");
-		return NULL;
-	}
-
-	t = malloc(sizeof(*t) * TOKENS_EXPECTED);
-	if (!t) {
-		logit(LOG_ERR, "Not enough memory");
-		free(p);
-		return NULL;
-	}
+	return json_is(doc, 0, "success", "ok");
+}
 
-	jsmn_init(p);
-	r = jsmn_parse(p, response, strlen(response), t, TOKENS_EXPECTED);
-	free(p);
-	*n = r;
+/*
+ * Find the A record of @subdomain in a records list, with added
+ * whitespace for clarity:
+ * { "domain": "example.com",
+ *   "records": [{ "record_id": 123, "type": "A", "subdomain": "www", ... }],
+ *   "success": "ok"
+ * }
+ */
+static int get_record_id(const json_t *doc, const char *subdomain)
+{
+	char buf[16];
+	int records, i, k;
 
-	if (r < 0) {
-		logit(LOG_ERR, "Failed to parse JSON");
-		free(t);
-		return NULL;
+	records = json_query(doc, 0, "records");
+	if (records < 0 || doc->tok[records].type != JSMN_ARRAY) {
+		logit(LOG_ERR, "Got JSON document that cannot understand\n");
+		return -1;
 	}
 
-	if ((r < 1) || (t[0].type != JSMN_OBJECT)) {
-		logit(LOG_ERR, "JSON object expected");
-		free(t);
-		return NULL;
+	for (i = records + 1, k = 0; k < doc->tok[records].size; i = json_next(doc, i), k++) {
+		if (!json_is(doc, i, "subdomain", subdomain) || !json_is(doc, i, "type", "A"))
+			continue;
+
+		if (!json_get(doc, i, "record_id", buf, sizeof(buf)) && atoi(buf) > 0)
+			return atoi(buf);
 	}
 
-	return t;
+	return 0;
 }
 
-static int success(const char *response)
+static int fetch_record_id(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 {
-	jsmntok_t *t;
-	int	   n, i;
-	int	   rc = 0;
-
-	t = get_tokens(response, &n);
-	if (!t)
-		return 0;
-
-	for (i = 1; i < n - 1; i++) {
-		jsmntok_t *tok = &t[i];
+	struct yandex *y = (struct yandex *)info->data;
+	jsmntok_t tokens[JSON_MAX_TOKENS];
+	http_trans_t trans;
+	json_t doc;
+	int rc, len;
 
-		if (jsoneq(response, tok, "success"))
-			continue;
+	snprintf(y->url, sizeof(y->url), "/api2/admin/dns/list?domain=%s",
+		 info->creds.username);
+	len = snprintf(ctx->request_buf, ctx->request_buflen,
+		       YANDEX_GET_REQUEST, y->url,
+		       info->server_name.name,
+		       info->creds.password,
+		       info->user_agent);
 
-		if (jsoneq(response, tok + 1, "ok") == 0) {
-			rc = 1;
-			break;
-		}
+	rc = rest_call(ctx, info, "Sending records list query", &trans, len);
+	if (rc || (rc = http_status_valid(trans.status))) {
+		logit(LOG_WARNING, "Failed fetching record_id, rc: %d", rc);
+		return rc;
 	}
 
-	free(t);
+	if (json_parse(&doc, trans.rsp_body, tokens, NELEMS(tokens)) < 0)
+		return RC_DDNS_INVALID_OPTION;
 
-	return rc;
-}
+	if (success(&doc))
+		y->record_id = get_record_id(&doc, alias->name);
+	else
+		y->record_id = -1;
+	json_free(&doc);
 
-static int get_record_id(const char *response, const char *subdomain)
-{
-	jsmntok_t *t;
-	int	   n, i;
-	int	   record_id = 0;
-	int	   id_keyword_found = 0;
-
-	enum {
-		ST_UNKNOWN,
-		ST_FIND_RECORDS,
-		ST_FIND_RECORD_ID
-	} state = ST_UNKNOWN;
-
-	enum {
-		SUBDOMAIN_NONE,
-		SUBDOMAIN_KEYWORD,
-		SUBDOMAIN_VALUE
-	} subdomain_field = SUBDOMAIN_NONE;
-
-	enum {
-		TYPE_NONE,
-		TYPE_KEYWORD,
-		TYPE_VALUE
-	} type_field = TYPE_NONE;
-
-	t = get_tokens(response, &n);
-	if (!t)
-		return -1;
-
-	for (i = 1; i < n; i++) {
-		jsmntok_t *tok = &t[i];
-
-		switch (tok->type) {
-		case JSMN_STRING:
-		case JSMN_PRIMITIVE:
-			if (jsoneq(response, tok, "records") == 0) {
-				state = ST_FIND_RECORDS;
-				break;
-			}
-
-			if (state != ST_FIND_RECORD_ID)
-				break;
-
-			if (jsoneq(response, tok, "subdomain") == 0) {
-				subdomain_field = SUBDOMAIN_KEYWORD;
-				break;
-			}
-
-			if (jsoneq(response, tok, "type") == 0) {
-				type_field = TYPE_KEYWORD;
-				break;
-			}
-
-			if (jsoneq(response, tok, "record_id") == 0) {
-				id_keyword_found = 1;
-				break;
-			}
-
-			if ((subdomain_field == SUBDOMAIN_KEYWORD) &&
-					(jsoneq(response, tok, subdomain)) == 0)
-				subdomain_field = SUBDOMAIN_VALUE;
-
-			if ((type_field == TYPE_KEYWORD) &&
-					(jsoneq(response, tok, "A")) == 0)
-				type_field = TYPE_VALUE;
-
-			if (id_keyword_found) {
-				char buf[129]; // additional byte for \0
-				size_t n = tok->end - tok->start;
-
-				id_keyword_found = 0;
-				if (n > sizeof(buf) - 1)
-					break;
-
-				memset(buf, 0, sizeof(buf));
-				strncpy(buf, response + tok->start, n);
-				record_id = strtol(buf, NULL, 10);
-			}
-
-			if (subdomain_field == SUBDOMAIN_VALUE &&
-					type_field == TYPE_VALUE &&
-					record_id > 0) {
-				free(t);
-				return record_id;
-			}
-
-			break;
-		case JSMN_ARRAY:
-			if (state != ST_FIND_RECORDS)
-				break;
-
-			state = ST_FIND_RECORD_ID;
-			break;
-		case JSMN_OBJECT:
-			if (state != ST_FIND_RECORD_ID)
-				break;
-
-			subdomain_field  = SUBDOMAIN_NONE;
-			type_field	 = TYPE_NONE;
-			id_keyword_found = 0;
-			break;
-
-		case JSMN_UNDEFINED:
-			break;
-		}
-	}
+	if (y->record_id < 0)
+		return RC_DDNS_INVALID_OPTION;
 
-	free(t);
+	if (y->record_id > 0) {
+		char id[REST_MAX_ID];
 
-	if (state != ST_FIND_RECORD_ID) {
-		logit(LOG_ERR, "Got JSON document that cannot understand\n");
-		return -1;
+		snprintf(id, sizeof(id), "%d", y->record_id);
+		rest_id_set(info, alias, info->creds.username, id);
 	}
 
 	return 0;
 }
 
+/*
+ * The record id is only looked up if not already cached, the cached
+ * id is dropped if Yandex responds there is no such record.  The id
+ * of a created record is cached from the response.
+ */
 static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 {
 	struct yandex *y;
-	http_trans_t trans;
-	http_t client;
-	char *resp;
+	char id[REST_MAX_ID];
 	int rc = 0;
 
 	if (!info->data) {
@@ -268,48 +165,14 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 	y = (struct yandex *)info->data;
 	memset(y, 0, sizeof(struct yandex));
 
-	rc = http_construct(&client);
-	if (rc)
-		return rc;
-
-	http_set_port(&client, info->server_name.port);
-	http_set_remote_name(&client, info->server_name.name);
-
-	client.ssl_enabled = info->ssl_enabled;
-	rc = http_init(&client, "Sending records list query", TCP_AUTO);
-	if (rc) {
-		http_destruct(&client, 1);
-		return rc;
-	}
-
-	snprintf(y->url, sizeof(y->url), "/api2/admin/dns/list?domain=%s",
-		 info->creds.username);
-	trans.req_len = snprintf(ctx->request_buf, ctx->request_buflen,
-				 YANDEX_GET_REQUEST, y->url,
-				 info->server_name.name,
-				 info->creds.password,
-				 info->user_agent);
-	trans.req = ctx->request_buf;
-	trans.rsp = ctx->work_buf;
-	trans.max_rsp_len = ctx->work_buflen - 1;
-
-	rc = http_transaction(&client, &trans);
-	http_exit(&client);
-	http_destruct(&client, 1);
-	if (rc || (rc = http_status_valid(trans.status))) {
-		logit(LOG_WARNING, "Failed fetching record_id, rc: %d", rc);
-		return rc;
+	if (!rest_id_get(info, alias, info->creds.username, id, sizeof(id)))
+		y->record_id = atoi(id);
+	if (y->record_id <= 0) {
+		rc = fetch_record_id(ctx, info, alias);
+		if (rc)
+			return rc;
 	}
 
-	resp = trans.rsp_body;
-	logit(LOG_DEBUG, "Yandex response: %s", resp);
-	if (!success(resp))
-		return RC_DDNS_INVALID_OPTION;
-
-	y->record_id = get_record_id(resp, alias->name);
-	if (y->record_id < 0)
-		return RC_DDNS_INVALID_OPTION;
-
 	if (y->record_id > 0) {
 		logit(LOG_INFO, "Updating record, id = %i", y->record_id);
 		y->len = snprintf(y->url, sizeof(y->url),
@@ -348,16 +211,30 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
-	char *resp = trans->rsp_body;
-
-	(void)info;
-	(void)alias;
+	struct yandex *y = (struct yandex *)info->data;
+	jsmntok_t tokens[JSON_MAX_TOKENS];
+	char buf[REST_MAX_ID];
+	json_t doc;
+	int rc = RC_DDNS_RSP_NOTOK;
 
 	DO(http_status_valid(trans->status));
-	if (success(resp))
-		return 0;
+	if (json_parse(&doc, trans->rsp_body, tokens, NELEMS(tokens)) < 0)
+		return RC_DDNS_RSP_NOTOK;
+
+	if (success(&doc)) {
+		/* New record created, cache its id for the next update */
+		if (y && y->record_id <= 0 && !json_get(&doc, 0, "record.record_id", buf, sizeof(buf)))
+			rest_id_set(info, alias, info->creds.username, buf);
+
+		rc = 0;
+	} else if (json_is(&doc, 0, "error", "no_such_record")) {
+		logit(LOG_WARNING, "Yandex record of %s not found, looking it up again on retry.", alias->name);
+		rest_id_drop(info, alias);
+		rc = RC_DDNS_RSP_RETRY_LATER;
+	}
+	json_free(&doc);
 
-	return RC_DDNS_RSP_NOTOK;
+	return rc;
 }
 
 PLUGIN_INIT(plugin_init)
@@ -25,22 +25,20 @@
 #include "plugin.h"
 
 #define ZONEEDIT_UPDATE_IP_REQUEST					\
-	"GET %s?"							\
-	"hostname=%s&"							\
-	"myip=%s&"							\
-	"wildcard=%s "							\
+	"GET %U?"							\
+	"hostname=%h&"							\
+	"myip=%i&"							\
+	"wildcard=%w "							\
 	"HTTP/1.0\r\n"							\
-	"Host: %s\r\n"							\
-	"Authorization: Basic %s\r\n"					\
-	"User-Agent: %s\r\n\r\n"
+	"Host: %S\r\n"							\
+	"Authorization: Basic %C\r\n"					\
+	"User-Agent: %A\r\n\r\n"
 
-static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
 static ddns_system_t plugin = {
 	.name         = "default@zoneedit.com",
 
-	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
@@ -51,19 +49,6 @@ static ddns_system_t plugin = {
 	.server_url   = "/dyn/dynsite.php"
 };
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->name,
-			alias->address,
-			info->wildcard ? "ON" : "OFF",
-			info->server_name.name,
-			info->creds.encoded_password,
-			info->user_agent);
-}
-
 /*
  * NOERROR is the OK code here
  */
@@ -0,0 +1,179 @@
+/* Pool of growable I/O buffers, shared by the HTTP layer and plugins
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "buffer.h"
+#include "error.h"
+
+/*
+ * Idle buffers, shared by all worker threads.  Buffers keep their size
+ * when returned, up to BUF_KEEP_MAX, so after the first few cycles all
+ * requests and responses fit in a buffer from the pool.
+ */
+static LIST_HEAD(, buf) idle = LIST_HEAD_INITIALIZER(idle);
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int num_idle;
+
+/**
+ * buf_get - Get a buffer from the pool, or allocate a new one
+ * @size: Minimum size of buffer
+ *
+ * The contents of the buffer is undefined, except the first byte, which
+ * is always NUL.
+ *
+ * Returns:
+ * Buffer, or %NULL if out of memory.
+ */
+buf_t *buf_get(size_t size)
+{
+	buf_t *buf, *best = NULL;
+
+	pthread_mutex_lock(&lock);
+	/* First that fits, or else the most recently used, to grow */
+	LIST_FOREACH(buf, &idle, link) {
+		if (buf->size >= size) {
+			best = buf;
+			break;
+		}
+	}
+	if (!best)
+		best = LIST_FIRST(&idle);
+	if (best) {
+		LIST_REMOVE(best, link);
+		num_idle--;
+	}
+	pthread_mutex_unlock(&lock);
+
+	buf = best;
+	if (!buf) {
+		buf = calloc(1, sizeof(*buf));
+		if (!buf)
+			return NULL;
+	}
+
+	if (buf_grow(buf, size)) {
+		free(buf->data);
+		free(buf);
+		return NULL;
+	}
+	buf->data[0] = 0;
+
+	return buf;
+}
+
+/**
+ * buf_grow - Grow buffer to at least @size bytes
+ * @buf:  Buffer
+ * @size: Minimum size
+ *
+ * Buffers grow in powers of two, from BUF_DEFAULT_SIZE, and never past
+ * the max-response-size setting.  The contents is kept.
+ *
+ * Returns:
+ * POSIX OK(0), or RC_BUFFER_OVERFLOW if @size is over the limit, or
+ * RC_OUT_OF_MEMORY.
+ */
+int buf_grow(buf_t *buf, size_t size)
+{
+	size_t max = max_response_size > 0 ? (size_t)max_response_size : BUF_DEFAULT_MAX;
+	size_t len = buf->size ? buf->size : BUF_DEFAULT_SIZE;
+	char *data;
+
+	if (size <= buf->size)
+		return 0;
+	if (size > max)
+		return RC_BUFFER_OVERFLOW;
+
+	while (len < size)
+		len *= 2;
+	if (len > max)
+		len = max;
+
+	data = realloc(buf->data, len);
+	if (!data)
+		return RC_OUT_OF_MEMORY;
+
+	buf->data = data;
+	buf->size = len;
+
+	return 0;
+}
+
+/**
+ * buf_put - Return buffer to the pool
+ * @buf: Buffer, or %NULL
+ */
+void buf_put(buf_t *buf)
+{
+	char *data;
+
+	if (!buf)
+		return;
+
+	/* Do not hold on to memory used for a rare large response */
+	if (buf->size > BUF_KEEP_MAX) {
+		data = realloc(buf->data, BUF_DEFAULT_SIZE);
+		if (data) {
+			buf->data = data;
+			buf->size = BUF_DEFAULT_SIZE;
+		}
+	}
+
+	pthread_mutex_lock(&lock);
+	if (num_idle < BUF_POOL_MAX) {
+		LIST_INSERT_HEAD(&idle, buf, link);
+		num_idle++;
+		buf = NULL;
+	}
+	pthread_mutex_unlock(&lock);
+
+	if (buf) {
+		free(buf->data);
+		free(buf);
+	}
+}
+
+/* Free all idle buffers */
+void buf_flush(void)
+{
+	buf_t *buf;
+
+	pthread_mutex_lock(&lock);
+	while ((buf = LIST_FIRST(&idle))) {
+		LIST_REMOVE(buf, link);
+		free(buf->data);
+		free(buf);
+	}
+	num_idle = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -21,16 +21,18 @@
  */
 
 /*
- * A user may have several DNS records to update.  Earlier versions of
- * inadyn supports this, but only recorded changes in one cache file.
- * This made keeping track of update times per record impossible.  Now
- * inadyn records each DNS entry to be updated in its own cache file,
- * enabling individual updates and tracking the file MTIME better.
+ * A user may have several DNS records to update.  The address sent and
+ * the time of the last update of each record is kept in the state store,
+ * a single journal in the cache directory, see state.c.  Earlier versions
+ * of inadyn used one cache file per record, with the time of the update
+ * in the file MTIME.
  *
- * At startup inadyn will fall back to the old cache file and remove it
- * once it has read the IP and the modification time.
+ * At startup inadyn will fall back to the old cache files, and remove
+ * them once their IP and modification time is saved in the journal.
  */
 
+#include <pthread.h>
+#include <signal.h>
 #include <time.h>
 #include <unistd.h>
 #include <netinet/in.h>
@@ -39,10 +41,34 @@
 
 #include "ddns.h"
 #include "cache.h"
+#include "state.h"
 
-extern ddns_info_t *conf_info_iterator(int first);
+#define SEED_MAX_THREADS  32
+#define SEED_DEADLINE     10	/* sec */
 
-static int nslookup(ddns_alias_t *alias)
+/*
+ * Lookups of aliases without a cache file, shared with the resolver
+ * threads.  Lookups still running at the deadline are abandoned, the
+ * last one out frees the state.
+ */
+struct seed {
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+	int             refcnt;
+	int             stop;
+
+	size_t          num;
+	size_t          next;	/* Next lookup to start */
+	size_t          done;	/* Number of completed lookups */
+	struct lookup {
+		char    name[SERVER_NAME_LEN];
+		char    address[MAX_ADDRESS_LEN];
+		int     done;
+		int     error;
+	} lookup[];
+};
+
+static int nslookup(const char *name, char *address, size_t len)
 {
 	struct addrinfo *result;
 	struct addrinfo hints;
@@ -54,61 +80,215 @@ static int nslookup(ddns_alias_t *alias)
 	hints.ai_flags = 0;
 	hints.ai_protocol = 0;          /* Any protocol */
 
-	error = getaddrinfo(alias->name, NULL, &hints, &result);
+	error = getaddrinfo(name, NULL, &hints, &result);
 	if (!error) {
+		/* DNS reply for alias found, convert to IP# */
+		error = getnameinfo(result->ai_addr, result->ai_addrlen, address, len, NULL, 0, NI_NUMERICHOST);
+		freeaddrinfo(result);
+	}
+
+	return error;
+}
+
+static void seed_put(struct seed *seed)
+{
+	int last;
+
+	pthread_mutex_lock(&seed->lock);
+	last = --seed->refcnt == 0;
+	pthread_mutex_unlock(&seed->lock);
+
+	if (!last)
+		return;
+
+	pthread_cond_destroy(&seed->cond);
+	pthread_mutex_destroy(&seed->lock);
+	free(seed);
+}
+
+static void *seed_thread(void *arg)
+{
+	struct seed *seed = (struct seed *)arg;
+
+	pthread_mutex_lock(&seed->lock);
+	while (!seed->stop && seed->next < seed->num) {
+		struct lookup *l = &seed->lookup[seed->next++];
 		char address[MAX_ADDRESS_LEN];
+		int error;
 
-		/* DNS reply for alias found, convert to IP# */
-		if (!getnameinfo(result->ai_addr, result->ai_addrlen, address, sizeof(address), NULL, 0, NI_NUMERICHOST)) {
-			/* Update local record for next checkip call. */
-			alias->last_update = 0;
-			strlcpy(alias->address, address, sizeof(alias->address));
-			logit(LOG_INFO, "Resolving hostname %s => IP# %s", alias->name, address);
+		pthread_mutex_unlock(&seed->lock);
+		error = nslookup(l->name, address, sizeof(address));
+		pthread_mutex_lock(&seed->lock);
+
+		strlcpy(l->address, address, sizeof(l->address));
+		l->error = error;
+		l->done  = 1;
+		seed->done++;
+		pthread_cond_signal(&seed->cond);
+	}
+	pthread_mutex_unlock(&seed->lock);
+
+	seed_put(seed);
+
+	return NULL;
+}
+
+/*
+ * Resolve all aliases without a cache file concurrently, instead of
+ * one after the other, waiting at most SEED_DEADLINE sec in total.
+ */
+static void seed_aliases(ddns_alias_t **alias, size_t num)
+{
+	pthread_condattr_t attr;
+	struct timespec deadline;
+	sigset_t all, old;
+	struct seed *seed;
+	pthread_t tid;
+	size_t i, threads;
+
+	if (!num)
+		return;
+
+	seed = calloc(1, sizeof(*seed) + num * sizeof(seed->lookup[0]));
+	if (!seed)
+		return;
+
+	pthread_mutex_init(&seed->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&seed->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	seed->num = num;
+	for (i = 0; i < num; i++)
+		strlcpy(seed->lookup[i].name, alias[i]->name, sizeof(seed->lookup[i].name));
+
+	logit(LOG_INFO, "Resolving %zu hostnames without cache file ...", num);
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += SEED_DEADLINE;
+
+	seed->refcnt = 1;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (threads = 0; threads < MIN(num, SEED_MAX_THREADS); threads++) {
+		pthread_mutex_lock(&seed->lock);
+		seed->refcnt++;
+		pthread_mutex_unlock(&seed->lock);
+
+		if (pthread_create(&tid, NULL, seed_thread, seed)) {
+			pthread_mutex_lock(&seed->lock);
+			seed->refcnt--;
+			pthread_mutex_unlock(&seed->lock);
+			break;
 		}
+		pthread_detach(tid);
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
 
-		freeaddrinfo(result);
-		return 0;
+	pthread_mutex_lock(&seed->lock);
+	if (!threads) {
+		logit(LOG_WARNING, "Failed starting resolver threads: %s", strerror(errno));
+		seed->stop = 1;
+	}
+	while (seed->done < seed->num && !seed->stop) {
+		if (pthread_cond_timedwait(&seed->cond, &seed->lock, &deadline) == ETIMEDOUT) {
+			logit(LOG_WARNING, "Timed out resolving hostnames, %zu of %zu remaining",
+			      seed->num - seed->done, seed->num);
+			break;
+		}
 	}
+	seed->stop = 1;
 
-	logit(LOG_WARNING, "Failed resolving hostname %s: %s", alias->name, gai_strerror(error));
+	for (i = 0; i < num; i++) {
+		struct lookup *l = &seed->lookup[i];
 
-	return 1;
+		if (!l->done)
+			continue;
+
+		if (l->error) {
+			logit(LOG_WARNING, "Failed resolving hostname %s: %s", l->name, gai_strerror(l->error));
+			continue;
+		}
+
+		/* Update local record for next checkip call. */
+		alias[i]->last_update = 0;
+		strlcpy(alias[i]->address, l->address, sizeof(alias[i]->address));
+		logit(LOG_INFO, "Resolving hostname %s => IP# %s", l->name, l->address);
+	}
+	pthread_mutex_unlock(&seed->lock);
+
+	seed_put(seed);
+}
+
+static int save(ddns_alias_t *alias, const char *name)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%lld", (long long)alias->last_update);
+	if (state_set(name, alias->name, "address", alias->address) ||
+	    state_set(name, alias->name, "time", buf))
+		return 1;
+
+	return 0;
 }
 
-static void read_one(ddns_alias_t *alias, const char *name, int nonslookup)
+/* Import cache file from an earlier version, returns non-zero if found */
+static int read_legacy(ddns_alias_t *alias, const char *name)
 {
 	char path[256];
 	FILE *fp;
 
-	alias->last_update = 0;
-	memset(alias->address, 0, sizeof(alias->address));
-
 	cache_file(alias->name, name, path, sizeof(path));
 	fp = fopen(path, "r");
-	if (!fp) {
-		/* Exception for dnsomatic's special global hostname */
-		if (nonslookup || !strncmp(alias->name, "all.dnsomatic.com", sizeof(alias->name)))
-			return;
-
-		/* Try a DNS lookup of our last known IP#. */
-		nslookup(alias);
-	} else {
-		struct stat st;
-		char address[MAX_ADDRESS_LEN];
+	if (!fp)
+		return 0;
 
-		if (fgets(address, sizeof(address), fp)) {
-			logit(LOG_INFO, "Cached IP# %s for %s from previous invocation.", address, alias->name);
-			strlcpy(alias->address, address, sizeof(alias->address));
-		}
+	if (fgets(alias->address, sizeof(alias->address), fp)) {
+		struct stat st;
 
 		/* Initialize time since last update from modification time of cache file. */
-		if (!fstat(fileno(fp), &st)) {
+		if (!fstat(fileno(fp), &st))
 			alias->last_update = st.st_mtime;
-			logit(LOG_INFO, "Last update of %s on %s", alias->name, ctime(&st.st_mtime));
-		}
 
-		fclose(fp);
+		save(alias, name);
 	}
+	fclose(fp);
+
+	return 1;
+}
+
+/*
+ * Returns non-zero if the alias has no saved state and should be
+ * resolved, sets @legacy if an old cache file was imported.
+ */
+static int read_one(ddns_alias_t *alias, const char *name, int nonslookup, int *legacy)
+{
+	char buf[32];
+
+	alias->last_update = 0;
+	memset(alias->address, 0, sizeof(alias->address));
+
+	if (state_get(name, alias->name, "address", alias->address, sizeof(alias->address))) {
+		if (read_legacy(alias, name)) {
+			*legacy = 1;
+		} else {
+			/* Exception for dnsomatic's special global hostname */
+			if (nonslookup || !strcmp(alias->name, "all.dnsomatic.com"))
+				return 0;
+
+			/* Try a DNS lookup of our last known IP#. */
+			return 1;
+		}
+	} else if (!state_get(name, alias->name, "time", buf, sizeof(buf))) {
+		alias->last_update = strtoll(buf, NULL, 10);
+	}
+
+	if (alias->address[0])
+		logit(LOG_INFO, "Cached IP# %s for %s from previous invocation.", alias->address, alias->name);
+	if (alias->last_update)
+		logit(LOG_INFO, "Last update of %s on %s", alias->name, ctime(&alias->last_update));
+
+	return 0;
 }
 
 char *cache_file(char *name, const char *sysname, char *buf, size_t len)
@@ -131,7 +311,10 @@ char *cache_file(char *name, const char *sysname, char *buf, size_t len)
  */
 int read_cache_file(ddns_t *ctx)
 {
+	ddns_alias_t **lookup;
 	ddns_info_t *info;
+	size_t id, num = 0;
+	int legacy = 0;
 
 	/*
 	 * Clear DNS cache before querying for the IP below, this to
@@ -143,8 +326,17 @@ int read_cache_file(ddns_t *ctx)
 	if (!ctx)
 		return RC_INVALID_POINTER;
 
-	info = conf_info_iterator(1);
-	while (info) {
+	state_open(cache_dir);
+
+	CONF_INFO_FOREACH(info, id)
+		num += info->alias_count;
+
+	lookup = calloc(num + 1, sizeof(*lookup));
+	if (!lookup)
+		return RC_OUT_OF_MEMORY;
+
+	num = 0;
+	CONF_INFO_FOREACH(info, id) {
 		/* XXX: Possibly move this exception to each plugin */
 		const char *except[] = {
 			"ipv6tb@he.net",
@@ -163,40 +355,47 @@ int read_cache_file(ddns_t *ctx)
 		}
 
 // XXX: TODO better plugin identifiction here
-		for (j = 0; j < info->alias_count; j++)
-			read_one(&info->alias[j], name, nonslookup);
+		for (j = 0; j < info->alias_count; j++) {
+			ddns_alias_t *alias = &info->alias[j];
 
-		info = conf_info_iterator(0);
+			if (read_one(alias, name, nonslookup, &legacy))
+				lookup[num++] = alias;
+		}
 	}
 
+	/* Old cache files are no longer needed once saved in the journal */
+	if (legacy && !state_commit()) {
+		CONF_INFO_FOREACH(info, id) {
+			char path[256];
+			size_t j;
+
+			for (j = 0; j < info->alias_count; j++) {
+				cache_file(info->alias[j].name, info->system->name, path, sizeof(path));
+				remove(path);
+			}
+		}
+	}
+
+	seed_aliases(lookup, num);
+	free(lookup);
+
 	return 0;
 }
 
 /*
- * Update cache with new IP
- * /var/cache/inadyn/my.server.name.cache { LAST-IPADDR } MTIME
+ * Update cache with new IP and time of update, saved to disk with all
+ * other changes by the next state_commit()
  */
 int write_cache_file(ddns_alias_t *alias, const char *name)
 {
-	char path[256];	
-	FILE *fp;
-
-	cache_file(alias->name, name, path, sizeof(path));
-	fp = fopen(path, "w");
-	if (fp) {
-		const char *prefix = "ipv6";
+	const char *prefix = "ipv6";
 
-		if (!strncmp(name, prefix, strlen(prefix)))
-			logit(LOG_NOTICE, "Updating IPv6 cache for %s", alias->name);
-		else
-			logit(LOG_NOTICE, "Updating IPv4 cache for %s", alias->name);
-		fprintf(fp, "%s", alias->address);
-		fclose(fp);
+	if (!strncmp(name, prefix, strlen(prefix)))
+		logit(LOG_NOTICE, "Updating IPv6 cache for %s", alias->name);
+	else
+		logit(LOG_NOTICE, "Updating IPv4 cache for %s", alias->name);
 
-		return 0;
-	}
-
-	return 1;
+	return save(alias, name);
 }
 
 /**
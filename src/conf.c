@@ -21,6 +21,8 @@
 
 #include "cache.h"
 #include "ddns.h"
+#include "dns.h"
+#include "pool.h"
 #include "ssl.h"
 
 /*
@@ -43,7 +45,18 @@
  *   hostname = example.dyndns.org
  * }
  */
-static LIST_HEAD(head, di) info_list = LIST_HEAD_INITIALIZER(info_list);
+
+/*
+ * Provider table, indexed by id, with a hash index on the section name,
+ * open addressing holding id + 1.  Built when parsing the .conf file and
+ * read-only until conf_info_cleanup(), so any number of threads can
+ * walk it with CONF_INFO_FOREACH() or look up providers concurrently.
+ */
+static ddns_info_t **info_table;
+static size_t        info_num;
+static size_t        info_max;
+static size_t       *info_hash;
+static size_t        info_hash_size;	/* Power of two, at least 2 * info_max */
 
 static void conf_errfunc(cfg_t *cfg, const char *format, va_list args)
 {
@@ -116,19 +129,13 @@ static int validate_hostname(cfg_t *cfg, const char *provider, cfg_opt_t *hostna
 
 	for (i = 0; i < cfg_opt_size(hostname); i++) {
 		char *name = cfg_opt_getnstr(hostname, i);
-		ddns_info_t info;
 
-		if (sizeof(info.alias[0].name) < strlen(name)) {
+		if (strlen(name) >= SERVER_NAME_LEN) {
 			cfg_error(cfg, "Too long DDNS hostname (%s) in provider %s", name, provider);
 			return -1;
 		}
 	}
 
-	if (i >= DDNS_MAX_ALIAS_NUMBER) {
-		cfg_error(cfg, "Too many hostname aliases, MAX %d supported!", DDNS_MAX_ALIAS_NUMBER);
-		return -1;
-	}
-
 	return 0;
 }
 
@@ -319,11 +326,98 @@ static int cfg_parseproxy(cfg_t *cfg, char *server, tcp_proxy_type_t *type, ddns
 }
 #endif
 
+/*
+ * Allocate the alias table, one entry per hostname, with all names
+ * packed in a single block after it.  Both are sized exactly, and
+ * never reallocated, since aliases are referenced by timers and lists.
+ */
+static int set_aliases(ddns_info_t *info, cfg_t *cfg)
+{
+	size_t i, num, len = 0;
+	char *ptr;
+
+	num = cfg_size(cfg, "hostname");
+	for (i = 0; i < num; i++) {
+		char *str = cfg_getnstr(cfg, "hostname", i);
+
+		if (str)
+			len += strlen(str) + 1;
+	}
+
+	info->alias = calloc(num ? num : 1, sizeof(ddns_alias_t));
+	info->names = malloc(len ? len : 1);
+	if (!info->alias || !info->names) {
+		logit(LOG_ERR, "Failed allocating memory for hostnames in provider %s", cfg_title(cfg));
+		return 1;
+	}
+
+	ptr = info->names;
+	for (i = 0; i < num; i++) {
+		char *str = cfg_getnstr(cfg, "hostname", i);
+
+		if (!str)
+			continue;
+
+		len = strlen(str) + 1;
+		memcpy(ptr, str, len);
+		info->alias[info->alias_count++].name = ptr;
+		ptr += len;
+	}
+
+	return 0;
+}
+
+static int add_responses(cfg_t *cfg, struct match *m, const char *opt, int result)
+{
+	size_t i;
+
+	for (i = 0; i < cfg_size(cfg, opt); i++) {
+		char *str = cfg_getnstr(cfg, opt, i);
+
+		if (str && match_add(m, str, result))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Custom provider response rules, compiled into one matcher.  Success
+ * patterns win over retry and auth failure patterns, any other response
+ * is an error.
+ */
+static int set_responses(cfg_t *cfg, ddns_info_t *info)
+{
+	struct match *m;
+	size_t i;
+
+	m = match_new(MATCH_NOCASE);
+	if (!m)
+		return 1;
+	info->responses = m;
+
+	if (add_responses(cfg, m, "ddns-response", 0))
+		return 1;
+
+	/* Default check, if no configured custom response string(s) */
+	if (!cfg_size(cfg, "ddns-response")) {
+		for (i = 0; generic_responses[i]; i++) {
+			if (match_add(m, generic_responses[i], 0))
+				return 1;
+		}
+	}
+
+	if (add_responses(cfg, m, "ddns-response-retry", RC_DDNS_RSP_RETRY_LATER) ||
+	    add_responses(cfg, m, "ddns-response-auth", RC_DDNS_RSP_AUTH_FAIL))
+		return 1;
+
+	return match_compile(m);
+}
+
 static int set_provider_opts(cfg_t *cfg, ddns_info_t *info, int custom)
 {
 	ddns_system_t *system;
 	const char *str;
-	size_t j;
 
 	if (custom)
 		str = "custom";
@@ -357,6 +451,8 @@ static int set_provider_opts(cfg_t *cfg, ddns_info_t *info, int custom)
 	info->wildcard = cfg_getbool(cfg, "wildcard");
 	info->ttl = cfg_getint(cfg, "ttl");
 	info->proxied = cfg_getbool_or_default(cfg, "proxied", -1);
+	if (!custom)
+		info->zone_refresh = cfg_getint(cfg, "zone-refresh");
 	info->ssl_enabled = cfg_getbool(cfg, "ssl");
 	str = cfg_getstr(cfg, "username");
 	if (str && strlen(str) <= sizeof(info->creds.username))
@@ -366,21 +462,8 @@ static int set_provider_opts(cfg_t *cfg, ddns_info_t *info, int custom)
 		strlcpy(info->creds.password, str, sizeof(info->creds.password));
 	info->ifname = cfg_getstr(cfg, "iface");
 
-	for (j = 0; j < cfg_size(cfg, "hostname"); j++) {
-		size_t pos = info->alias_count;
-
-		str = cfg_getnstr(cfg, "hostname", j);
-		if (!str)
-			continue;
-
-		if (info->alias_count == DDNS_MAX_ALIAS_NUMBER) {
-			logit(LOG_WARNING, "Too many hostname aliases, skipping %s ...", str);
-			continue;
-		}
-
-		strlcpy(info->alias[pos].name, str, sizeof(info->alias[pos].name));
-		info->alias_count++;
-	}
+	if (set_aliases(info, cfg))
+		return 1;
 
 	if (custom) {
 		info->append_myip = cfg_getbool(cfg, "append-myip");
@@ -390,33 +473,8 @@ static int set_provider_opts(cfg_t *cfg, ddns_info_t *info, int custom)
 		if (str && strlen(str) <= sizeof(info->server_url))
 			strlcpy(info->server_url, str, sizeof(info->server_url));
 
-		for (j = 0; j < cfg_size(cfg, "ddns-response"); j++) {
-			size_t pos = info->server_response_num;
-
-			str = cfg_getnstr(cfg, "ddns-response", j);
-			if (!str)
-				continue;
-
-			if (info->server_response_num >= NELEMS(info->server_response)) {
-				logit(LOG_WARNING, "Skipping response '%s', only %zu custom responses supported",
-				      str, NELEMS(info->server_response));
-				continue;
-			}
-
-			strlcpy(info->server_response[pos], str, sizeof(info->server_response[pos]));
-			info->server_response_num++;
-		}
-
-		/* Default check, if no configured custom response string(s) */
-		if (!cfg_size(cfg, "ddns-response")) {
-			for (j = 0; j < NELEMS(info->server_response); j++) {
-				if (!generic_responses[j])
-					break;
-
-				strlcpy(info->server_response[j], generic_responses[j], sizeof(info->server_response[j]));
-				info->server_response_num++;
-			}
-		}
+		if (set_responses(cfg, info))
+			goto error;
 	}
 
 	/*
@@ -488,6 +546,49 @@ error:
 	return 1;
 }
 
+static void hash_info(size_t id)
+{
+	size_t mask = info_hash_size - 1;
+	size_t pos = string_hash(info_table[id]->name, -1) & mask;
+
+	while (info_hash[pos])
+		pos = (pos + 1) & mask;
+	info_hash[pos] = id + 1;
+}
+
+/* Append provider to table, growing table and hash index as needed */
+static int add_info(ddns_info_t *info)
+{
+	if (info_num == info_max) {
+		size_t max = info_max ? 2 * info_max : 8;
+		ddns_info_t **table;
+		size_t *hash, id;
+
+		table = realloc(info_table, max * sizeof(*table));
+		if (!table)
+			return 1;
+		info_table = table;
+
+		hash = calloc(2 * max, sizeof(*hash));
+		if (!hash)
+			return 1;
+
+		free(info_hash);
+		info_hash      = hash;
+		info_hash_size = 2 * max;
+		info_max       = max;
+
+		for (id = 0; id < info_num; id++)
+			hash_info(id);
+	}
+
+	info->id = info_num;
+	info_table[info_num] = info;
+	hash_info(info_num++);
+
+	return 0;
+}
+
 static int create_provider(cfg_t *cfg, int custom)
 {
 	ddns_info_t *info;
@@ -501,44 +602,112 @@ static int create_provider(cfg_t *cfg, int custom)
 	http_construct(&info->checkip);
 	http_construct(&info->server);
 	if (set_provider_opts(cfg, info, custom)) {
+		match_free(info->responses);
+		free(info->alias);
+		free(info->names);
+		free(info);
+		return 1;
+	}
+
+	info->name = cfg_title(cfg);
+	if (add_info(info)) {
+		logit(LOG_ERR, "Failed allocating memory for provider %s", cfg_title(cfg));
+		match_free(info->responses);
+		free(info->alias);
+		free(info->names);
 		free(info);
 		return 1;
 	}
 
-	LIST_INSERT_HEAD(&info_list, info, link);
 	return 0;
 }
 
-ddns_info_t *conf_info_iterator(int first)
+/* Number of providers, valid ids are 0 .. num - 1 */
+size_t conf_info_count(void)
 {
-	static ddns_info_t *ptr = NULL;
+	return info_num;
+}
 
-	if (first) {
-		ptr = LIST_FIRST(&info_list);
-		return ptr;
-	}
+/* Provider by id, NULL when out of range, see CONF_INFO_FOREACH() */
+ddns_info_t *conf_info_get(size_t id)
+{
+	if (id >= info_num)
+		return NULL;
+
+	return info_table[id];
+}
 
-	if (!ptr || ptr == LIST_END(&info_list))
+/* Provider by .conf section name, e.g., default@no-ip.com:1 */
+ddns_info_t *conf_info_find(const char *name)
+{
+	size_t mask, pos, id;
+
+	if (!name || !info_num)
 		return NULL;
 
-	ptr = LIST_NEXT(ptr, link);
-	return ptr;
+	mask = info_hash_size - 1;
+	for (pos = string_hash(name, -1) & mask; (id = info_hash[pos]); pos = (pos + 1) & mask) {
+		if (!strcmp(info_table[id - 1]->name, name))
+			return info_table[id - 1];
+	}
+
+	return NULL;
 }
 
 void conf_info_cleanup(void)
 {
-	ddns_info_t *ptr, *tmp;
+	size_t id;
+
+	for (id = 0; id < info_num; id++) {
+		ddns_info_t *ptr = info_table[id];
 
-	LIST_FOREACH_SAFE(ptr, &info_list, link, tmp) {
 		if (ptr->creds.encoded_password)
 			free(ptr->creds.encoded_password);
+		tmpl_free(ptr);
+		match_free(ptr->responses);
+		if (ptr->alias)
+			free(ptr->alias);
+		if (ptr->names)
+			free(ptr->names);
 		if (ptr->checkip_cmd)
 			free(ptr->checkip_cmd);
 		if (ptr->data)
 			free(ptr->data);
-		LIST_REMOVE(ptr, link);
 		free(ptr);
 	}
+
+	free(info_table);
+	free(info_hash);
+	info_table     = NULL;
+	info_hash      = NULL;
+	info_num       = 0;
+	info_max       = 0;
+	info_hash_size = 0;
+}
+
+/* Pin hostnames to static addresses, replaces any previous pinning */
+static int set_resolve(cfg_t *cfg)
+{
+	size_t i;
+	int ret = 0;
+
+	dns_flush();
+	for (i = 0; i < cfg_size(cfg, "resolve"); i++) {
+		char *str = cfg_getnstr(cfg, "resolve", i);
+		char host[256], *ptr;
+
+		strlcpy(host, str, sizeof(host));
+		ptr = strchr(host, '@');
+		if (ptr)
+			*ptr++ = 0;
+
+		if (!ptr || !host[0] || dns_pin(host, ptr)) {
+			cfg_error(cfg, "Invalid resolve = \"%s\", expected host@address", str);
+			ret = 1;
+		}
+	}
+
+	return ret;
 }
 
 cfg_t *conf_parse_file(char *file, ddns_t *ctx)
@@ -555,6 +724,7 @@ cfg_t *conf_parse_file(char *file, ddns_t *ctx)
 		CFG_BOOL    ("wildcard",     cfg_false, CFGF_NONE),
 		CFG_INT     ("ttl",          -1, CFGF_NONE),
 		CFG_BOOL    ("proxied",      cfg_false, CFGF_NODEFAULT),
+		CFG_INT     ("zone-refresh", DDNS_ZONE_REFRESH, CFGF_NONE),
 		CFG_STR     ("iface",          NULL, CFGF_NONE), /* interface name */
 		CFG_STR     ("checkip-server", NULL, CFGF_NONE), /* Syntax:  name:port */
 		CFG_STR     ("checkip-path",   NULL, CFGF_NONE), /* Default: "/" */
@@ -587,6 +757,8 @@ cfg_t *conf_parse_file(char *file, ddns_t *ctx)
 		CFG_STR     ("ddns-server",    NULL, CFGF_NONE),
 		CFG_STR     ("ddns-path",      NULL, CFGF_NONE),
 		CFG_STR_LIST("ddns-response",  NULL, CFGF_NONE),
+		CFG_STR_LIST("ddns-response-retry", NULL, CFGF_NONE),
+		CFG_STR_LIST("ddns-response-auth",  NULL, CFGF_NONE),
 		CFG_END()
 	};
 	cfg_opt_t opts[] = {
@@ -596,12 +768,17 @@ cfg_t *conf_parse_file(char *file, ddns_t *ctx)
 		CFG_BOOL("secure-ssl",    cfg_true, CFGF_NONE),
 		CFG_BOOL("broken-rtc",    cfg_false, CFGF_NONE),
 		CFG_STR ("ca-trust-file", NULL, CFGF_NONE),
+		CFG_BOOL("persist-ssl-sessions", cfg_false, CFGF_NONE),
 		CFG_STR ("cache-dir",	  NULL, CFGF_DEPRECATED | CFGF_DROP),
 		CFG_INT ("period",	  DDNS_DEFAULT_PERIOD, CFGF_NONE),
 		CFG_INT ("iterations",    DDNS_DEFAULT_ITERATIONS, CFGF_NONE),
 		CFG_INT ("forced-update", DDNS_FORCED_UPDATE_PERIOD, CFGF_NONE),
+		CFG_INT ("concurrency",   DDNS_DEFAULT_CONCURRENCY, CFGF_NONE),
+		CFG_INT ("keepalive-timeout", HTTP_DEFAULT_KEEPALIVE, CFGF_NONE),
+		CFG_INT ("max-response-size", BUF_DEFAULT_MAX, CFGF_NONE),
 		CFG_STR ("iface",         NULL, CFGF_NONE),
 		CFG_STR ("user-agent",    NULL, CFGF_NONE),
+		CFG_STR_LIST("resolve",   NULL, CFGF_NONE), /* Syntax: host@address */
 		CFG_SEC ("provider",      provider_opts, CFGF_MULTI | CFGF_TITLE),
 		CFG_SEC ("custom",        custom_opts, CFGF_MULTI | CFGF_TITLE),
 		CFG_END()
@@ -645,6 +822,19 @@ cfg_t *conf_parse_file(char *file, ddns_t *ctx)
 		ctx->total_iterations = 1;
 	else
 		ctx->total_iterations = cfg_getint(cfg, "iterations");
+	ctx->concurrency              = cfg_getint(cfg, "concurrency");
+	if (ctx->concurrency < 1)
+		ctx->concurrency      = 1;
+	if (ctx->concurrency > POOL_MAX_THREADS)
+		ctx->concurrency      = POOL_MAX_THREADS;
+
+	keepalive_timeout             = cfg_getint(cfg, "keepalive-timeout");
+	if (keepalive_timeout < 0)
+		keepalive_timeout     = 0;
+
+	max_response_size             = cfg_getint(cfg, "max-response-size");
+	if (max_response_size < DDNS_HTTP_RESPONSE_BUFFER_SIZE)
+		max_response_size     = DDNS_HTTP_RESPONSE_BUFFER_SIZE;
 
 	verify_addr                   = cfg_getbool(cfg, "verify-address");
 	ctx->forced_update_fake_addr  = cfg_getbool(cfg, "fake-address");
@@ -663,6 +853,9 @@ cfg_t *conf_parse_file(char *file, ddns_t *ctx)
 		logit(LOG_ERR, "Cannot find CA trust file %s", ca_trust_file);
 		return NULL;
 	}
+	persist_ssl_sessions          = cfg_getbool(cfg, "persist-ssl-sessions");
+	if (set_resolve(cfg))
+		return NULL;
 
 	for (i = 0; i < cfg_size(cfg, "provider"); i++)
 		ret |= create_provider(cfg_getnsec(cfg, "provider", i), 0);
@@ -21,6 +21,7 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -38,9 +39,13 @@
 #include "ddns.h"
 #include "cache.h"
 #include "log.h"
+#include "loop.h"
 #include "base64.h"
 #include "md5.h"
+#include "netlink.h"
+#include "pool.h"
 #include "sha1.h"
+#include "state.h"
 
 /* Conversation with the checkip server */
 #define DYNDNS_CHECKIP_HTTP_REQUEST  					\
@@ -50,30 +55,73 @@
 
 /* Used to preserve values during reset at SIGHUP.  Time also initialized from cache file at startup. */
 static int cached_num_iterations = 0;
-extern ddns_info_t *conf_info_iterator(int first);
 
+/* Context for scheduler callbacks, and any fatal error from them */
+static ddns_t *sched_ctx = NULL;
+static int     sched_rc  = 0;
+static int     sched_closing;
 
-static int wait_for_cmd(ddns_t *ctx)
-{
-	int counter;
-	ddns_cmd_t old_cmd;
+/* Updates from all jobs done within a second are saved together */
+static loop_timer_t commit_timer;
+
+/* Closes idle persistent connections when their keepalive expires */
+static loop_timer_t pool_timer;
+
+typedef enum {
+	JOB_CHECK,		/* Check address, update aliases if needed */
+	JOB_UPDATE,		/* Update aliases, after fake-address */
+	JOB_ALIAS		/* Forced update or retry of due aliases */
+} job_type_t;
+
+/*
+ * Work for a provider, run in a worker thread.  Each job has its own
+ * copy of the context, since plugins compose requests and parse the
+ * response in the context's buffers.
+ */
+typedef struct {
+	job_type_t        type;
+	ddns_t           *ctx;
+	ddns_info_t      *info;
+	struct alias_list aliases;	/* JOB_ALIAS */
+	int               force;	/* JOB_CHECK, forced update */
+	int               fake;		/* JOB_CHECK, fake update sent */
+	int               rc;
+} job_t;
+
+/*
+ * Address source, a checkip server, an interface, or a command.  The
+ * address is shared by all providers using the same source, which is
+ * queried at most once per DDNS_ADDRESS_CACHE_TTL.  Concurrent checks
+ * wait for the query in flight, so they all share it.
+ */
+struct source {
+	LIST_ENTRY(source) link;
+	char              *key;
+	int                busy;	/* Query in flight */
+	int                valid;
+	long long          time;	/* When queried, monotonic msec */
+	int                rc;
+	char               address[MAX_ADDRESS_LEN];
+};
+
+static LIST_HEAD(, source) sources = LIST_HEAD_INITIALIZER(sources);
+static pthread_mutex_t     source_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t      source_cond = PTHREAD_COND_INITIALIZER;
 
+/*
+ * Run the event loop, i.e., any scheduled checks and updates, until
+ * @timeout expires or a command arrives, e.g. SIGUSR1.  There are no
+ * periodic wakeups, the signal callback breaks out of the loop.
+ */
+static int wait_for_cmd(ddns_t *ctx, time_t timeout)
+{
 	if (!ctx)
 		return RC_INVALID_POINTER;
 
-	old_cmd = ctx->cmd;
-	if (old_cmd != NO_CMD)
+	if (ctx->cmd != NO_CMD)
 		return 0;
 
-	counter = ctx->update_period / ctx->cmd_check_period;
-	while (counter--) {
-		if (ctx->cmd != old_cmd)
-			break;
-
-		sleep(ctx->cmd_check_period);
-	}
-
-	return 0;
+	return loop_run(timeout);
 }
 
 static int shell_transaction(ddns_t *ctx, ddns_info_t *info, const char *cmd)
@@ -94,18 +142,18 @@ static int shell_transaction(ddns_t *ctx, ddns_info_t *info, const char *cmd)
 	}
 
 	/* TODO: timeout on fread */
-	rc = fread(ctx->work_buf, 1, ctx->work_buflen, pipe);
+	rc = fread(ctx->work->data, 1, ctx->work->size - 1, pipe);
 	if (rc < 0) {
 		logit(LOG_ERR, "Error running '%s': %s", ctx->request_buf, strerror(errno));
-		ctx->work_buf[0] = 0;
+		ctx->work->data[0] = 0;
 		rc = errno;
 	} else if (rc == 0) {
 		logit(LOG_ERR, "Error running '%s': 0 bytes read", ctx->request_buf);
-		ctx->work_buf[0] = 0;
+		ctx->work->data[0] = 0;
 		rc = RC_INVALID_POINTER;
 	} else {
 		logit(LOG_DEBUG, "Command '%s' returns %d bytes", ctx->request_buf, rc);
-		ctx->work_buf[rc] = 0;
+		ctx->work->data[rc] = 0;
 		rc = 0;
 	}
 	pclose(pipe);
@@ -139,15 +187,13 @@ static int server_transaction(ddns_t *ctx, ddns_info_t *provider)
 	DO(http_init(client, "Checking for IP# change", ddns_get_tcp_force(provider)));
 
 	/* Prepare request for IP server */
-	memset(ctx->work_buf, 0, ctx->work_buflen);
 	memset(ctx->request_buf, 0, ctx->request_buflen);
 	memset(&ctx->http_transaction, 0, sizeof(ctx->http_transaction));
 
 	trans              = &ctx->http_transaction;
 	trans->req_len     = get_req_for_ip_server(ctx, provider);
 	trans->req         = ctx->request_buf;
-	trans->rsp         = ctx->work_buf;
-	trans->max_rsp_len = ctx->work_buflen - 1;	/* Save place for terminating \0 in string. */
+	trans->buf         = ctx->work;	/* Grows for large responses */
 
 	logit(LOG_DEBUG, "Querying DDNS checkip server for my public IP#: %s", ctx->request_buf);
 
@@ -342,7 +388,7 @@ static int get_address_remote(ddns_t *ctx, ddns_info_t *info, char *address, siz
 		return RC_INVALID_POINTER;
 
 	logit(LOG_DEBUG, "IP server response:");
-	logit(LOG_DEBUG, "%s", ctx->work_buf);
+	logit(LOG_DEBUG, "%s", ctx->work->data);
 
 	DO(parse_my_address(ctx->http_transaction.rsp_body, address, len));
 
@@ -353,9 +399,9 @@ static int get_address_cmd(ddns_t *ctx, ddns_info_t *info, char *address, size_t
 {
 	DO(shell_transaction(ctx, info, info->checkip_cmd));
 	logit(LOG_DEBUG, "Command response:");
-	logit(LOG_DEBUG, "%s", ctx->work_buf);
+	logit(LOG_DEBUG, "%s", ctx->work->data);
 
-	DO(parse_my_address(ctx->work_buf, address, len));
+	DO(parse_my_address(ctx->work->data, address, len));
 
 	return 0;
 }
@@ -394,7 +440,23 @@ static int get_ipv4_address_iface(const char *ifname, char *address, size_t len)
 	return 0;
 }
 
-static int get_address_iface(ddns_t *ctx, const char *ifname, char *address, size_t len)
+/* Append valid interface address to work buffer, one per line */
+static void add_address_iface(int family, const char *host, void *arg)
+{
+	ddns_t *ctx = (ddns_t *)arg;
+	size_t pos;
+
+	if (!is_address_valid(family, host)) {
+		logit(LOG_INFO, "Invalid/local address %s, skipping ...", host);
+		return;
+	}
+
+	pos = strlen(ctx->work->data);
+	snprintf(&ctx->work->data[pos], ctx->work->size - pos, "%s\n", host);
+}
+
+/* Fallback when the netlink monitor is not available, query the kernel */
+static int get_address_ifaddrs(ddns_t *ctx, const char *ifname, char *address, size_t len)
 {
 	char *ptr, trailer[IFNAMSIZ + 2];
 	struct ifaddrs *ifaddr, *ifa;
@@ -402,15 +464,12 @@ static int get_address_iface(ddns_t *ctx, const char *ifname, char *address, siz
 	/* Trailer to strip, if set by getnameinfo() */
 	snprintf(trailer, sizeof(trailer), "%%%s", ifname);
 
-	logit(LOG_INFO, "Checking for IP# change, querying interface %s", ifname);
 	if (getifaddrs(&ifaddr))
 		return get_ipv4_address_iface(ifname, address, len);
 
-	memset(ctx->work_buf, 0, ctx->work_buflen);
 	for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
 		int result, family;
 		char host[NI_MAXHOST] = "";
-		size_t pos;
 
 		if (!ifa->ifa_addr)
 			continue;
@@ -418,7 +477,6 @@ static int get_address_iface(ddns_t *ctx, const char *ifname, char *address, siz
 		if (!string_compare(ifa->ifa_name, ifname))
 			continue;
 
-		pos = strlen(ctx->work_buf);
 		family = ifa->ifa_addr->sa_family;
 		if (family == AF_INET || family == AF_INET6) {
 			result = getnameinfo(ifa->ifa_addr, ((family == AF_INET)
@@ -436,21 +494,48 @@ static int get_address_iface(ddns_t *ctx, const char *ifname, char *address, siz
 			if (ptr)
 				*ptr = 0;
 
-			if (!is_address_valid(family, host)) {
-				logit(LOG_INFO, "Invalid/local address %s for %s, skipping ...", host, ifname);
-				continue;
-			}
-
-			snprintf(&ctx->work_buf[pos], ctx->work_buflen - pos, "%s\n", host);
+			add_address_iface(family, host, ctx);
 		}
 	}
 
 	freeifaddrs(ifaddr);
-	DO(parse_my_address(ctx->work_buf, address, len));
+	DO(parse_my_address(ctx->work->data, address, len));
+
+	return 0;
+}
+
+/*
+ * Addresses are read from the table kept up to date by the netlink
+ * monitor, if it runs, otherwise from the kernel.
+ */
+static int get_address_iface(ddns_t *ctx, const char *ifname, char *address, size_t len)
+{
+	logit(LOG_INFO, "Checking for IP# change, querying interface %s", ifname);
+
+	ctx->work->data[0] = 0;
+	if (netlink_foreach(ifname, add_address_iface, ctx) < 0)
+		return get_address_ifaddrs(ctx, ifname, address, len);
+
+	DO(parse_my_address(ctx->work->data, address, len));
 
 	return 0;
 }
 
+/* Interface to read address from, or NULL if the provider does not use one */
+static const char *get_iface(ddns_info_t *info)
+{
+	if (info->checkip_cmd && info->checkip_cmd[0])
+		return NULL;
+
+	if (info->ifname && info->ifname[0])
+		return info->ifname;
+
+	if (iface && iface[0])
+		return iface;
+
+	return NULL;
+}
+
 static int get_address_backend(ddns_t *ctx, ddns_info_t *info, char *address, size_t len)
 {
 	char name[sizeof(info->checkip_name.name)];
@@ -519,46 +604,153 @@ error:
 }
 
 /*
- * Fetch IP, using any of the backends for each DDNS provider,
- * then check for address change.
+ * Key identifying the address source of a provider.  The command is
+ * run with provider and user in its environment, so it is only shared
+ * by sections for the same account.
  */
-static int get_address(ddns_t *ctx)
+static int source_key(ddns_info_t *info, char *key, size_t len)
 {
-	char address[MAX_ADDRESS_LEN];
-	ddns_info_t *info;
+	const char *name = get_iface(info);
+	int n;
+
+	if (info->checkip_cmd && info->checkip_cmd[0])
+		n = snprintf(key, len, "cmd %s %s %s", info->system->name,
+			     info->creds.username, info->checkip_cmd);
+	else if (name)
+		n = snprintf(key, len, "iface %s", name);
+	else
+		n = snprintf(key, len, "http%s://%s:%d%s ipv%d proxy %s",
+			     info->checkip_ssl ? "s" : "", info->checkip_name.name,
+			     info->checkip_name.port, info->checkip_url,
+			     ddns_get_tcp_force(info) == TCP_FORCE_IPV6 ? 6 : 4,
+			     info->proxy_name.name);
+
+	return n < 0 || (size_t)n >= len;
+}
 
-	info = conf_info_iterator(1);
-	while (info) {
-		int anychange = 0;
-		size_t i;
+/* Called from worker threads, see struct source */
+static int get_address_source(ddns_t *ctx, ddns_info_t *info, char *address, size_t len)
+{
+	struct source *src;
+	char key[1024];
+	int rc;
 
-		if (get_address_backend(ctx, info, address, sizeof(address)))
-			goto next;
+	if (source_key(info, key, sizeof(key)))
+		return get_address_backend(ctx, info, address, len);
 
-		for (i = 0; i < info->alias_count; i++) {
-			ddns_alias_t *alias = &info->alias[i];
+	pthread_mutex_lock(&source_lock);
+	LIST_FOREACH(src, &sources, link) {
+		if (!strcmp(src->key, key))
+			break;
+	}
 
-			alias->ip_has_changed = strncmp(alias->address, address, sizeof(alias->address)) != 0;
-			if (alias->ip_has_changed) {
-				anychange++;
-				strlcpy(alias->address, address, sizeof(alias->address));
-			}
+	if (!src) {
+		src = calloc(1, sizeof(*src));
+		if (!src || !(src->key = strdup(key))) {
+			pthread_mutex_unlock(&source_lock);
+			free(src);
+			return get_address_backend(ctx, info, address, len);
+		}
+		LIST_INSERT_HEAD(&sources, src, link);
+	}
 
-#ifdef ENABLE_SIMULATION
-			logit(LOG_WARNING, "In simulation, forcing IP# change ...");
-			alias->ip_has_changed = 1;
+	while (src->busy)
+		pthread_cond_wait(&source_cond, &source_lock);
+
+	if (src->valid && loop_now() - src->time < DDNS_ADDRESS_CACHE_TTL * 1000) {
+		rc = src->rc;
+		strlcpy(address, src->address, len);
+		pthread_mutex_unlock(&source_lock);
+
+		logit(LOG_DEBUG, "Using address %s for %s, from %s", rc ? "(none)" : address,
+		      info->system->name, key);
+		return rc;
+	}
+
+	src->busy = 1;
+	pthread_mutex_unlock(&source_lock);
+
+	rc = get_address_backend(ctx, info, address, len);
+
+	pthread_mutex_lock(&source_lock);
+	src->busy  = 0;
+	src->valid = 1;
+	src->time  = loop_now();
+	src->rc    = rc;
+	strlcpy(src->address, address, sizeof(src->address));
+	pthread_cond_broadcast(&source_cond);
+	pthread_mutex_unlock(&source_lock);
+
+	return rc;
+}
+
+/* Forget all addresses, e.g., on interface change or check now command */
+static void source_flush(void)
+{
+	struct source *src;
+
+	pthread_mutex_lock(&source_lock);
+	LIST_FOREACH(src, &sources, link)
+		src->valid = 0;
+	pthread_mutex_unlock(&source_lock);
+}
+
+/* Called when no jobs are running */
+static void source_free(void)
+{
+	struct source *src;
+
+	while ((src = LIST_FIRST(&sources))) {
+		LIST_REMOVE(src, link);
+		free(src->key);
+		free(src);
+	}
+}
+
+/*
+ * Fetch IP, using any of the backends for this DDNS provider, then
+ * check for address change.  The aliases are only visited when the
+ * address differs from what the provider saw last time.
+ */
+static int get_address(ddns_t *ctx, ddns_info_t *info, int *changed)
+{
+	char address[MAX_ADDRESS_LEN];
+	int anychange = 0;
+	size_t i;
+
+	*changed = 0;
+	if (get_address_source(ctx, info, address, sizeof(address)))
+		return 1;
+
+#ifndef ENABLE_SIMULATION
+	if (!strncmp(info->address, address, sizeof(info->address))) {
+		logit(LOG_INFO, "No IP# change detected for %s, still at %s", info->system->name, address);
+		return 0;
+	}
 #endif
-		}
+	strlcpy(info->address, address, sizeof(info->address));
+	*changed = 1;
 
-		if (!anychange)
-			logit(LOG_INFO, "No IP# change detected for %s, still at %s", info->system->name, address);
-		else
-			logit(LOG_INFO, "Current IP# %s at %s", address, info->system->name);
+	for (i = 0; i < info->alias_count; i++) {
+		ddns_alias_t *alias = &info->alias[i];
+
+		alias->ip_has_changed = strncmp(alias->address, address, sizeof(alias->address)) != 0;
+		if (alias->ip_has_changed) {
+			anychange++;
+			strlcpy(alias->address, address, sizeof(alias->address));
+		}
 
-	next:
-		info = conf_info_iterator(0);
+#ifdef ENABLE_SIMULATION
+		logit(LOG_WARNING, "In simulation, forcing IP# change ...");
+		alias->ip_has_changed = 1;
+#endif
 	}
 
+	if (!anychange)
+		logit(LOG_INFO, "No IP# change detected for %s, still at %s", info->system->name, address);
+	else
+		logit(LOG_INFO, "Current IP# %s at %s", address, info->system->name);
+
 	return 0;
 }
 
@@ -570,40 +762,67 @@ static int time_to_check(ddns_t *ctx, ddns_alias_t *alias)
 		(past_time > ctx->forced_update_period_sec);
 }
 
-static int check_alias_update_table(ddns_t *ctx)
+static void check_alias_update_table(ddns_t *ctx, ddns_info_t *info)
 {
-	ddns_info_t *info;
-
-	/* Uses fix test if ip of server 0 has changed.
-	 * That should be OK even if changes check_address() to
-	 * iterate over servernum, but not if it's fix set to =! 0 */
-	info = conf_info_iterator(1);
-	while (info) {
-		size_t i;
+	size_t i;
 
-		for (i = 0; i < info->alias_count; i++) {
-			int override;
-			ddns_alias_t *alias = &info->alias[i];
+	for (i = 0; i < info->alias_count; i++) {
+		int override;
+		ddns_alias_t *alias = &info->alias[i];
 
 /* XXX: TODO time_to_check() will return false positive if the cache
  *     file is missing => causing unnecessary update.  We should save
  *     the cache file with the current IP instead and fall back to
  *     standard update interval!
  */
-			override = time_to_check(ctx, alias);
-			if (!alias->ip_has_changed && !override) {
-				alias->update_required = 0;
-				continue;
-			}
-
-			alias->update_required = 1;
-			logit(LOG_NOTICE, "Update %s for alias %s, new IP# %s",
-			      override ? "forced" : "needed", alias->name, alias->address);
+		override = time_to_check(ctx, alias);
+		if (!alias->ip_has_changed && !override) {
+			alias->update_required = 0;
+			continue;
 		}
 
-		info = conf_info_iterator(0);
+		alias->update_required = 1;
+		logit(LOG_NOTICE, "Update %s for alias %s, new IP# %s",
+		      override ? "forced" : "needed", alias->name, alias->address);
+		alias->ip_has_changed = 0;
+	}
+}
+
+/*
+ * Compose update request for @num aliases from the compiled template,
+ * gathered from @iov, or from the plugin's own request composer.  The
+ * template only writes URL encoded values to @val, the request is
+ * copied to request_buf only for debug logging.
+ */
+static int compose_request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t **alias, size_t num,
+			   http_trans_t *trans, struct iovec *iov, int iovcnt, char *val, size_t len)
+{
+	memset(trans, 0, sizeof(*trans));
+	trans->req = ctx->request_buf;
+	trans->buf = ctx->work;	/* Grows for large responses */
+
+	if (!info->tmpl) {
+		memset(ctx->request_buf, 0, ctx->request_buflen);
+		if (num > 1)
+			trans->req_len = info->system->batch_request(ctx, info, alias, num);
+		else
+			trans->req_len = info->system->request(ctx, info, alias[0]);
+		if (trans->req_len < 0 || (size_t)trans->req_len >= ctx->request_buflen)
+			return RC_BUFFER_OVERFLOW;
+
+		ctx->request_buf[trans->req_len] = 0;
+		return 0;
 	}
 
+	trans->req_len = tmpl_render(info, alias, num, val, len, iov, &iovcnt);
+	if (trans->req_len < 0)
+		return RC_BUFFER_OVERFLOW;
+
+	trans->iov    = iov;
+	trans->iovcnt = iovcnt;
+	if (log_enabled(LOG_DEBUG))
+		tmpl_copy(iov, iovcnt, ctx->request_buf, ctx->request_buflen);
+
 	return 0;
 }
 
@@ -612,35 +831,37 @@ static int send_update(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias, int
 	int            rc;
 	http_trans_t   trans;
 	http_t        *client = &info->server;
-
-	if (info->system->setup)
-		DO(info->system->setup(ctx, info, alias));
+	struct iovec   iov[TMPL_MAX_IOV];
+	char           val[3 * (SERVER_NAME_LEN + MAX_ADDRESS_LEN)];
+
+	if (info->system->setup) {
+		rc = info->system->setup(ctx, info, alias);
+		if (rc == RC_DDNS_RSP_UNCHANGED) {
+			logit(LOG_INFO, "%s already up-to-date with IP# %s, skipping update",
+			      alias->name, alias->address);
+			alias->force_addr_update = 0;
+			return 0;
+		}
+		if (rc)
+			return rc;
+	}
 
 	client->ssl_enabled = info->ssl_enabled;
+	client->keepalive   = info->system->keepalive;
 	rc = http_init(client, "Sending IP# update to DDNS server", ddns_get_tcp_force(info));
 	if (rc) {
-		/* Update failed, force update again in ctx->cmd_check_period seconds */
+		/* Update failed, force update again on retry */
 		alias->force_addr_update = 1;
 		return rc;
 	}
 
-	memset(ctx->work_buf, 0, ctx->work_buflen);
-	memset(ctx->request_buf, 0, ctx->request_buflen);
-	memset(&trans, 0, sizeof(trans));
-
-	trans.req_len     = info->system->request(ctx, info, alias);
-	trans.req         = (char *)ctx->request_buf;
-	trans.rsp         = (char *)ctx->work_buf;
-	trans.max_rsp_len = ctx->work_buflen - 1;	/* Save place for a \0 at the end */
-
-	if (trans.req_len < 0) {
+	if (compose_request(ctx, info, &alias, 1, &trans, iov, NELEMS(iov), val, sizeof(val))) {
 		logit(LOG_ERR, "Invalid HTTP GET request in %s provider, cannot update.", info->system->name);
 		rc = RC_ERROR;
 
 		goto exit;
 	}
 
-	ctx->request_buf[trans.req_len] = 0;
 	logit(LOG_DEBUG, "Sending alias table update to DDNS server: %s", ctx->request_buf);
 
 #ifdef ENABLE_SIMULATION
@@ -649,9 +870,8 @@ static int send_update(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias, int
 #endif
 	rc = http_transaction(client, &trans);
 	if (rc) {
-		/* Update failed, force update again in ctx->cmd_check_period seconds */
+		/* Update failed, force update again on retry */
 		logit(LOG_WARNING, "HTTP(S) Transaction failed, error %d: %s", rc, error_str(rc));
-		logit(LOG_INFO, "Update failed, forced update/retry in %d sec ...", ctx->cmd_check_period);
 		alias->force_addr_update = 1;
 		goto exit;
 	}
@@ -664,7 +884,7 @@ static int send_update(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias, int
 //		logit(LOG_WARNING, "[%d %s]", trans.status, trans.status_desc);
 		logit(LOG_DEBUG, "%s", trans.rsp_body != trans.rsp ? trans.rsp_body : "");
 
-		/* Update failed, force update again in ctx->cmd_check_period seconds */
+		/* Update failed, force update again on retry */
 		alias->force_addr_update = 1;
 	} else {
 		logit(LOG_INFO, "Successful alias table update for %s => new IP# %s",
@@ -681,84 +901,297 @@ exit:
 	return rc;
 }
 
-static int update_alias_table(ddns_t *ctx)
+/*
+ * Send update for @num aliases, all to the same address, in a single
+ * request.  The outcome of each alias is stored in @result, unless the
+ * request does not fit in the request buffer.
+ */
+static int send_update_batch(ddns_t *ctx, ddns_info_t *info, ddns_alias_t **alias, int *result, size_t num)
 {
-	int rc = 0, remember = 0;
-	int anychange = 0;
-	ddns_info_t *info;
+	int            rc = 0;
+	http_trans_t   trans;
+	http_t        *client = &info->server;
+	struct iovec   iov[TMPL_MAX_IOV];
+	char           val[3 * (SERVER_NAME_LEN + MAX_ADDRESS_LEN)];
+	size_t         i;
 
-	/* Issue #15: On external trig. force update to random addr. */
-	if (ctx->forced_update_fake_addr) {
-		/* If the DDNS server responds with an error, we ignore it here,
-		 * since this is just to fool the DDNS server to register a a
-		 * change, i.e., an active user. */
-		info = conf_info_iterator(1);
-		while (info) {
-			size_t i;
+	if (num < 1 || num > DDNS_MAX_BATCH_NUMBER)
+		return RC_BUFFER_OVERFLOW;
+
+	rc = compose_request(ctx, info, alias, num, &trans, iov, NELEMS(iov), val, sizeof(val));
+	if (rc)
+		return rc;
 
-			for (i = 0; i < info->alias_count; i++) {
-				ddns_alias_t *alias = &info->alias[i];
-				if (alias->force_addr_update) {
-					char backup[sizeof(alias->address)];
+	for (i = 0; info->system->setup && i < num && !rc; i++)
+		rc = info->system->setup(ctx, info, alias[i]);
+	if (rc)
+		goto fail;
 
-					strlcpy(backup, alias->address, sizeof(backup));
+	client->ssl_enabled = info->ssl_enabled;
+	client->keepalive   = info->system->keepalive;
+	rc = http_init(client, "Sending IP# update to DDNS server", ddns_get_tcp_force(info));
+	if (rc)
+		goto fail;
 
-					/* Picking random address in 203.0.113.0/24 ... */
-					snprintf(alias->address, sizeof(alias->address), "203.0.113.%d", (rand() + 1) % 255);
-					TRY(send_update(ctx, info, alias, NULL));
+	logit(LOG_DEBUG, "Sending batch update of %zu aliases to DDNS server: %s", num, ctx->request_buf);
 
-					strlcpy(alias->address, backup, sizeof(alias->address));
-				}
-			}
+#ifdef ENABLE_SIMULATION
+	logit(LOG_WARNING, "In simulation, skipping update to server ...");
+	http_exit(client);
+	for (i = 0; i < num; i++)
+		result[i] = 0;
+	return 0;
+#endif
+	rc = http_transaction(client, &trans);
+	http_exit(client);
+	if (rc) {
+		logit(LOG_WARNING, "HTTP(S) Transaction failed, error %d: %s", rc, error_str(rc));
+		goto fail;
+	}
+	logit(LOG_DEBUG, "DDNS server response: %s", trans.rsp);
+
+	rc = info->system->batch_response(&trans, info, alias, result, num);
+	if (rc)
+		goto fail;
 
-			info = conf_info_iterator(0);
+	for (i = 0; i < num; i++) {
+		if (result[i]) {
+			logit(LOG_WARNING, "%s error in DDNS server response for %s: %s",
+			      result[i] == RC_DDNS_RSP_RETRY_LATER || result[i] == RC_DDNS_RSP_TOO_FREQUENT
+			      ? "Temporary" : "Fatal", alias[i]->name, error_str(result[i]));
+			alias[i]->force_addr_update = 1;
+		} else {
+			logit(LOG_INFO, "Successful alias table update for %s => new IP# %s",
+			      alias[i]->name, alias[i]->address);
+			alias[i]->force_addr_update = 0;
 		}
+	}
 
-		/* Play nice with server, wait a bit before sending actual IP */
-		sleep(3);
+	return 0;
+fail:
+	/* Update failed, force update again on retry */
+	for (i = 0; i < num; i++) {
+		alias[i]->force_addr_update = 1;
+		result[i] = rc;
 	}
 
-	info = conf_info_iterator(1);
-	while (info) {
-		size_t i;
+	return rc;
+}
 
-		for (i = 0; i < info->alias_count; i++) {
-			ddns_alias_t *alias = &info->alias[i];
-			char *event = "update";
-			rc = 0;
+/* Only errors reported by the DDNS server affect scheduling */
+static int server_error(int rc)
+{
+	switch (rc) {
+	case RC_DDNS_RSP_NOTOK:
+	case RC_DDNS_RSP_AUTH_FAIL:
+	case RC_DDNS_RSP_RETRY_LATER:
+	case RC_DDNS_RSP_TOO_FREQUENT:
+		return rc;
 
-			if (!alias->update_required) {
-				if (exec_mode == EXEC_MODE_COMPAT)
-					continue;
-				event = "nochg";
-			} else if ((rc = send_update(ctx, info, alias, &anychange))) {
-				if (exec_mode == EXEC_MODE_COMPAT)
-					break;
-				event = "error";
-			} else {
-				/* Only reset if send_update() succeeds. */
-				alias->update_required = 0;
-				alias->last_update = time(NULL);
-
-				/* Update cache file for this entry */
-				write_cache_file(alias, info->system->name);
-			}
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * Arm alias timer, either for a retry after a failed update, or for
+ * the next forced update after a successful one.  A server asking us
+ * to back off gets the error period, other failures are retried on
+ * the normal period.
+ */
+static void schedule_alias(ddns_t *ctx, ddns_alias_t *alias, int rc)
+{
+	long long sec;
+
+	if (rc) {
+		if (rc == RC_DDNS_RSP_RETRY_LATER || rc == RC_DDNS_RSP_TOO_FREQUENT)
+			sec = ctx->error_update_period_sec;
+		else
+			sec = ctx->normal_update_period_sec;
+		logit(LOG_INFO, "Update of %s failed, retry in %lld sec ...", alias->name, sec);
+	} else {
+		sec = alias->last_update + ctx->forced_update_period_sec - time(NULL);
+		if (sec < 0)
+			sec = 0;
+		if (sec > ctx->forced_update_period_sec)
+			sec = ctx->forced_update_period_sec;
+	}
+
+	loop_timer_add(&alias->timer, sec * 1000);
+}
+
+/* Record outcome of update, handled by alias_done() in the main thread */
+static void update_result(ddns_info_t *info, ddns_alias_t *alias, int rc)
+{
+	if (rc) {
+		if (exec_mode != EXEC_MODE_COMPAT)
+			alias->event = "error";
+	} else {
+		/* Only reset if the update succeeds. */
+		alias->update_required = 0;
+		alias->last_update = time(NULL);
+
+		/* Update cache file for this entry */
+		write_cache_file(alias, info->system->name);
+		alias->event = "update";
+	}
+
+	alias->reschedule = 1;
+	alias->result = rc;
+}
+
+/*
+ * Update a single alias, if required.  Runs in a worker thread, so the
+ * outcome is only recorded in the alias, any script and the next forced
+ * update or retry are handled by alias_done() in the main thread.
+ */
+static int update_alias(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+{
+	int rc;
+
+	if (!alias->update_required) {
+		if (exec_mode != EXEC_MODE_COMPAT)
+			alias->event = "nochg";
+		return 0;
+	}
+
+	rc = send_update(ctx, info, alias, NULL);
+	update_result(info, alias, rc);
+
+	return rc;
+}
+
+/* Send @num aliases, halving the batch if the request is too large */
+static void send_batch(ddns_t *ctx, ddns_info_t *info, ddns_alias_t **batch, size_t num)
+{
+	int result[DDNS_MAX_BATCH_NUMBER];
+	size_t i, n, pos;
+	int rc;
+
+	for (pos = 0; pos < num; pos += n) {
+		n = num - pos;
+		while ((rc = send_update_batch(ctx, info, &batch[pos], result, n)) == RC_BUFFER_OVERFLOW && n > 1)
+			n /= 2;
+		if (rc == RC_BUFFER_OVERFLOW)
+			continue;
+
+		for (i = 0; i < n; i++)
+			update_result(info, batch[pos + i], result[i]);
+	}
+}
+
+/*
+ * Update aliases sharing the same address in batches, for plugins that
+ * support it.  Aliases that do not fit in a batch, or have an address
+ * of their own, are left for update_alias().
+ */
+static void update_alias_batch(ddns_t *ctx, ddns_info_t *info)
+{
+	ddns_alias_t *batch[DDNS_MAX_BATCH_NUMBER];
+	char address[MAX_ADDRESS_LEN] = "";
+	size_t i, num = 0;
+
+	for (i = 0; i < info->alias_count; i++) {
+		ddns_alias_t *alias = &info->alias[i];
+
+		if (!alias->update_required)
+			continue;
+		if (address[0] && strcmp(alias->address, address))
+			continue;
+
+		strlcpy(address, alias->address, sizeof(address));
+		batch[num++] = alias;
+		if (num == NELEMS(batch)) {
+			send_batch(ctx, info, batch, num);
+			num = 0;
+		}
+	}
+
+	if (num > 1)
+		send_batch(ctx, info, batch, num);
+}
+
+/* Called in main thread when an update job is done with the alias */
+static void alias_done(ddns_t *ctx, ddns_alias_t *alias)
+{
+	if (alias->reschedule)
+		schedule_alias(ctx, alias, alias->result);
+
+	/* Run command or script on successful update. */
+	if (alias->event && script_exec)
+		os_shell_execute(script_exec, alias->address, alias->name, alias->event, alias->result);
 
-			/* Run command or script on successful update. */
-			if (script_exec)
-				os_shell_execute(script_exec, alias->address, alias->name, event, rc);
+	alias->reschedule = 0;
+	alias->event = NULL;
+}
+
+static int update_alias_table(ddns_t *ctx, ddns_info_t *info)
+{
+	int rc = 0;
+	size_t i;
+
+	if ((info->system->batch_request || info->tmpl) && info->system->batch_response)
+		update_alias_batch(ctx, info);
+
+	for (i = 0; i < info->alias_count; i++) {
+		ddns_alias_t *alias = &info->alias[i];
+
+		/* Already sent in a batch */
+		if (alias->reschedule)
+			rc = alias->result;
+		else
+			rc = update_alias(ctx, info, alias);
+		if (rc && exec_mode == EXEC_MODE_COMPAT)
+			break;
+	}
+
+	/* Remaining aliases were skipped, let them retry on their own */
+	while (rc && ++i < info->alias_count) {
+		ddns_alias_t *alias = &info->alias[i];
+
+		if (alias->update_required && !alias->reschedule) {
+			alias->reschedule = 1;
+			alias->result = rc;
 		}
+	}
+
+	return server_error(rc);
+}
 
-		if (RC_DDNS_RSP_NOTOK == rc || RC_DDNS_RSP_AUTH_FAIL == rc)
-			remember = rc;
+/*
+ * Issue #15: On external trig. force update to random addr.
+ *
+ * If the DDNS server responds with an error, we ignore it here, since
+ * this is just to fool the DDNS server to register a a change, i.e.,
+ * an active user.  Returns number of fake updates sent.
+ */
+static int fake_update(ddns_t *ctx, ddns_info_t *info)
+{
+	int rc = 0, num = 0;
+	size_t i;
+
+	for (i = 0; i < info->alias_count; i++) {
+		ddns_alias_t *alias = &info->alias[i];
+		char backup[sizeof(alias->address)];
+
+		if (!alias->force_addr_update)
+			continue;
 
-		if ((RC_DDNS_RSP_RETRY_LATER == rc || rc == RC_DDNS_RSP_TOO_FREQUENT) && !remember)
-			remember = rc;
+		strlcpy(backup, alias->address, sizeof(backup));
 
-		info = conf_info_iterator(0);
+		/* Picking random address in 203.0.113.0/24 ... */
+		snprintf(alias->address, sizeof(alias->address), "203.0.113.%d", (rand() + 1) % 255);
+		rc = send_update(ctx, info, alias, NULL);
+		num++;
+
+		strlcpy(alias->address, backup, sizeof(alias->address));
+		if (rc)
+			break;
 	}
 
-	return remember;
+	return num;
 }
 
 static int get_encoded_user_passwd(void)
@@ -767,6 +1200,7 @@ static int get_encoded_user_passwd(void)
 	char *buf = NULL;
 	size_t len;
 	ddns_info_t *info;
+	size_t id;
 
 	/* Take base64 encoding into account when allocating buf */
 	len = sizeof(info->creds.password) + sizeof(info->creds.username) + 2;
@@ -776,8 +1210,7 @@ static int get_encoded_user_passwd(void)
 	if (!buf)
 		return RC_OUT_OF_MEMORY;
 
-	info = conf_info_iterator(1);
-	while (info) {
+	CONF_INFO_FOREACH(info, id) {
 		int rc2;
 		char *encode;
 		size_t dlen = 0;
@@ -816,8 +1249,6 @@ static int get_encoded_user_passwd(void)
 		info->creds.encoded_password = encode;
 		info->creds.encoded = 1;
 		info->creds.size = strlen(info->creds.encoded_password);
-
-		info = conf_info_iterator(0);
 	}
 
 	memset(buf, 0, len);
@@ -826,64 +1257,17 @@ static int get_encoded_user_passwd(void)
 	return rc;
 }
 
-static int init_context(ddns_t *ctx)
+/*
+ * Compile request templates of all providers, once the credentials
+ * have been encoded, so updates only fill in hostname and address.
+ */
+static int compile_templates(void)
 {
 	ddns_info_t *info;
-	struct timeval tv;
+	size_t id;
 
-	if (!ctx)
-		return RC_INVALID_POINTER;
-
-	if (ctx->initialized == 1)
-		return 0;
-
-	/* Seed prng, used in silly IP randomizer */
-	gettimeofday(&tv, NULL);
-	srand((unsigned int)tv.tv_usec);
-
-	info = conf_info_iterator(1);
-	while (info) {
-		http_t *checkip = &info->checkip;
-		http_t *update  = &info->server;
-
-		if (strlen(info->proxy_name.name)) {
-			http_set_port(checkip, info->proxy_name.port);
-			http_set_port(update,  info->proxy_name.port);
-
-			http_set_remote_name(checkip, info->proxy_name.name);
-			http_set_remote_name(update,  info->proxy_name.name);
-		} else {
-			http_set_port(checkip, info->checkip_name.port);
-			http_set_port(update,  info->server_name.port);
-
-			http_set_remote_name(checkip, info->checkip_name.name);
-			http_set_remote_name(update,  info->server_name.name);
-		}
-
-		info = conf_info_iterator(0);
-	}
-
-	/* Restore values, if reset by SIGHUP.  Initialize time from cache file at startup. */
-	ctx->num_iterations = cached_num_iterations;
-
-	ctx->initialized = 1;
-
-	return 0;
-}
-
-static int check_address(ddns_t *ctx)
-{
-	if (!ctx)
-		return RC_INVALID_POINTER;
-
-	/* Get IP address from any of the different backends */
-	DO(get_address(ctx));
-
-	/* Step through aliases list, resolve them and check if they point to my IP */
-	DO(check_alias_update_table(ctx));
-
-	/* Update IPs marked as not identical with my IP */
-	DO(update_alias_table(ctx));
+	CONF_INFO_FOREACH(info, id)
+		DO(tmpl_compile(info));
 
 	return 0;
 }
@@ -891,15 +1275,17 @@ static int check_address(ddns_t *ctx)
 /*
  * Error filter.  Some errors are to be expected in a network
  * application, some we can recover from, wait a shorter while and try
- * again, whereas others are terminal, e.g., some OS errors.
+ * again, whereas others are terminal, e.g., some OS errors.  If @info
+ * is given, its check period is adjusted accordingly.
  */
-static int check_error(ddns_t *ctx, int rc)
+static int check_error(ddns_t *ctx, ddns_info_t *info, int rc)
 {
 	const char *errstr = "Error response from DDNS server";
 
 	switch (rc) {
 	case RC_OK:
-		ctx->update_period = ctx->normal_update_period_sec;
+		if (info)
+			info->period = ctx->normal_update_period_sec;
 		break;
 
 	/* dyn_dns_update_ip() failed, inform the user the (network) error
@@ -912,8 +1298,11 @@ static int check_error(ddns_t *ctx, int rc)
 	case RC_DDNS_RSP_RETRY_LATER:
 	case RC_DDNS_INVALID_CHECKIP_RSP:
 	case RC_DDNS_RSP_TOO_FREQUENT:
-		ctx->update_period = ctx->error_update_period_sec;
-		logit(LOG_WARNING, "Will retry again in %d sec ...", ctx->update_period);
+		if (info) {
+			info->period = ctx->error_update_period_sec;
+			logit(LOG_WARNING, "Will retry %s again in %d sec ...",
+			      info->system->name, info->period);
+		}
 		break;
 
 	case RC_DDNS_RSP_NOTOK:
@@ -934,10 +1323,543 @@ static int check_error(ddns_t *ctx, int rc)
 	return 0;
 }
 
-int ddns_main_loop(ddns_t *ctx)
+/* Fatal error in a scheduler callback, leave main loop */
+static void schedule_stop(int rc)
+{
+	sched_rc = rc;
+	loop_break();
+}
+
+/*
+ * Check if all providers have run the number of iterations requested,
+ * the least number of completed iterations is saved in the context.
+ */
+static int iterations_done(ddns_t *ctx)
+{
+	ddns_info_t *info;
+	size_t id;
+	int num = -1;
+
+	CONF_INFO_FOREACH(info, id) {
+		if (num == -1 || info->num_iterations < num)
+			num = info->num_iterations;
+	}
+
+	if (num != -1)
+		ctx->num_iterations = num;
+
+	return ctx->total_iterations != 0 && ctx->num_iterations >= ctx->total_iterations;
+}
+
+/*
+ * Provider has completed a check, with or without updates.  Schedule
+ * its next check, or retire it when its iterations are done.
+ */
+static void provider_done(ddns_t *ctx, ddns_info_t *info, int rc)
+{
+	size_t i;
+
+	if (check_error(ctx, info, rc)) {
+		schedule_stop(rc);
+		return;
+	}
+
+	if (!rc && ctx->total_iterations != 0 &&
+	    ++info->num_iterations >= ctx->total_iterations) {
+		for (i = 0; i < info->alias_count; i++)
+			loop_timer_del(&info->alias[i].timer);
+
+		if (iterations_done(ctx))
+			loop_break();
+		return;
+	}
+
+	loop_timer_add(&info->timer, (long long)info->period * 1000);
+}
+
+static void job_free(job_t *job)
+{
+	if (job->ctx) {
+		buf_put(job->ctx->work);
+		buf_put(job->ctx->request);
+		free(job->ctx);
+	}
+	free(job);
+}
+
+static job_t *job_new(ddns_t *ctx, ddns_info_t *info, job_type_t type)
+{
+	job_t *job;
+
+	job = calloc(1, sizeof(*job));
+	if (!job)
+		return NULL;
+
+	job->type = type;
+	job->info = info;
+	TAILQ_INIT(&job->aliases);
+
+	job->ctx = malloc(sizeof(*ctx));
+	if (!job->ctx)
+		goto fail;
+
+	*job->ctx = *ctx;
+	job->ctx->work    = buf_get(BUF_DEFAULT_SIZE);
+	job->ctx->request = buf_get(ctx->request_buflen);
+	if (!job->ctx->work || !job->ctx->request)
+		goto fail;
+	job->ctx->request_buf = job->ctx->request->data;
+
+	return job;
+fail:
+	job_free(job);
+	return NULL;
+}
+
+/*
+ * Check address and update aliases that need it, unless a fake update
+ * was sent, then the actual update is deferred to a JOB_UPDATE.
+ */
+static int job_check(job_t *job)
+{
+	ddns_info_t *info = job->info;
+	ddns_t *ctx = job->ctx;
+	int changed;
+	size_t i;
+
+	if (job->force) {
+		for (i = 0; i < info->alias_count; i++)
+			info->alias[i].force_addr_update = 1;
+	}
+
+	/* Get IP address from any of the different backends */
+	if (get_address(ctx, info, &changed) ||
+	    (!changed && !job->force && exec_mode == EXEC_MODE_COMPAT))
+		return 0;
+
+	/* Step through aliases list, resolve them and check if they point to my IP */
+	check_alias_update_table(ctx, info);
+
+	if (ctx->forced_update_fake_addr && fake_update(ctx, info)) {
+		job->fake = 1;
+		return 0;
+	}
+
+	/* Update IPs marked as not identical with my IP */
+	return update_alias_table(ctx, info);
+}
+
+/* Forced update or retry of aliases whose timer has expired */
+static int job_alias(job_t *job)
 {
+	ddns_alias_t *alias;
 	int rc = 0;
+
+	TAILQ_FOREACH(alias, &job->aliases, link) {
+		int result;
+
+		/* No address yet, the provider check takes care of it */
+		if (!alias->address[0])
+			continue;
+
+		logit(LOG_NOTICE, "Update %s for alias %s, new IP# %s",
+		      alias->update_required ? "retry" : "forced", alias->name, alias->address);
+		alias->update_required = 1;
+
+		result = server_error(update_alias(job->ctx, job->info, alias));
+		if (result && !rc)
+			rc = result;
+	}
+
+	return rc;
+}
+
+/* Worker thread, must not touch the event loop or any scheduler state */
+static void job_work(void *arg)
+{
+	job_t *job = (job_t *)arg;
+
+	switch (job->type) {
+	case JOB_CHECK:
+		job->rc = job_check(job);
+		break;
+
+	case JOB_UPDATE:
+		job->rc = update_alias_table(job->ctx, job->info);
+		break;
+
+	case JOB_ALIAS:
+		job->rc = job_alias(job);
+		break;
+	}
+}
+
+static void provider_kick(ddns_t *ctx, ddns_info_t *info);
+
+/* Close expired idle connections, then wait for the next to expire */
+static void pool_expire(loop_timer_t *t, void *arg)
+{
+	long long msec;
+
+	msec = http_pool_expire();
+	if (msec >= 0)
+		loop_timer_add(t, msec);
+	else
+		loop_timer_del(t);
+}
+
+/*
+ * Main thread, job is done, or cancelled (@ran is zero) at exit.  Runs
+ * any scripts, schedules the next check and any alias retries, then
+ * starts the next job for the provider, if any work is pending.
+ */
+static void job_done(void *arg, int ran)
+{
+	job_t *job = (job_t *)arg;
+	ddns_info_t *info = job->info;
+	ddns_t *ctx = sched_ctx;
+	ddns_alias_t *alias;
+	size_t i;
+
+	info->busy = 0;
+	if (!ran) {
+		TAILQ_FOREACH(alias, &job->aliases, link)
+			alias->queued = 0;
+		goto done;
+	}
+
+	switch (job->type) {
+	case JOB_CHECK:
+	case JOB_UPDATE:
+		for (i = 0; i < info->alias_count; i++) {
+			alias = &info->alias[i];
+
+			/* Timer fired while job ran, but alias already updated */
+			if (alias->reschedule && alias->queued) {
+				TAILQ_REMOVE(&info->due, alias, link);
+				alias->queued = 0;
+			}
+			alias_done(ctx, alias);
+		}
+
+		/* Play nice with server, wait a bit before sending actual IP */
+		if (job->fake) {
+			loop_timer_add(&info->defer, DDNS_FAKE_ADDRESS_DELAY * 1000);
+			break;
+		}
+
+		provider_done(ctx, info, job->rc);
+		break;
+
+	case JOB_ALIAS:
+		TAILQ_FOREACH(alias, &job->aliases, link) {
+			alias->queued = 0;
+			alias_done(ctx, alias);
+		}
+
+		if (check_error(ctx, NULL, job->rc))
+			schedule_stop(job->rc);
+		break;
+	}
+
+	if (!loop_timer_pending(&commit_timer))
+		loop_timer_add(&commit_timer, DDNS_STATE_COMMIT_DELAY * 1000);
+	pool_expire(&pool_timer, NULL);
+
+	provider_kick(ctx, info);
+done:
+	job_free(job);
+}
+
+/*
+ * Start next job for provider, unless it is already busy.  Pending
+ * updates and checks go first, then forced updates and retries of
+ * any aliases that have become due in the meantime.
+ */
+static void provider_kick(ddns_t *ctx, ddns_info_t *info)
+{
+	job_type_t type;
+	job_t *job;
+	int rc;
+
+	if (sched_closing || info->busy)
+		return;
+
+	if (info->update_pending)
+		type = JOB_UPDATE;
+	else if (info->check_pending)
+		type = JOB_CHECK;
+	else if (!TAILQ_EMPTY(&info->due))
+		type = JOB_ALIAS;
+	else
+		return;
+
+	job = job_new(ctx, info, type);
+	if (!job) {
+		schedule_stop(RC_OUT_OF_MEMORY);
+		return;
+	}
+
+	switch (type) {
+	case JOB_UPDATE:
+		info->update_pending = 0;
+		break;
+
+	case JOB_CHECK:
+		info->check_pending = 0;
+		job->force = info->force_addr_update;
+		info->force_addr_update = 0;
+		break;
+
+	case JOB_ALIAS:
+		TAILQ_CONCAT(&job->aliases, &info->due, link);
+		break;
+	}
+
+	rc = pool_submit(job_work, job_done, job);
+	if (rc) {
+		job_done(job, 0);
+		schedule_stop(rc);
+		return;
+	}
+
+	info->busy = 1;
+}
+
+/* Deferred action, sends actual updates after any fake update */
+static void provider_update(loop_timer_t *t, void *arg)
+{
+	ddns_info_t *info = (ddns_info_t *)arg;
+
+	info->update_pending = 1;
+	provider_kick(sched_ctx, info);
+}
+
+/* Provider timer callback, check address and update aliases that need it */
+static void provider_check(loop_timer_t *t, void *arg)
+{
+	ddns_info_t *info = (ddns_info_t *)arg;
+
+	info->check_pending = 1;
+	provider_kick(sched_ctx, info);
+}
+
+/* Alias timer callback, time for forced update or retry */
+static void alias_check(loop_timer_t *t, void *arg)
+{
+	ddns_alias_t *alias = (ddns_alias_t *)arg;
+	ddns_info_t *info = alias->info;
+
+	if (alias->queued)
+		return;
+
+	alias->queued = 1;
+	TAILQ_INSERT_TAIL(&info->due, alias, link);
+	provider_kick(sched_ctx, info);
+}
+
+/*
+ * Mark all providers for forced update, e.g., on SIGUSR1.  Their next
+ * check job marks the aliases, a running job may still use them.
+ */
+static void force_update(ddns_t *ctx)
+{
+	ddns_info_t *info;
+	size_t id;
+
+	CONF_INFO_FOREACH(info, id)
+		info->force_addr_update = 1;
+}
+
+/* Check all providers now, except those deferred or done */
+static void check_now(ddns_t *ctx)
+{
+	ddns_info_t *info;
+	size_t id;
+
+	source_flush();
+
+	CONF_INFO_FOREACH(info, id) {
+		int done = ctx->total_iterations != 0 &&
+			info->num_iterations >= ctx->total_iterations;
+
+		if (!done && !loop_timer_pending(&info->defer) && !info->update_pending)
+			loop_timer_add(&info->timer, 0);
+	}
+}
+
+/*
+ * Address added to, or removed from, an interface.  Check providers
+ * using it after a short delay, to let a burst of changes settle.
+ */
+static void iface_change(const char *ifname, void *arg)
+{
+	ddns_t *ctx = (ddns_t *)arg;
+	ddns_info_t *info;
+	size_t id;
+
+	source_flush();
+
+	CONF_INFO_FOREACH(info, id) {
+		const char *name = get_iface(info);
+		int done = ctx->total_iterations != 0 &&
+			info->num_iterations >= ctx->total_iterations;
+
+		if (name && !strcmp(name, ifname) && !done &&
+		    !loop_timer_pending(&info->defer) && !info->update_pending)
+			loop_timer_add(&info->timer, DDNS_IFACE_CHANGE_DELAY * 1000);
+	}
+}
+
+/*
+ * Monitor interface addresses, instead of polling, if any provider
+ * reads its address from an interface.
+ */
+static void iface_monitor(ddns_t *ctx)
+{
+	ddns_info_t *info;
+	size_t id;
+	int num = 0;
+
+	CONF_INFO_FOREACH(info, id) {
+		if (get_iface(info))
+			num++;
+	}
+
+	if (!num || netlink_init())
+		return;
+
+	netlink_notify(iface_change, ctx);
+}
+
+static void state_save(loop_timer_t *t, void *arg)
+{
+	state_commit();
+}
+
+/*
+ * Start the scheduler, all providers check their address at once and
+ * aliases with a known last update get their forced update deadline.
+ */
+static void schedule_start(ddns_t *ctx)
+{
+	ddns_info_t *info;
+	size_t id;
+
+	sched_ctx     = ctx;
+	sched_rc      = 0;
+	sched_closing = 0;
+
+	loop_timer_init(&commit_timer, state_save, NULL);
+	loop_timer_init(&pool_timer, pool_expire, NULL);
+	iface_monitor(ctx);
+
+	CONF_INFO_FOREACH(info, id) {
+		size_t i;
+
+		for (i = 0; i < info->alias_count; i++) {
+			ddns_alias_t *alias = &info->alias[i];
+
+			if (alias->last_update)
+				schedule_alias(ctx, alias, 0);
+		}
+	}
+
+	check_now(ctx);
+}
+
+/*
+ * Stop the scheduler, waits for running jobs to complete.  Any queued
+ * jobs are cancelled, as are all timers.
+ */
+static void schedule_stop_all(ddns_t *ctx)
+{
 	ddns_info_t *info;
+	size_t id;
+
+	sched_closing = 1;
+	netlink_notify(NULL, NULL);
+	pool_exit();
+	source_free();
+
+	CONF_INFO_FOREACH(info, id) {
+		size_t i;
+
+		for (i = 0; i < info->alias_count; i++)
+			loop_timer_del(&info->alias[i].timer);
+		loop_timer_del(&info->timer);
+		loop_timer_del(&info->defer);
+		info->check_pending = 0;
+		info->update_pending = 0;
+	}
+	loop_timer_del(&commit_timer);
+	loop_timer_del(&pool_timer);
+	state_close();
+
+	sched_ctx = NULL;
+}
+
+static int init_context(ddns_t *ctx)
+{
+	ddns_info_t *info;
+	size_t id;
+	struct timeval tv;
+
+	if (!ctx)
+		return RC_INVALID_POINTER;
+
+	if (ctx->initialized == 1)
+		return 0;
+
+	/* Seed prng, used in silly IP randomizer */
+	gettimeofday(&tv, NULL);
+	srand((unsigned int)tv.tv_usec);
+
+	CONF_INFO_FOREACH(info, id) {
+		http_t *checkip = &info->checkip;
+		http_t *update  = &info->server;
+		size_t i;
+
+		if (strlen(info->proxy_name.name)) {
+			http_set_port(checkip, info->proxy_name.port);
+			http_set_port(update,  info->proxy_name.port);
+
+			http_set_remote_name(checkip, info->proxy_name.name);
+			http_set_remote_name(update,  info->proxy_name.name);
+		} else {
+			http_set_port(checkip, info->checkip_name.port);
+			http_set_port(update,  info->server_name.port);
+
+			http_set_remote_name(checkip, info->checkip_name.name);
+			http_set_remote_name(update,  info->server_name.name);
+		}
+
+		/* Scheduler, restore iterations if reset by SIGHUP */
+		loop_timer_init(&info->timer, provider_check, info);
+		loop_timer_init(&info->defer, provider_update, info);
+		info->period = ctx->normal_update_period_sec;
+		info->num_iterations = cached_num_iterations;
+		TAILQ_INIT(&info->due);
+
+		for (i = 0; i < info->alias_count; i++) {
+			ddns_alias_t *alias = &info->alias[i];
+
+			loop_timer_init(&alias->timer, alias_check, alias);
+			alias->info = info;
+		}
+	}
+
+	/* Restore values, if reset by SIGHUP.  Initialize time from cache file at startup. */
+	ctx->num_iterations = cached_num_iterations;
+
+	ctx->initialized = 1;
+
+	return 0;
+}
+
+int ddns_main_loop(ddns_t *ctx)
+{
+	int rc = 0;
 	static int first_startup = 1;
 
 	if (!ctx)
@@ -952,9 +1874,8 @@ int ddns_main_loop(ddns_t *ctx)
 		logit(LOG_NOTICE, "Startup delay: %d sec ...", startup_delay);
 		first_startup = 0;
 
-		/* Now sleep a while. Using the time set in update_period data member */
-		ctx->update_period = startup_delay;
-		wait_for_cmd(ctx);
+		/* Now sleep a while, or until we get a command */
+		DO(wait_for_cmd(ctx, startup_delay));
 
 		if (ctx->cmd == CMD_STOP) {
 			logit(LOG_NOTICE, "STOP command received, exiting.");
@@ -966,15 +1887,7 @@ int ddns_main_loop(ddns_t *ctx)
 		}
 		if (ctx->cmd == CMD_FORCED_UPDATE) {
 			logit(LOG_INFO, "FORCED_UPDATE command received, updating now.");
-			info = conf_info_iterator(1);
-			while (info) {
-				size_t i;
-				for (i = 0; i < info->alias_count; i++) {
-					ddns_alias_t *alias = &info->alias[i];
-					alias->force_addr_update = 1;
-				}
-				info = conf_info_iterator(0);
-			}
+			force_update(ctx);
 			ctx->cmd = NO_CMD;
 		} else if (ctx->cmd == CMD_CHECK_NOW) {
 			logit(LOG_INFO, "CHECK_NOW command received, leaving startup delay.");
@@ -985,45 +1898,27 @@ int ddns_main_loop(ddns_t *ctx)
 	DO(init_context(ctx));
 	DO(read_cache_file(ctx));
 	DO(get_encoded_user_passwd());
+	DO(compile_templates());
 
-	if (once && force) {
-			info = conf_info_iterator(1);
-			while (info) {
-				size_t i;
+	if (once && force)
+		force_update(ctx);
 
-				for (i = 0; i < info->alias_count; i++) {
-					ddns_alias_t *alias = &info->alias[i];
-					alias->force_addr_update = 1;
-				}
-				info = conf_info_iterator(0);
-			}
-	}
 	/* Initialization done, create pidfile to indicate we are ready to communicate */
 	if (once == 0 && pidfile_name[0] && pidfile(pidfile_name))
 		logit(LOG_WARNING, "Failed creating pidfile: %s", strerror(errno));
 
-	/* DDNS client main loop */
-	while (1) {
-		rc = check_address(ctx);
-		if (RC_OK == rc) {
-			if (ctx->total_iterations != 0 &&
-			    ++ctx->num_iterations >= ctx->total_iterations)
-				break;
-		}
-
-		if (ctx->cmd == CMD_RESTART) {
-			logit(LOG_INFO, "RESTART command received. Restarting.");
-			ctx->cmd = NO_CMD;
-			rc = RC_RESTART;
+	/* DDNS client main loop, all work is done from scheduler callbacks */
+	DO(pool_init(ctx->concurrency));
+	schedule_start(ctx);
+	while (!iterations_done(ctx)) {
+		rc = wait_for_cmd(ctx, LOOP_FOREVER);
+		if (rc)
 			break;
-		}
 
-		/* On error, check why, possibly need to retry sooner ... */
-		if (check_error(ctx, rc))
+		if (sched_rc) {
+			rc = sched_rc;
 			break;
-
-		/* Now sleep a while. Using the time set in update_period data member */
-		wait_for_cmd(ctx);
+		}
 
 		if (ctx->cmd == CMD_STOP) {
 			logit(LOG_NOTICE, "STOP command received, exiting.");
@@ -1037,27 +1932,15 @@ int ddns_main_loop(ddns_t *ctx)
 		}
 		if (ctx->cmd == CMD_FORCED_UPDATE) {
 			logit(LOG_INFO, "FORCED_UPDATE command received, updating now.");
-
-			info = conf_info_iterator(1);
-			while (info) {
-				size_t i;
-
-				for (i = 0; i < info->alias_count; i++) {
-					ddns_alias_t *alias = &info->alias[i];
-					alias->force_addr_update = 1;
-				}
-				info = conf_info_iterator(0);
-			}
-			ctx->cmd = NO_CMD;
-			continue;
-		}
-
-		if (ctx->cmd == CMD_CHECK_NOW) {
+			force_update(ctx);
+			check_now(ctx);
+		} else if (ctx->cmd == CMD_CHECK_NOW) {
 			logit(LOG_INFO, "CHECK_NOW command received, checking ...");
-			ctx->cmd = NO_CMD;
-			continue;
+			check_now(ctx);
 		}
+		ctx->cmd = NO_CMD;
 	}
+	schedule_stop_all(ctx);
 
 	/* Save old value, if restarted by SIGHUP */
 	cached_num_iterations = ctx->num_iterations;
@@ -0,0 +1,486 @@
+/* In-process DNS resolver cache, with record TTL and static pinning
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <limits.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <netinet/in.h>
+#include <resolv.h>
+
+#include "dns.h"
+#include "log.h"
+#include "loop.h"
+#include "queue.h"
+
+#ifndef _PATH_HOSTS
+#define _PATH_HOSTS "/etc/hosts"
+#endif
+
+struct entry {
+	LIST_ENTRY(entry) link;
+	char             *host;
+	int               family;	/* Requested family, AF_UNSPEC for pins */
+	int               pinned;
+	long long         expires;	/* loop_now() msec */
+
+	struct sockaddr_storage pref;	/* Last connected, tried first */
+	socklen_t         pref_len;
+
+	size_t            num;
+	struct sockaddr_storage addr[DNS_MAX_ADDRS];
+	socklen_t         len[DNS_MAX_ADDRS];
+};
+
+struct node {
+	struct addrinfo         ai;
+	struct sockaddr_storage ss;
+};
+
+/* Shared by all worker threads */
+static LIST_HEAD(, entry) cache = LIST_HEAD_INITIALIZER(cache);
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct entry *find(const char *host, int family, int pinned)
+{
+	struct entry *entry;
+
+	LIST_FOREACH(entry, &cache, link) {
+		if (entry->pinned != pinned || strcasecmp(entry->host, host))
+			continue;
+		if (pinned || entry->family == family)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static struct entry *add(const char *host, int family, int pinned)
+{
+	struct entry *entry;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return NULL;
+
+	entry->host = strdup(host);
+	if (!entry->host) {
+		free(entry);
+		return NULL;
+	}
+	entry->family = family;
+	entry->pinned = pinned;
+	LIST_INSERT_HEAD(&cache, entry, link);
+
+	return entry;
+}
+
+static struct addrinfo *node(struct sockaddr_storage *ss, socklen_t len, int port)
+{
+	struct node *node;
+
+	node = calloc(1, sizeof(*node));
+	if (!node)
+		return NULL;
+
+	memcpy(&node->ss, ss, len);
+	if (ss->ss_family == AF_INET)
+		((struct sockaddr_in *)&node->ss)->sin_port = htons(port);
+	else
+		((struct sockaddr_in6 *)&node->ss)->sin6_port = htons(port);
+
+	node->ai.ai_family   = ss->ss_family;
+	node->ai.ai_socktype = SOCK_STREAM;
+	node->ai.ai_addr     = (struct sockaddr *)&node->ss;
+	node->ai.ai_addrlen  = len;
+
+	return &node->ai;
+}
+
+/*
+ * Copy addresses of @family in @entry to a list the caller owns, the
+ * address we last connected to goes first.
+ */
+static int copy(struct entry *entry, int family, int port, struct addrinfo **result)
+{
+	struct addrinfo *head = NULL, **tail = &head, *ai;
+	size_t i;
+
+	for (i = 0; i < entry->num; i++) {
+		if (family != AF_UNSPEC && family != entry->addr[i].ss_family)
+			continue;
+
+		ai = node(&entry->addr[i], entry->len[i], port);
+		if (!ai) {
+			dns_free(head);
+			return EAI_MEMORY;
+		}
+
+		if (entry->pref_len == entry->len[i] &&
+		    !memcmp(&entry->pref, &entry->addr[i], entry->len[i])) {
+			ai->ai_next = head;
+			if (!head)
+				tail = &ai->ai_next;
+			head = ai;
+			continue;
+		}
+
+		*tail = ai;
+		tail  = &ai->ai_next;
+	}
+
+	if (!head)
+		return EAI_NONAME;
+
+	*result = head;
+
+	return 0;
+}
+
+#ifdef HAVE_NS_INITPARSE
+/* Lowest TTL of the answers to a query for @type records, or -1 */
+static long query_ttl(const char *host, int type)
+{
+	unsigned char buf[4096];
+	ns_msg msg;
+	ns_rr rr;
+	long ttl = -1;
+	int len, i;
+
+	len = res_query(host, ns_c_in, type, buf, sizeof(buf));
+	if (len < 0 || ns_initparse(buf, len, &msg))
+		return -1;
+
+	for (i = 0; i < ns_msg_count(msg, ns_s_an); i++) {
+		if (ns_parserr(&msg, ns_s_an, i, &rr))
+			break;
+		if (ns_rr_type(rr) != type)
+			continue;
+		if (ttl < 0 || (long)ns_rr_ttl(rr) < ttl)
+			ttl = ns_rr_ttl(rr);
+	}
+
+	return ttl;
+}
+#endif
+
+/*
+ * The system resolver does not report record TTLs, so when possible we
+ * ask for them separately.  Defaults to a short TTL when the records
+ * cannot be found.
+ */
+static long get_ttl(const char *host, int family)
+{
+	long ttl = -1;
+
+#ifdef HAVE_NS_INITPARSE
+	long ttl6 = -1;
+
+	if (family != AF_INET6)
+		ttl = query_ttl(host, ns_t_a);
+	if (family != AF_INET)
+		ttl6 = query_ttl(host, ns_t_aaaa);
+	if (ttl6 >= 0 && (ttl < 0 || ttl6 < ttl))
+		ttl = ttl6;
+#else
+	(void)host;
+	(void)family;
+#endif
+
+	if (ttl < 0)
+		ttl = DNS_DEFAULT_TTL;
+	if (ttl > DNS_MAX_TTL)
+		ttl = DNS_MAX_TTL;
+
+	return ttl;
+}
+
+/* Name listed in the hosts file, resolved without asking DNS */
+static int in_hosts(const char *host)
+{
+	char line[512], *tok, *ptr;
+	int found = 0;
+	FILE *fp;
+
+	fp = fopen(_PATH_HOSTS, "r");
+	if (!fp)
+		return 0;
+
+	while (!found && fgets(line, sizeof(line), fp)) {
+		tok = strchr(line, '#');
+		if (tok)
+			*tok = 0;
+
+		/* Skip address, then canonical name and aliases */
+		tok = strtok_r(line, " \t\r\n", &ptr);
+		while (tok && (tok = strtok_r(NULL, " \t\r\n", &ptr))) {
+			if (!strcasecmp(tok, host)) {
+				found = 1;
+				break;
+			}
+		}
+	}
+	fclose(fp);
+
+	return found;
+}
+
+/*
+ * Resolve @host without holding the lock, result in @entry.  Numeric
+ * addresses never expire, and names in the hosts file get the default
+ * TTL, neither should cost a DNS query, e.g., when the WAN is down.
+ */
+static int lookup(const char *host, int family, struct entry *entry)
+{
+	struct addrinfo hints, *servinfo, *ai;
+	int numeric = 1;
+	int rc;
+
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family   = family;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags    = AI_NUMERICHOST;
+	rc = getaddrinfo(host, NULL, &hints, &servinfo);
+	if (rc) {
+		numeric = 0;
+
+		/* Reload resolv.conf, may have changed since last lookup */
+		res_init();
+
+		hints.ai_flags = 0;
+		rc = getaddrinfo(host, NULL, &hints, &servinfo);
+		if (rc)
+			return rc;
+	}
+
+	entry->num = 0;
+	for (ai = servinfo; ai && entry->num < DNS_MAX_ADDRS; ai = ai->ai_next) {
+		if (ai->ai_addrlen > sizeof(entry->addr[0]))
+			continue;
+
+		memcpy(&entry->addr[entry->num], ai->ai_addr, ai->ai_addrlen);
+		entry->len[entry->num++] = ai->ai_addrlen;
+	}
+	freeaddrinfo(servinfo);
+
+	if (!entry->num)
+		return EAI_NONAME;
+
+	if (numeric)
+		entry->expires = LLONG_MAX;
+	else if (in_hosts(host))
+		entry->expires = loop_now() + DNS_DEFAULT_TTL * 1000;
+	else
+		entry->expires = loop_now() + get_ttl(host, family) * 1000;
+
+	return 0;
+}
+
+/**
+ * dns_resolve - Resolve hostname, using cached result if still valid
+ * @host:   Hostname, or numeric address
+ * @port:   Port number to set in the resulting addresses
+ * @family: %AF_INET, %AF_INET6, or %AF_UNSPEC
+ * @result: Resulting list of addresses, free with dns_free()
+ *
+ * Pinned addresses from the configuration file are always used as-is.
+ * Other results are reused until their TTL expires.  If a new lookup
+ * fails, the last known good addresses are used instead.  Safe to call
+ * from worker threads.
+ *
+ * Returns:
+ * POSIX OK(0), or getaddrinfo() error code, see gai_strerror().
+ */
+int dns_resolve(const char *host, int port, int family, struct addrinfo **result)
+{
+	struct entry *entry, tmp;
+	int rc;
+
+	pthread_mutex_lock(&lock);
+	entry = find(host, AF_UNSPEC, 1);
+	if (entry) {
+		rc = copy(entry, family, port, result);
+		pthread_mutex_unlock(&lock);
+		return rc;
+	}
+
+	entry = find(host, family, 0);
+	if (entry && entry->expires > loop_now()) {
+		logit(LOG_DEBUG, "Using cached address(es) for %s", host);
+		rc = copy(entry, family, port, result);
+		pthread_mutex_unlock(&lock);
+		return rc;
+	}
+	pthread_mutex_unlock(&lock);
+
+	memset(&tmp, 0, sizeof(tmp));
+	rc = lookup(host, family, &tmp);
+
+	/* Another thread may have added, or flushed, the entry meanwhile */
+	pthread_mutex_lock(&lock);
+	entry = find(host, family, 0);
+	if (rc) {
+		if (entry) {
+			logit(LOG_WARNING, "Failed resolving hostname %s: %s, using last known address(es)",
+			      host, gai_strerror(rc));
+			rc = copy(entry, family, port, result);
+		}
+		pthread_mutex_unlock(&lock);
+		return rc;
+	}
+
+	if (!entry)
+		entry = add(host, family, 0);
+	if (entry) {
+		entry->num     = tmp.num;
+		entry->expires = tmp.expires;
+		memcpy(entry->addr, tmp.addr, sizeof(tmp.addr));
+		memcpy(entry->len, tmp.len, sizeof(tmp.len));
+		rc = copy(entry, family, port, result);
+	} else
+		rc = copy(&tmp, family, port, result);
+	pthread_mutex_unlock(&lock);
+
+	return rc;
+}
+
+void dns_free(struct addrinfo *result)
+{
+	struct addrinfo *next;
+
+	while (result) {
+		next = result->ai_next;
+		free(result);		/* First member of struct node */
+		result = next;
+	}
+}
+
+/**
+ * dns_pin - Pin hostname to a static address
+ * @host:    Hostname
+ * @address: Numeric IPv4 or IPv6 address
+ *
+ * A hostname can be pinned to several addresses, e.g., one of each
+ * address family.  Pinned hostnames are never looked up.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero if @address is invalid or too many.
+ */
+int dns_pin(const char *host, const char *address)
+{
+	struct sockaddr_storage ss;
+	struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+	struct entry *entry;
+	socklen_t len;
+	int rc = 1;
+
+	memset(&ss, 0, sizeof(ss));
+	if (inet_pton(AF_INET, address, &sin->sin_addr) == 1) {
+		sin->sin_family = AF_INET;
+		len = sizeof(*sin);
+	} else if (inet_pton(AF_INET6, address, &sin6->sin6_addr) == 1) {
+		sin6->sin6_family = AF_INET6;
+		len = sizeof(*sin6);
+	} else
+		return 1;
+
+	pthread_mutex_lock(&lock);
+	entry = find(host, AF_UNSPEC, 1);
+	if (!entry)
+		entry = add(host, AF_UNSPEC, 1);
+	if (entry && entry->num < DNS_MAX_ADDRS) {
+		memcpy(&entry->addr[entry->num], &ss, len);
+		entry->len[entry->num++] = len;
+		rc = 0;
+	}
+	pthread_mutex_unlock(&lock);
+
+	return rc;
+}
+
+/**
+ * dns_prefer - Remember address a connection to @host succeeded with
+ * @host: Hostname
+ * @sa:   Address of connected socket
+ *
+ * The address is returned first by later dns_resolve() calls, for as
+ * long as it remains in the DNS response.
+ */
+void dns_prefer(const char *host, const struct sockaddr *sa)
+{
+	struct sockaddr_storage ss;
+	struct entry *entry;
+	socklen_t len;
+
+	memset(&ss, 0, sizeof(ss));
+	if (sa->sa_family == AF_INET) {
+		len = sizeof(struct sockaddr_in);
+		memcpy(&ss, sa, len);
+		((struct sockaddr_in *)&ss)->sin_port = 0;
+	} else if (sa->sa_family == AF_INET6) {
+		len = sizeof(struct sockaddr_in6);
+		memcpy(&ss, sa, len);
+		((struct sockaddr_in6 *)&ss)->sin6_port = 0;
+	} else
+		return;
+
+	pthread_mutex_lock(&lock);
+	LIST_FOREACH(entry, &cache, link) {
+		if (strcasecmp(entry->host, host))
+			continue;
+
+		memcpy(&entry->pref, &ss, sizeof(ss));
+		entry->pref_len = len;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * dns_flush - Drop all cached and pinned addresses
+ */
+void dns_flush(void)
+{
+	struct entry *entry;
+
+	pthread_mutex_lock(&lock);
+	while ((entry = LIST_FIRST(&cache))) {
+		LIST_REMOVE(entry, link);
+		free(entry->host);
+		free(entry);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -67,11 +67,13 @@ static const ERROR_NAME global_error_table[] = {
 	{ RC_DDNS_RSP_RETRY_LATER,        E("DDNS server busy, try later"      )},
 	{ RC_DDNS_RSP_AUTH_FAIL,          E("Authentication failure"           )},
 	{ RC_DDNS_RSP_TOO_FREQUENT,       E("DDNS warning, your update interval is set too low.")},
+	{ RC_DDNS_RSP_UNCHANGED,          E("DNS record already up-to-date"    )},
 
 	{ RC_OS_FORK_FAILURE,             E("Failed forking off child"         )},
 	{ RC_OS_CHANGE_PERSONA_FAILURE,   E("Failed dropping privileges"       )},
 	{ RC_OS_INVALID_UID,              E("Invalid or unknown UID"           )},
 	{ RC_OS_INVALID_GID,              E("Invalid or unknown GID"           )},
+	{ RC_OS_EVENT_LOOP_FAILED,        E("Failed setting up event loop"     )},
 
 	{ RC_FILE_IO_ACCESS_ERROR,        E("Failed create/modify file/dir"    )},
 	{ RC_FILE_IO_MISSING_FILE,        E("Missing .conf file"               )},
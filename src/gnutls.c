@@ -19,15 +19,32 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <pthread.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <gnutls/x509.h>
 
 #include "log.h"
+#include "loop.h"
 #include "http.h"
+#include "session.h"
 #include "ssl.h"
 
+/*
+ * Credentials and CA store, shared by all sessions.  Rebuilt when
+ * ca-trust-file changes, sessions already opened keep a reference to
+ * the previous one, it is freed when the last of them is closed.
+ */
+struct tls_conf {
+	int                              refcnt;
+	char                            *ca_file;
+	gnutls_certificate_credentials_t xcred;
+};
+
 extern char *prognm;
-static gnutls_certificate_credentials_t xcred;
+static struct tls_conf  *shared;
+static gnutls_priority_t priority;
+static pthread_mutex_t   conf_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 /* This function will verify the peer's certificate, and check
@@ -118,7 +135,7 @@ error:
 	return 0;
 }
 
-static int ssl_set_ca_location(void)
+static int ssl_load_ca_location(gnutls_certificate_credentials_t xcred)
 {
 	int num = 0;
 
@@ -143,8 +160,100 @@ done:
 	return 0;
 }
 
+static void conf_free(struct tls_conf *conf)
+{
+	if (conf->xcred)
+		gnutls_certificate_free_credentials(conf->xcred);
+	free(conf->ca_file);
+	free(conf);
+}
+
+static struct tls_conf *conf_new(void)
+{
+	struct tls_conf *conf;
+
+	conf = calloc(1, sizeof(*conf));
+	if (!conf)
+		return NULL;
+
+	if (ca_trust_file) {
+		conf->ca_file = strdup(ca_trust_file);
+		if (!conf->ca_file)
+			goto fail;
+	}
+
+	if (gnutls_certificate_allocate_credentials(&conf->xcred)) {
+		conf->xcred = NULL;
+		goto fail;
+	}
+	gnutls_certificate_set_verify_function(conf->xcred, verify_certificate_callback);
+
+	/* Try to figure out location of trusted CA certs on system */
+	if (ssl_load_ca_location(conf->xcred)) {
+		conf_free(conf);
+		return NULL;
+	}
+
+	return conf;
+fail:
+	logit(LOG_ERR, "Failed allocating HTTPS credentials");
+	conf_free(conf);
+	return NULL;
+}
+
+static int same_file(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return !strcmp(a, b);
+}
+
+/*
+ * Take a reference to the shared credentials, loading them on first use
+ * or if ca-trust-file has changed since, e.g., on SIGHUP.  Sessions may
+ * be opened from several worker threads at once.
+ */
+static struct tls_conf *conf_get(void)
+{
+	struct tls_conf *conf;
+
+	pthread_mutex_lock(&conf_lock);
+	if (!shared || !same_file(shared->ca_file, ca_trust_file)) {
+		conf = conf_new();
+		if (!conf)
+			goto done;
+
+		if (shared && --shared->refcnt == 0)
+			conf_free(shared);
+		shared = conf;
+		shared->refcnt = 1;
+	}
+
+	conf = shared;
+	conf->refcnt++;
+done:
+	pthread_mutex_unlock(&conf_lock);
+
+	return conf;
+}
+
+static void conf_put(struct tls_conf *conf)
+{
+	if (!conf)
+		return;
+
+	pthread_mutex_lock(&conf_lock);
+	if (--conf->refcnt == 0)
+		conf_free(conf);
+	pthread_mutex_unlock(&conf_lock);
+}
+
 int ssl_init(void)
 {
+	const char *err;
+	int ret;
+
 	if (!gnutls_check_version("3.1.4")) {
 		logit(LOG_ERR, "%s requires GnuTLS 3.1.4 or later for SSL", prognm);
 		exit(1);
@@ -153,9 +262,14 @@ int ssl_init(void)
 	/* for backwards compatibility with gnutls < 3.3.0 */
 	gnutls_global_init();
 
-	/* X509 stuff */
-	gnutls_certificate_allocate_credentials(&xcred);
-	gnutls_certificate_set_verify_function(xcred, verify_certificate_callback);
+	/* Use default priorities, parsed once for all sessions */
+	ret = gnutls_priority_init(&priority, "NORMAL", &err);
+	if (ret < 0) {
+		if (ret == GNUTLS_E_INVALID_REQUEST)
+			logit(LOG_ERR, "Syntax error at: %s", err);
+		logit(LOG_ERR, "Failed initializing HTTPS: %s", gnutls_strerror(ret));
+		return RC_HTTPS_INVALID_REQUEST;
+	}
 
 	return 0;
 }
@@ -163,7 +277,14 @@ int ssl_init(void)
 
 void ssl_exit(void)
 {
-	gnutls_certificate_free_credentials(xcred);
+	pthread_mutex_lock(&conf_lock);
+	if (shared && --shared->refcnt == 0)
+		conf_free(shared);
+	shared = NULL;
+	pthread_mutex_unlock(&conf_lock);
+
+	session_flush();
+	gnutls_priority_deinit(priority);
 	gnutls_global_deinit();
 }
 
@@ -196,17 +317,18 @@ int ssl_open(http_t *client, char *msg, int force)
 	const gnutls_datum_t *cert_list;
 	unsigned int cert_list_size = 0;
 	gnutls_x509_crt_t cert;
-	const char *sn, *err;
+	const char *sn;
 	char buf[256];
 	int port = 0;
+	void *data;
 	size_t len;
-	int ret;
+	int ret, rc;
 
 	if (!client->ssl_enabled)
 		return tcp_init(&client->tcp, msg, force);
 
-	/* Try to figure out location of trusted CA certs on system */
-	if (ssl_set_ca_location())
+	client->tls = conf_get();
+	if (!client->tls)
 		return RC_HTTPS_NO_TRUSTED_CA_STORE;
 
 	/* Initialize TLS session */
@@ -214,6 +336,9 @@ int ssl_open(http_t *client, char *msg, int force)
 	ret = gnutls_init(&client->ssl, GNUTLS_CLIENT);
 	if (ret) {
 		logit(LOG_ERR, "Failed initializing HTTPS: %s", gnutls_strerror(ret));
+		client->ssl = NULL;
+		conf_put(client->tls);
+		client->tls = NULL;
 		return RC_HTTPS_OUT_OF_MEMORY;
 	}
 
@@ -223,23 +348,25 @@ int ssl_open(http_t *client, char *msg, int force)
 	if (gnutls_server_name_set(client->ssl, GNUTLS_NAME_DNS, sn, strlen(sn)))
 		return ssl_fail(client, RC_HTTPS_SNI_ERROR);
 
-	/* Use default priorities */
-	ret = gnutls_priority_set_direct(client->ssl, "NORMAL", &err);
-	if (ret < 0) {
-		if (ret == GNUTLS_E_INVALID_REQUEST)
-			logit(LOG_ERR, "Syntax error at: %s", err);
-
+	if (gnutls_priority_set(client->ssl, priority))
 		return ssl_fail(client, RC_HTTPS_INVALID_REQUEST);
-	}
 
 	/* put the x509 credentials to the current session */
-	gnutls_credentials_set(client->ssl, GNUTLS_CRD_CERTIFICATE, xcred);
+	gnutls_credentials_set(client->ssl, GNUTLS_CRD_CERTIFICATE, client->tls->xcred);
 
 	/* connect to the peer */
 	http_get_port(client, &port);
 	if (!port)
 		http_set_port(client, HTTPS_DEFAULT_PORT);
-	DO(tcp_init(&client->tcp, msg, force));
+	rc = tcp_init(&client->tcp, msg, force);
+	if (rc)
+		return ssl_fail(client, rc);
+
+	/* Resume last session with this server, if any */
+	if (!session_get(sn, client->tcp.port, &data, &len)) {
+		gnutls_session_set_data(client->ssl, data, len);
+		free(data);
+	}
 
 	/* Forward TCP socket to GnuTLS, the set_int() API is perhaps too new still ... since 3.1.9 */
 //	gnutls_transport_set_int(client->ssl, client->tcp.socket);
@@ -258,6 +385,8 @@ int ssl_open(http_t *client, char *msg, int force)
 
 	client->connected = 1;
 	ssl_get_info(client);
+	if (gnutls_session_is_resumed(client->ssl))
+		logit(LOG_DEBUG, "Resumed TLS session with %s", sn);
 
 	/* Get server's certificate (note: beware of dynamic allocation) - opt */
 	cert_list = gnutls_certificate_get_peers(client->ssl, &cert_list_size);
@@ -281,12 +410,36 @@ int ssl_open(http_t *client, char *msg, int force)
 	return 0;
 }
 
+/*
+ * With TLS 1.3 the ticket arrives after the handshake, so the session
+ * is saved when closing, after the last response has been read.
+ */
+static void ssl_save_session(http_t *client)
+{
+	gnutls_datum_t data;
+	const char *sn;
+
+	if (gnutls_session_get_data2(client->ssl, &data))
+		return;
+
+	http_get_remote_name(client, &sn);
+	session_put(sn, client->tcp.port, data.data, data.size);
+	gnutls_free(data.data);
+}
+
 int ssl_close(http_t *client)
 {
 	if (client->ssl_enabled) {
-		if (client->connected)
-			gnutls_bye(client->ssl, GNUTLS_SHUT_WR);
-		gnutls_deinit(client->ssl);
+		if (client->ssl) {
+			if (client->connected) {
+				ssl_save_session(client);
+				gnutls_bye(client->ssl, GNUTLS_SHUT_WR);
+			}
+			gnutls_deinit(client->ssl);
+			client->ssl = NULL;
+		}
+		conf_put(client->tls);
+		client->tls = NULL;
 	}
 	client->connected = 0;
 
@@ -314,19 +467,53 @@ int ssl_send(http_t *client, const char *buf, int len)
 	return 0;
 }
 
+/* Corked records are held back and sent together when uncorked */
+int ssl_sendv(http_t *client, const struct iovec *iov, int iovcnt)
+{
+	int i, ret = 0;
+
+	if (!client->ssl_enabled)
+		return tcp_sendv(&client->tcp, iov, iovcnt);
+
+	gnutls_record_cork(client->ssl);
+	for (i = 0; i < iovcnt && ret >= 0; i++) {
+		do {
+			ret = gnutls_record_send(client->ssl, iov[i].iov_base, iov[i].iov_len);
+		} while (ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN);
+	}
+
+	if (ret >= 0) {
+		do {
+			ret = gnutls_record_uncork(client->ssl, GNUTLS_RECORD_WAIT);
+		} while (ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN);
+	}
+
+	if (ret < 0) {
+		logit(LOG_WARNING, "Failed sending HTTPS request: %s", gnutls_strerror(ret));
+		return RC_HTTPS_SEND_ERROR;
+	}
+
+	logit(LOG_DEBUG, "Successfully sent HTTPS request!");
+
+	return 0;
+}
+
 int ssl_recv(http_t *client, char *buf, int buf_len, int *recv_len)
 {
-	int ret, len = 0;
+	long long deadline;
+	int ret;
 
 	if (!client->ssl_enabled)
 		return tcp_recv(&client->tcp, buf, buf_len, recv_len);
 
+	/*
+	 * Non-data records, e.g., TLS 1.3 session tickets, also return
+	 * GNUTLS_E_AGAIN, as does the socket receive timeout.
+	 */
+	deadline = loop_now() + client->tcp.timeout;
 	do {
-		ret = gnutls_record_recv(client->ssl, buf + len, buf_len - len);
-		if (ret > 0) {
-			len += ret;
-		}
-	} while (ret > 0 || ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN);
+		ret = gnutls_record_recv(client->ssl, buf, buf_len);
+	} while ((ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN) && loop_now() < deadline);
 
 	/*
 	 * We may get GNUTLS_E_PREMATURE_TERMINATION here.  It happens
@@ -335,14 +522,15 @@ int ssl_recv(http_t *client, char *buf, int buf_len, int *recv_len)
 	 * TLS handling.  OpenSSL seems to ignore this so we do too.
 	 *                       -- André Colomb
 	 */
-	if (ret < 0 && ret != GNUTLS_E_PREMATURE_TERMINATION) {
+	if (ret == GNUTLS_E_PREMATURE_TERMINATION)
+		ret = 0;
+
+	if (ret < 0) {
 		logit(LOG_WARNING, "Failed receiving HTTPS response: %s", gnutls_strerror(ret));
 		return RC_HTTPS_RECV_ERROR;
 	}
 
-	*recv_len = len;
-
-	logit(LOG_DEBUG, "Successfully received HTTPS response (%d/%d bytes)!", *recv_len, buf_len);
+	*recv_len = ret;
 
 	return 0;
 }
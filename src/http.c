@@ -20,11 +20,32 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "ssl.h"
 #include "http.h"
 #include "error.h"
+#include "log.h"
+#include "loop.h"
+#include "queue.h"
+
+/* Idle persistent connection, kept for reuse by later transactions */
+struct conn {
+	TAILQ_ENTRY(conn) link;
+	char             *host;
+	int               port;
+	int               ssl;
+	long long         expires;	/* loop_now() msec */
+	http_t            client;
+};
+
+/* Shared by all worker threads */
+static TAILQ_HEAD(, conn) idle = TAILQ_HEAD_INITIALIZER(idle);
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
 
 int http_construct(http_t *client)
 {
@@ -59,12 +80,206 @@ static int local_set_params(http_t *client)
 	return 0;
 }
 
+static void conn_close(struct conn *conn)
+{
+	http_t *client = &conn->client;
+
+	ssl_close(client);
+	free(conn->host);
+	free(conn);
+}
+
+/* Server has closed an idle connection, or sent something unexpected */
+static int conn_stale(struct conn *conn)
+{
+	struct pollfd pfd = { conn->client.tcp.socket, POLLIN, 0 };
+
+	return poll(&pfd, 1, 0) != 0;
+}
+
+/* Take idle connection to same server, dropping expired ones on the way */
+static struct conn *pool_get(http_t *client)
+{
+	struct conn *conn, *tmp, *found = NULL;
+	TAILQ_HEAD(, conn) expired = TAILQ_HEAD_INITIALIZER(expired);
+	long long now = loop_now();
+
+	pthread_mutex_lock(&pool_lock);
+	TAILQ_FOREACH_SAFE(conn, &idle, link, tmp) {
+		if (conn->expires <= now || conn_stale(conn)) {
+			TAILQ_REMOVE(&idle, conn, link);
+			TAILQ_INSERT_TAIL(&expired, conn, link);
+			continue;
+		}
+
+		if (found || conn->port != client->tcp.port || conn->ssl != client->ssl_enabled ||
+		    strcasecmp(conn->host, client->tcp.remote_host))
+			continue;
+
+		TAILQ_REMOVE(&idle, conn, link);
+		found = conn;
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	while ((conn = TAILQ_FIRST(&expired))) {
+		TAILQ_REMOVE(&expired, conn, link);
+		logit(LOG_DEBUG, "Closing idle connection to %s:%d", conn->host, conn->port);
+		conn_close(conn);
+	}
+
+	return found;
+}
+
+/*
+ * Park connection in the pool, if the last response allows reuse.  The
+ * client keeps its settings, but is no longer connected.
+ */
+static int pool_put(http_t *client)
+{
+	struct conn *conn;
+
+	if (!client->keepalive || !client->persistent || keepalive_timeout <= 0 ||
+	    !client->tcp.remote_host)
+		return 1;
+#ifdef CONFIG_MBEDTLS
+	/* The TLS context refers to its own address, cannot be moved */
+	if (client->ssl_enabled)
+		return 1;
+#endif
+
+	conn = calloc(1, sizeof(*conn));
+	if (!conn)
+		return 1;
+
+	conn->host = strdup(client->tcp.remote_host);
+	if (!conn->host) {
+		free(conn);
+		return 1;
+	}
+	conn->port    = client->tcp.port;
+	conn->ssl     = client->ssl_enabled;
+	conn->expires = loop_now() + keepalive_timeout * 1000LL;
+	memcpy(&conn->client, client, sizeof(*client));
+	conn->client.tcp.remote_host = conn->host;
+
+	pthread_mutex_lock(&pool_lock);
+	TAILQ_INSERT_HEAD(&idle, conn, link);
+	pthread_mutex_unlock(&pool_lock);
+
+	logit(LOG_DEBUG, "Keeping connection to %s:%d open for reuse", conn->host, conn->port);
+
+	/* Connection now owned by pool */
+	client->tcp.socket      = -1;
+	client->tcp.initialized = 0;
+	client->connected       = 0;
+#if defined(ENABLE_SSL)
+#if defined(CONFIG_OPENSSL)
+	client->ssl             = NULL;
+#elif defined(CONFIG_GNUTLS)
+	client->ssl             = NULL;
+	client->tls             = NULL;
+#endif
+#endif
+
+	return 0;
+}
+
+/* Move idle connection to @client, returns non-zero if none available */
+static int pool_reuse(http_t *client)
+{
+	tcp_sock_t tcp = client->tcp;
+	int keepalive = client->keepalive;
+	int force = client->force;
+	char *msg = client->msg;
+	struct conn *conn;
+
+	if (!client->keepalive || keepalive_timeout <= 0 || !client->tcp.remote_host)
+		return 1;
+
+	conn = pool_get(client);
+	if (!conn)
+		return 1;
+
+	memcpy(client, &conn->client, sizeof(*client));
+	client->tcp.remote_host = tcp.remote_host;
+	client->tcp.timeout     = tcp.timeout;
+	client->keepalive       = keepalive;
+	client->force           = force;
+	client->msg             = msg;
+	client->reused          = 1;
+	free(conn->host);
+	free(conn);
+
+	logit(LOG_DEBUG, "Reusing connection to %s:%d", client->tcp.remote_host, client->tcp.port);
+
+	return 0;
+}
+
+/**
+ * http_pool_expire - Close idle persistent connections that have expired
+ *
+ * Also closes connections the server has closed, so they do not linger
+ * in CLOSE_WAIT until the next transaction.
+ *
+ * Returns:
+ * Time in msec until the next idle connection expires, or -1 if none.
+ */
+long long http_pool_expire(void)
+{
+	struct conn *conn, *tmp;
+	TAILQ_HEAD(, conn) expired = TAILQ_HEAD_INITIALIZER(expired);
+	long long now = loop_now(), next = -1;
+
+	pthread_mutex_lock(&pool_lock);
+	TAILQ_FOREACH_SAFE(conn, &idle, link, tmp) {
+		if (conn->expires <= now || conn_stale(conn)) {
+			TAILQ_REMOVE(&idle, conn, link);
+			TAILQ_INSERT_TAIL(&expired, conn, link);
+			continue;
+		}
+
+		if (next < 0 || conn->expires - now < next)
+			next = conn->expires - now;
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	while ((conn = TAILQ_FIRST(&expired))) {
+		TAILQ_REMOVE(&expired, conn, link);
+		logit(LOG_DEBUG, "Closing idle connection to %s:%d", conn->host, conn->port);
+		conn_close(conn);
+	}
+
+	return next;
+}
+
+/**
+ * http_pool_flush - Close all idle persistent connections
+ */
+void http_pool_flush(void)
+{
+	struct conn *conn;
+
+	pthread_mutex_lock(&pool_lock);
+	while ((conn = TAILQ_FIRST(&idle))) {
+		TAILQ_REMOVE(&idle, conn, link);
+		conn_close(conn);
+	}
+	pthread_mutex_unlock(&pool_lock);
+}
+
 int http_init(http_t *client, char *msg, int force)
 {
 	int rc = 0;
 
+	client->msg        = msg;
+	client->force      = force;
+	client->reused     = 0;
+	client->persistent = 0;
+
 	do {
 		TRY(local_set_params(client));
+		if (!pool_reuse(client))
+			break;
 		TRY(ssl_open(client, msg, force));
 	}
 	while (0);
@@ -87,51 +302,368 @@ int http_exit(http_t *client)
 		return 0;
 
 	client->initialized = 0;
+	if (!pool_put(client))
+		return 0;
+
 	return ssl_close(client);
 }
 
-static void http_response_parse(http_trans_t *trans)
+/* Response parser states */
+enum {
+	HTTP_STATUS,		/* Status line */
+	HTTP_HEADER,		/* Header lines, until empty line */
+	HTTP_BODY,		/* Content-Length, or until close */
+	HTTP_CHUNK_SIZE,	/* Chunk size line */
+	HTTP_CHUNK_DATA,
+	HTTP_CHUNK_END,		/* CRLF after chunk data */
+	HTTP_TRAILER,		/* Trailer lines, until empty line */
+	HTTP_DONE
+};
+
+/*
+ * Incremental HTTP/1.x response parser, fed the bytes of the response
+ * as they are received.  Only lines are copied out of the buffer, the
+ * body stays in place.  Chunked bodies are decoded in place, as chunks
+ * arrive, with any unparsed bytes moved down after the decoded data.
+ */
+struct http_parser {
+	int   state;
+	int   pos;		/* Next byte to parse */
+	int   body;		/* Start of body */
+	int   etag;		/* Start of ETag value */
+	int   out;		/* End of body, decoded */
+	long  left;		/* Bytes left of body or chunk, -1 until close */
+	int   chunked;
+	int   persistent;
+};
+
+static int match(const char *line, int len, const char *name, const char **val)
 {
-	char *body;
-	char *rsp = trans->rsp_body = trans->rsp;
-	int status = trans->status = 0;
-	const char sep[] = "\r\n\r\n";
+	int nlen = strlen(name);
 
-	memset(trans->status_desc, 0, sizeof(trans->status_desc));
+	if (len <= nlen || line[nlen] != ':' || strncasecmp(line, name, nlen))
+		return 0;
+
+	line += nlen + 1;
+	while (*line == ' ' || *line == '\t')
+		line++;
+	*val = line;
+
+	return 1;
+}
+
+static void http_parse_status(struct http_parser *p, http_trans_t *trans, const char *line, int len)
+{
+	int num = 0;
 
-	if (rsp != NULL && (body = strstr(rsp, sep)) != NULL) {
-		body += strlen(sep);
-		trans->rsp_body = body;
+	/* HTTP/1.x SSS Reason phrase */
+	if (len < 12 || strncmp(line, "HTTP/1.", 7) || line[8] != ' ')
+		return;
+
+	trans->status = strtol(&line[9], NULL, 10);
+	p->persistent = line[7] == '1';
+
+	if (len > 13) {
+		num = len - 13;
+		if (num > (int)sizeof(trans->status_desc) - 1)
+			num = sizeof(trans->status_desc) - 1;
+		memcpy(trans->status_desc, &line[13], num);
 	}
+	trans->status_desc[num] = 0;
+}
 
-	/*
-	 * %*c         : HTTP/1.0, 1.1 etc, discard read value
-	 * %4d         : HTTP status code, e.g. 200
-	 * %255[^\r\n] : HTTP status text, e.g. OK -- Reads max 255 bytes, including \0, not \r or \n
-	 */
-	if (sscanf(trans->rsp, "HTTP/1.%*c %4d %255[^\r\n]", &status, trans->status_desc) == 2)
-		trans->status = status;
+static void http_parse_header(struct http_parser *p, http_trans_t *trans, char *buf, const char *line, int len)
+{
+	const char *val;
+	int num;
+
+	if (match(line, len, "Transfer-Encoding", &val)) {
+		if (memmem(val, len - (val - line), "chunked", 7))
+			p->chunked = 1;
+	} else if (match(line, len, "Content-Length", &val)) {
+		trans->content_length = strtol(val, NULL, 10);
+	} else if (match(line, len, "Connection", &val)) {
+		if (!strncasecmp(val, "close", 5))
+			p->persistent = 0;
+	} else if (match(line, len, "Retry-After", &val)) {
+		if (*val >= '0' && *val <= '9')
+			trans->retry_after = strtol(val, NULL, 10);
+	} else if (match(line, len, "ETag", &val)) {
+		num = len - (val - line);
+		while (num > 0 && (val[num - 1] == ' ' || val[num - 1] == '\t'))
+			num--;
+		p->etag         = val - buf;
+		trans->etag_len = num;
+	}
+}
+
+/* End of headers, figure out how the body is delimited */
+static void http_parse_body(struct http_parser *p, http_trans_t *trans)
+{
+	int status = trans->status;
+
+	p->body = p->out = p->pos;
+
+	/* Interim response, the real one follows */
+	if (status >= 100 && status < 200) {
+		p->state = HTTP_STATUS;
+		return;
+	}
+
+	if (status == 204 || status == 304) {
+		p->state = HTTP_DONE;
+	} else if (p->chunked) {
+		p->state = HTTP_CHUNK_SIZE;
+	} else if (trans->content_length >= 0) {
+		p->left  = trans->content_length;
+		p->state = p->left ? HTTP_BODY : HTTP_DONE;
+	} else {
+		/* Delimited by server closing the connection */
+		p->left       = -1;
+		p->persistent = 0;
+		p->state      = HTTP_BODY;
+	}
+}
+
+/*
+ * Parse the received bytes not yet parsed, up to @len, which shrinks
+ * when chunked encoding is decoded.  Returns non-zero when the response
+ * is complete.
+ */
+static int http_parse(struct http_parser *p, http_trans_t *trans, char *buf, int *len)
+{
+	while (p->state != HTTP_DONE && p->pos < *len) {
+		char *line = &buf[p->pos], *eol = NULL;
+		int avail = *len - p->pos;
+		int num = 0;
+
+		/* All but body and chunk data are lines */
+		if (p->state != HTTP_BODY && p->state != HTTP_CHUNK_DATA) {
+			eol = memchr(line, '\n', avail);
+			if (!eol)
+				break;
+
+			p->pos = eol - buf + 1;
+			num = eol - line;
+			if (num > 0 && line[num - 1] == '\r')
+				num--;
+		}
+
+		switch (p->state) {
+		case HTTP_STATUS:
+			http_parse_status(p, trans, line, num);
+			p->state = HTTP_HEADER;
+			break;
+
+		case HTTP_HEADER:
+			if (num)
+				http_parse_header(p, trans, buf, line, num);
+			else
+				http_parse_body(p, trans);
+			break;
+
+		case HTTP_BODY:
+			if (p->left >= 0 && avail > p->left)
+				avail = p->left;
+			p->pos += avail;
+			p->out  = p->pos;
+			if (p->left >= 0) {
+				p->left -= avail;
+				if (!p->left)
+					p->state = HTTP_DONE;
+			}
+			break;
+
+		case HTTP_CHUNK_SIZE:
+			p->left = strtol(line, NULL, 16);
+			if (p->left < 0) {
+				p->persistent = 0;
+				return 1;
+			}
+			p->state = p->left ? HTTP_CHUNK_DATA : HTTP_TRAILER;
+			break;
+
+		case HTTP_CHUNK_DATA:
+			if (avail > p->left)
+				avail = p->left;
+			memmove(&buf[p->out], line, avail);
+			p->out  += avail;
+			p->pos  += avail;
+			p->left -= avail;
+			if (!p->left)
+				p->state = HTTP_CHUNK_END;
+			break;
+
+		case HTTP_CHUNK_END:
+			p->state = HTTP_CHUNK_SIZE;
+			break;
+
+		case HTTP_TRAILER:
+			if (!num)
+				p->state = HTTP_DONE;
+			break;
+		}
+	}
+
+	/* Reclaim the chunk framing, keep any unparsed bytes */
+	if (p->chunked && p->state > HTTP_BODY && p->pos > p->out) {
+		memmove(&buf[p->out], &buf[p->pos], *len - p->pos);
+		*len  -= p->pos - p->out;
+		p->pos = p->out;
+	}
+
+	return p->state == HTTP_DONE;
+}
+
+static void http_response_init(http_trans_t *trans)
+{
+	trans->rsp_len        = 0;
+	trans->rsp_body       = trans->rsp;
+	trans->rsp_body_len   = 0;
+	trans->status         = 0;
+	trans->status_desc[0] = 0;
+	trans->content_length = -1;
+	trans->retry_after    = -1;
+	trans->etag           = NULL;
+	trans->etag_len       = 0;
+}
+
+/* Double the response buffer, if it has one, the parser uses offsets */
+static int http_grow(http_trans_t *trans)
+{
+	if (!trans->buf || buf_grow(trans->buf, trans->buf->size * 2))
+		return 1;
+
+	trans->rsp         = trans->buf->data;
+	trans->rsp_body    = trans->rsp;
+	trans->max_rsp_len = trans->buf->size - 1;
+
+	return 0;
+}
+
+/*
+ * Read response, parsing it as it arrives, until it is complete.  The
+ * response is delimited by Content-Length, chunked encoding, or the
+ * server closing the connection.  A complete HTTP/1.1 response, not
+ * followed by Connection: close, allows the connection to be reused.
+ * Sets @closed if the server closed the connection before responding.
+ */
+static int http_recv(http_t *client, http_trans_t *trans, int *closed)
+{
+	struct http_parser p = { .state = HTTP_STATUS };
+	int len = 0, num, done = 0, rc;
+	char *buf;
+
+	http_response_init(trans);
+	*closed = 0;
+
+	while (len < trans->max_rsp_len || !http_grow(trans)) {
+		buf = trans->rsp;
+		errno = 0;
+		rc = ssl_recv(client, buf + len, trans->max_rsp_len - len, &num);
+		if (rc) {
+			/* Reset by peer before responding, not a timeout */
+			if (!len && (errno == ECONNRESET || errno == EPIPE))
+				*closed = 1;
+			return rc;
+		}
+		if (!num)
+			break;
+
+		len += num;
+		if (http_parse(&p, trans, buf, &len)) {
+			done = 1;
+			break;
+		}
+	}
+
+	if (!len) {
+		*closed = 1;
+		return RC_TCP_RECV_ERROR;
+	}
+
+	/* Body delimited by close is complete when the server closes */
+	if (!done && p.state == HTTP_BODY && p.left < 0 && len < trans->max_rsp_len)
+		done = 1;
+	if (!done && len >= trans->max_rsp_len)
+		logit(LOG_WARNING, "HTTP response from %s truncated at %d bytes, see max-response-size",
+		      client->tcp.remote_host, len);
+
+	/* Anything after the response means the stream is out of sync */
+	if (done && len > p.pos)
+		p.persistent = 0;
+
+	if (p.state >= HTTP_BODY)
+		len = p.out;
+
+	buf = trans->rsp;
+	trans->rsp_len      = len;
+	trans->rsp_body     = &buf[p.body];
+	trans->rsp_body_len = len - p.body;
+	if (trans->etag_len)
+		trans->etag = &buf[p.etag];
+	client->persistent  = done && p.persistent;
+
+	logit(LOG_DEBUG, "Received HTTP%s response (%d/%d bytes)%s", client->ssl_enabled ? "S" : "",
+	      len, trans->max_rsp_len, client->persistent ? ", connection kept open" : "");
+	if (trans->retry_after >= 0)
+		logit(LOG_DEBUG, "Server asks to retry after %d sec", trans->retry_after);
+
+	return 0;
+}
+
+static int http_send(http_t *client, http_trans_t *trans)
+{
+	if (trans->iov)
+		return ssl_sendv(client, trans->iov, trans->iovcnt);
+
+	return ssl_send(client, trans->req, trans->req_len);
 }
 
 int http_transaction(http_t *client, http_trans_t *trans)
 {
-	int rc = 0;
+	int rc, closed = 0;
 
 	ASSERT(client);
 	ASSERT(trans);
 
+	if (trans->buf) {
+		trans->rsp         = trans->buf->data;
+		trans->max_rsp_len = trans->buf->size - 1;
+	}
+
+	http_response_init(trans);
+	trans->rsp[0] = 0;
 	if (!client->initialized)
 		return RC_HTTP_OBJECT_NOT_INITIALIZED;
 
-	trans->rsp_len = 0;
-	do {
-		TRY(ssl_send(client, trans->req, trans->req_len));
-		TRY(ssl_recv(client, trans->rsp, trans->max_rsp_len, &trans->rsp_len));
+	client->persistent = 0;
+	rc = http_send(client, trans);
+	if (rc)
+		closed = 1;
+	else
+		rc = http_recv(client, trans, &closed);
+
+	/*
+	 * Server may have closed the idle connection just as we sent.  The
+	 * request may not be idempotent, so it is only sent again if it
+	 * could not be sent, or if the server closed the connection before
+	 * sending any of the response.  Never after a receive timeout.
+	 */
+	if (rc && client->reused && closed) {
+		logit(LOG_DEBUG, "Reused connection to %s closed, reconnecting", client->tcp.remote_host);
+		ssl_close(client);
+		client->reused = 0;
+
+		rc = ssl_open(client, client->msg, client->force);
+		if (!rc) {
+			rc = http_send(client, trans);
+			if (!rc)
+				rc = http_recv(client, trans, &closed);
+		}
 	}
-	while (0);
 
 	trans->rsp[trans->rsp_len] = 0;
-	http_response_parse(trans);
 
 	return rc;
 }
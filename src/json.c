@@ -1,6 +1,7 @@
 /* JSON helpers
  *
  * Copyright (C) 2019-2020 Simon Pilkington
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License
@@ -19,40 +20,304 @@
  * Boston, MA  02110-1301, USA.
  */
 
+/*
+ * Responses are parsed once, into a token buffer on the caller's stack,
+ * continuing in a larger buffer on the heap only for big documents.
+ * Values are then found with path queries, e.g. "result[0].id", which
+ * walk the tokens once from the root, skipping subtrees not on the path.
+ */
+
+#include <stdlib.h>
 #include <string.h>
 
 #include "log.h"
 #include "json.h"
 
-int parse_json(const char *json, jsmntok_t *out_tokens[])
+/**
+ * json_parse - Parse JSON document
+ * @doc: Document to set up, release with json_free()
+ * @js:  JSON text, must outlive @doc
+ * @buf: Token buffer, usually on the caller's stack
+ * @max: Number of tokens in @buf
+ *
+ * Returns:
+ * Number of tokens, or -1 if @js is not a JSON document.
+ */
+int json_parse(json_t *doc, const char *js, jsmntok_t *buf, int max)
 {
-	int num_tokens;
-
 	jsmn_parser parser;
+	size_t len = strlen(js);
+	int num;
+
+	memset(doc, 0, sizeof(*doc));
+	doc->js  = js;
+	doc->tok = buf;
+
 	jsmn_init(&parser);
-	num_tokens = jsmn_parse(&parser, json, strlen(json), NULL, 0);
+	while ((num = jsmn_parse(&parser, js, len, doc->tok, max)) == JSMN_ERROR_NOMEM) {
+		jsmntok_t *tok;
+
+		/* jsmn continues where it stopped, with the larger buffer */
+		tok = realloc(doc->heap, 2 * max * sizeof(jsmntok_t));
+		if (!tok) {
+			logit(LOG_ERR, "Couldn't allocate memory to parse JSON.");
+			json_free(doc);
+			return -1;
+		}
+		if (!doc->heap)
+			memcpy(tok, buf, max * sizeof(jsmntok_t));
+
+		doc->heap = doc->tok = tok;
+		max *= 2;
+	}
 
-	if (num_tokens < 0) {
+	if (num < 0) {
 		logit(LOG_ERR, "Failed to parse JSON.");
+		json_free(doc);
 		return -1;
 	}
 
-	if (num_tokens == 0) {
+	if (num == 0) {
 		logit(LOG_WARNING, "No JSON found in string.");
+		json_free(doc);
 		return -1;
 	}
 
-	*out_tokens = malloc(num_tokens * sizeof(jsmntok_t));
+	doc->num = num;
+
+	return num;
+}
+
+void json_free(json_t *doc)
+{
+	free(doc->heap);
+	doc->heap = NULL;
+	doc->tok  = NULL;
+	doc->num  = 0;
+}
+
+/**
+ * json_compile - Compile path query
+ * @path: Compiled path
+ * @expr: Path expression, e.g. "success", "result[0].id", "records[*].value"
+ *
+ * An empty @expr is the value queried from.  Keys in @path point into
+ * @expr, which must outlive @path.
+ *
+ * Returns:
+ * Zero, or -1 if @expr is not a valid path.
+ */
+int json_compile(json_path_t *path, const char *expr)
+{
+	const char *p = expr;
+
+	path->num = 0;
+	while (*p) {
+		int i = path->num;
+
+		if (i >= JSON_MAX_PATH)
+			return -1;
+
+		if (*p == '[') {
+			char *end;
+			long index;
+
+			path->step[i].key = NULL;
+			path->step[i].len = 0;
+			if (!strncmp(p, "[*]", 3)) {
+				path->step[i].index = JSON_ANY;
+				p += 3;
+			} else {
+				index = strtol(p + 1, &end, 10);
+				if (end == p + 1 || *end != ']' || index < 0 || index > 65535)
+					return -1;
+
+				path->step[i].index = (int)index;
+				p = end + 1;
+			}
+		} else {
+			size_t len = strcspn(p, ".[");
+
+			if (!len)
+				return -1;
+
+			path->step[i].key   = p;
+			path->step[i].len   = len;
+			path->step[i].index = 0;
+			p += len;
+		}
+		path->num++;
+
+		if (*p == '.') {
+			p++;
+			if (!*p || *p == '.' || *p == '[')
+				return -1;
+		} else if (*p && *p != '[') {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * json_next - Skip value
+ * @doc: Parsed document
+ * @i:   Token index of value
+ *
+ * Use to iterate over array elements, starting with the token after
+ * the array, or over object members, from key to key.
+ *
+ * Returns:
+ * Index of the token after the value at @i and all its children.
+ */
+int json_next(const json_t *doc, int i)
+{
+	int end = doc->tok[i].end;
+
+	for (i++; i < doc->num && doc->tok[i].start < end; i++)
+		;
+
+	return i;
+}
+
+static int keyeq(const json_t *doc, int i, const char *key, size_t len)
+{
+	const jsmntok_t *tok = &doc->tok[i];
+
+	return tok->type == JSMN_STRING && (size_t)(tok->end - tok->start) == len &&
+		!strncmp(doc->js + tok->start, key, len);
+}
+
+static int walk(const json_t *doc, int i, const json_path_t *path, int step, int match[], int max, int num)
+{
+	const jsmntok_t *tok = &doc->tok[i];
+	int j, k;
+
+	if (step == path->num) {
+		match[num++] = i;
+		return num;
+	}
+
+	if (path->step[step].key) {
+		if (tok->type != JSMN_OBJECT)
+			return num;
+
+		for (j = i + 1, k = 0; k < tok->size && j + 1 < doc->num; k++) {
+			if (keyeq(doc, j, path->step[step].key, path->step[step].len))
+				return walk(doc, j + 1, path, step + 1, match, max, num);
+
+			j = json_next(doc, j + 1);
+		}
+
+		return num;
+	}
+
+	if (tok->type != JSMN_ARRAY)
+		return num;
+
+	for (j = i + 1, k = 0; k < tok->size && j < doc->num && num < max; k++) {
+		if (path->step[step].index == JSON_ANY)
+			num = walk(doc, j, path, step + 1, match, max, num);
+		else if (path->step[step].index == k)
+			return walk(doc, j, path, step + 1, match, max, num);
+
+		j = json_next(doc, j);
+	}
+
+	return num;
+}
+
+/**
+ * json_find - Find all values matching a compiled path
+ * @doc:   Parsed document
+ * @from:  Token to query from, 0 for the document root
+ * @path:  Compiled path
+ * @match: Token index of each match, in document order
+ * @max:   Size of @match
+ *
+ * Returns:
+ * Number of matches, at most @max.
+ */
+int json_find(const json_t *doc, int from, const json_path_t *path, int match[], int max)
+{
+	if (from < 0 || from >= doc->num || max < 1)
+		return 0;
+
+	return walk(doc, from, path, 0, match, max, 0);
+}
 
-	if (!(*out_tokens)) {
-		logit(LOG_ERR, "Couldn't allocate memory to parse JSON.");
+/* Token index of first value matching @expr, or -1 */
+int json_query(const json_t *doc, int from, const char *expr)
+{
+	json_path_t path;
+	int match;
+
+	if (json_compile(&path, expr)) {
+		logit(LOG_ERR, "Invalid JSON path '%s'", expr);
 		return -1;
 	}
 
-	jsmn_init(&parser);
-	jsmn_parse(&parser, json, strlen(json), *out_tokens, num_tokens);
+	if (json_find(doc, from, &path, &match, 1) != 1)
+		return -1;
 
-	return num_tokens;
+	return match;
+}
+
+/**
+ * json_copy - Copy string or primitive value
+ * @doc: Parsed document
+ * @tok: Token index of value
+ * @buf: Buffer for value
+ * @len: Size of @buf
+ *
+ * Returns:
+ * Zero, -1 if @tok is not a string or primitive, -2 if it did not fit.
+ */
+int json_copy(const json_t *doc, int tok, char *buf, size_t len)
+{
+	const jsmntok_t *t;
+	size_t vlen;
+
+	if (tok < 0 || tok >= doc->num)
+		return -1;
+
+	t = &doc->tok[tok];
+	if (t->type != JSMN_STRING && t->type != JSMN_PRIMITIVE)
+		return -1;
+
+	vlen = t->end - t->start;
+	if (vlen >= len)
+		return -2;
+
+	memcpy(buf, doc->js + t->start, vlen);
+	buf[vlen] = 0;
+
+	return 0;
+}
+
+/* Copy first value matching @expr, see json_copy() */
+int json_get(const json_t *doc, int from, const char *expr, char *buf, size_t len)
+{
+	return json_copy(doc, json_query(doc, from, expr), buf, len);
+}
+
+/* True if the first value matching @expr is @value, e.g. "true" or "ok" */
+int json_is(const json_t *doc, int from, const char *expr, const char *value)
+{
+	const jsmntok_t *t;
+	int i;
+
+	i = json_query(doc, from, expr);
+	if (i < 0)
+		return 0;
+
+	t = &doc->tok[i];
+	if (t->type != JSMN_STRING && t->type != JSMN_PRIMITIVE)
+		return 0;
+
+	return (size_t)(t->end - t->start) == strlen(value) &&
+		!strncmp(doc->js + t->start, value, t->end - t->start);
 }
 
 int jsoneq(const char *json, const jsmntok_t *tok, const char *s)
@@ -74,3 +339,10 @@ int json_bool(const char *json, const jsmntok_t *token, int *out_value)
 
 	return -1;
 }
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -69,6 +69,12 @@ int log_level(char *arg)
 	return 0;
 }
 
+/* Check before composing expensive debug messages */
+int log_enabled(int prio)
+{
+	return prio <= level;
+}
+
 void vlogit(int prio, const char *fmt, va_list args)
 {
 	if (enabled && level != INTERNAL_NOPRI)
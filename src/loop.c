@@ -0,0 +1,527 @@
+/* Main event loop, a small reactor for signals and sockets
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#include "compat.h"
+#include "error.h"
+#include "log.h"
+#include "loop.h"
+
+struct io {
+	int           fd;
+	loop_io_fn_t  cb;
+	void         *arg;
+};
+
+struct sig {
+	loop_sig_fn_t cb;
+	void         *arg;
+};
+
+static struct io  iotab[LOOP_MAX_FDS];
+static struct sig sigtab[NSIG];
+static int        sigpipe[2] = { -1, -1 };
+static int        epfd = -1;
+static int        running;
+
+/* Timer min-heap, 1-based so that index zero means not queued */
+static loop_timer_t **heap;
+static size_t         heap_len;
+static size_t         heap_max;
+
+/*
+ * Async signal handler, the only thing done here is to queue the
+ * signal number on the self-pipe.  Callbacks are called from the
+ * loop, in normal context, where it is safe to log etc.
+ */
+static void sig_handler(int signo)
+{
+	unsigned char c = (unsigned char)signo;
+	int saved = errno;
+	ssize_t rc;
+
+	/* If the pipe is full the loop already has a wakeup pending */
+	rc = write(sigpipe[1], &c, 1);
+	(void)rc;
+
+	errno = saved;
+}
+
+static void sig_dispatch(int fd, void *arg)
+{
+	unsigned char buf[16];
+	ssize_t len, i;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < len; i++) {
+			struct sig *s = &sigtab[buf[i]];
+
+			if (s->cb)
+				s->cb(buf[i], s->arg);
+		}
+	}
+}
+
+static int set_nonblock(int fd)
+{
+	int flags;
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK))
+		return -1;
+
+	return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+/* Monotonic time in milliseconds, safe to call from any thread */
+long long loop_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void heap_swap(size_t a, size_t b)
+{
+	loop_timer_t *t = heap[a];
+
+	heap[a] = heap[b];
+	heap[b] = t;
+	heap[a]->index = a;
+	heap[b]->index = b;
+}
+
+static void heap_up(size_t i)
+{
+	while (i > 1 && heap[i]->deadline < heap[i / 2]->deadline) {
+		heap_swap(i, i / 2);
+		i /= 2;
+	}
+}
+
+static void heap_down(size_t i)
+{
+	while (2 * i <= heap_len) {
+		size_t child = 2 * i;
+
+		if (child < heap_len && heap[child + 1]->deadline < heap[child]->deadline)
+			child++;
+		if (heap[i]->deadline <= heap[child]->deadline)
+			break;
+
+		heap_swap(i, child);
+		i = child;
+	}
+}
+
+/* Run all expired timers, returns msec until next deadline, or -1 */
+static long long timer_run(void)
+{
+	while (running && heap_len > 0) {
+		loop_timer_t *t = heap[1];
+		long long left;
+
+		left = t->deadline - loop_now();
+		if (left > 0)
+			return left;
+
+		/* Dequeue before callback, it may re-arm the timer */
+		loop_timer_del(t);
+		t->cb(t, t->arg);
+	}
+
+	return heap_len > 0 ? 0 : -1;
+}
+
+static struct io *io_find(int fd)
+{
+	size_t i;
+
+	for (i = 0; i < NELEMS(iotab); i++) {
+		if (iotab[i].cb && iotab[i].fd == fd)
+			return &iotab[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Wait for, and dispatch, events on registered descriptors.  A negative
+ * @msec means wait forever.  Returns the number of events handled.
+ */
+static int io_wait(int msec)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	struct epoll_event ev[LOOP_MAX_FDS];
+	int i, num;
+
+	num = epoll_wait(epfd, ev, NELEMS(ev), msec);
+	if (num < 0)
+		return errno == EINTR ? 0 : -1;
+
+	for (i = 0; i < num; i++) {
+		struct io *io = ev[i].data.ptr;
+
+		/* May have been removed by a previous callback */
+		if (io->cb)
+			io->cb(io->fd, io->arg);
+	}
+
+	return num;
+#else
+	struct pollfd pfd[LOOP_MAX_FDS];
+	struct io *map[LOOP_MAX_FDS];
+	size_t i, n = 0;
+	int num;
+
+	for (i = 0; i < NELEMS(iotab); i++) {
+		if (!iotab[i].cb)
+			continue;
+
+		pfd[n].fd      = iotab[i].fd;
+		pfd[n].events  = POLLIN;
+		pfd[n].revents = 0;
+		map[n++]       = &iotab[i];
+	}
+
+	num = poll(pfd, n, msec);
+	if (num < 0)
+		return errno == EINTR ? 0 : -1;
+
+	for (i = 0; i < n; i++) {
+		if (!pfd[i].revents)
+			continue;
+
+		if (map[i]->cb && map[i]->fd == pfd[i].fd)
+			map[i]->cb(map[i]->fd, map[i]->arg);
+	}
+
+	return num;
+#endif
+}
+
+/**
+ * loop_init - Set up the main event loop
+ *
+ * Creates the self-pipe used to deliver signals, and the epoll
+ * descriptor on systems that have it.  Safe to call more than once.
+ *
+ * Returns:
+ * %RC_OK, or %RC_OS_EVENT_LOOP_FAILED.
+ */
+int loop_init(void)
+{
+	if (sigpipe[0] != -1)
+		return 0;
+
+	if (pipe(sigpipe))
+		goto fail;
+	if (set_nonblock(sigpipe[0]) || set_nonblock(sigpipe[1]))
+		goto fail;
+
+#ifdef HAVE_SYS_EPOLL_H
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0)
+		goto fail;
+#endif
+
+	if (loop_add(sigpipe[0], sig_dispatch, NULL))
+		goto fail;
+
+	return 0;
+fail:
+	logit(LOG_ERR, "Failed setting up event loop: %s", strerror(errno));
+	loop_exit();
+
+	return RC_OS_EVENT_LOOP_FAILED;
+}
+
+void loop_exit(void)
+{
+	size_t i;
+
+	for (i = 0; i < NELEMS(sigtab); i++) {
+		if (sigtab[i].cb)
+			signal(i, SIG_DFL);
+	}
+	memset(sigtab, 0, sizeof(sigtab));
+	memset(iotab, 0, sizeof(iotab));
+
+	while (heap_len > 0)
+		loop_timer_del(heap[1]);
+	free(heap);
+	heap = NULL;
+	heap_max = 0;
+
+	if (epfd != -1)
+		close(epfd);
+	if (sigpipe[0] != -1)
+		close(sigpipe[0]);
+	if (sigpipe[1] != -1)
+		close(sigpipe[1]);
+
+	epfd = sigpipe[0] = sigpipe[1] = -1;
+}
+
+/**
+ * loop_add - Register callback for a readable descriptor
+ * @fd:  Descriptor to watch, should be non-blocking
+ * @cb:  Callback to run when @fd is readable
+ * @arg: Optional argument to @cb
+ *
+ * Returns:
+ * %RC_OK, %RC_BUFFER_OVERFLOW if the table is full, or
+ * %RC_OS_EVENT_LOOP_FAILED.
+ */
+int loop_add(int fd, loop_io_fn_t cb, void *arg)
+{
+	struct io *io;
+	size_t i;
+
+	if (fd < 0 || !cb)
+		return RC_INVALID_POINTER;
+
+	io = io_find(fd);
+	if (!io) {
+		for (i = 0; i < NELEMS(iotab); i++) {
+			if (!iotab[i].cb) {
+				io = &iotab[i];
+				break;
+			}
+		}
+		if (!io)
+			return RC_BUFFER_OVERFLOW;
+
+#ifdef HAVE_SYS_EPOLL_H
+		{
+			struct epoll_event ev;
+
+			memset(&ev, 0, sizeof(ev));
+			ev.events   = EPOLLIN;
+			ev.data.ptr = io;
+			if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev))
+				return RC_OS_EVENT_LOOP_FAILED;
+		}
+#endif
+	}
+
+	io->fd  = fd;
+	io->cb  = cb;
+	io->arg = arg;
+
+	return 0;
+}
+
+int loop_del(int fd)
+{
+	struct io *io;
+
+	io = io_find(fd);
+	if (!io)
+		return 0;
+
+#ifdef HAVE_SYS_EPOLL_H
+	epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+	memset(io, 0, sizeof(*io));
+
+	return 0;
+}
+
+/**
+ * loop_signal - Register callback for a signal
+ * @signo: Signal to catch
+ * @cb:    Callback, called from loop_run(), not in signal context
+ * @arg:   Optional argument to @cb
+ *
+ * Calling this again for the same signal replaces the callback.
+ *
+ * Returns:
+ * %RC_OK, or %RC_OS_INSTALL_SIGHANDLER_FAILED.
+ */
+int loop_signal(int signo, loop_sig_fn_t cb, void *arg)
+{
+	struct sigaction sa;
+
+	if (signo <= 0 || signo >= NSIG || !cb)
+		return RC_INVALID_POINTER;
+
+	sigtab[signo].cb  = cb;
+	sigtab[signo].arg = arg;
+
+	memset(&sa, 0, sizeof(sa));
+#ifdef SA_RESTART
+	sa.sa_flags |= SA_RESTART;
+#endif
+	sa.sa_handler = sig_handler;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(signo, &sa, NULL))
+		return RC_OS_INSTALL_SIGHANDLER_FAILED;
+
+	return 0;
+}
+
+void loop_timer_init(loop_timer_t *t, loop_timer_fn_t cb, void *arg)
+{
+	memset(t, 0, sizeof(*t));
+	t->cb  = cb;
+	t->arg = arg;
+}
+
+/**
+ * loop_timer_add - Arm, or re-arm, a timer
+ * @t:    Timer, set up with loop_timer_init()
+ * @msec: Time from now until the callback runs
+ *
+ * Returns:
+ * %RC_OK, or %RC_OUT_OF_MEMORY.
+ */
+int loop_timer_add(loop_timer_t *t, long long msec)
+{
+	if (!t || !t->cb)
+		return RC_INVALID_POINTER;
+
+	if (msec < 0)
+		msec = 0;
+	t->deadline = loop_now() + msec;
+
+	if (t->index) {
+		heap_up(t->index);
+		heap_down(t->index);
+		return 0;
+	}
+
+	if (heap_len + 1 >= heap_max) {
+		size_t num = heap_max ? heap_max * 2 : 64;
+		loop_timer_t **ptr;
+
+		ptr = realloc(heap, num * sizeof(*ptr));
+		if (!ptr)
+			return RC_OUT_OF_MEMORY;
+
+		heap     = ptr;
+		heap_max = num;
+	}
+
+	heap[++heap_len] = t;
+	t->index = heap_len;
+	heap_up(t->index);
+
+	return 0;
+}
+
+void loop_timer_del(loop_timer_t *t)
+{
+	size_t i;
+
+	if (!t || !t->index)
+		return;
+
+	i = t->index;
+	t->index = 0;
+	if (i != heap_len) {
+		loop_timer_t *last = heap[heap_len--];
+
+		heap[i] = last;
+		last->index = i;
+		heap_up(i);
+		heap_down(last->index);
+	} else
+		heap_len--;
+}
+
+int loop_timer_pending(loop_timer_t *t)
+{
+	return t && t->index;
+}
+
+/**
+ * loop_run - Run event loop
+ * @timeout: Max time to run, in seconds, zero to only poll, or
+ *           %LOOP_FOREVER to run until loop_break()
+ *
+ * Sleeps in the kernel until a registered descriptor is readable, a
+ * signal is caught, a timer expires, or the timeout expires.  Callbacks
+ * are run as the events arrive, any callback may call loop_break() to
+ * return early.
+ *
+ * Returns:
+ * %RC_OK, or %RC_OS_EVENT_LOOP_FAILED on unrecoverable error.
+ */
+int loop_run(time_t timeout)
+{
+	long long deadline = loop_now() + (long long)timeout * 1000;
+
+	running = 1;
+	do {
+		long long left, next;
+		int msec;
+
+		next = timer_run();
+		if (!running)
+			break;
+
+		left = deadline - loop_now();
+		if (left < 0)
+			left = 0;
+		if (timeout < 0 || (next >= 0 && next < left))
+			left = next;
+		if (left > 86400000)
+			left = 86400000;
+		msec = (int)left;
+
+		if (io_wait(msec) < 0) {
+			logit(LOG_ERR, "Failed waiting for events: %s", strerror(errno));
+			running = 0;
+			return RC_OS_EVENT_LOOP_FAILED;
+		}
+	} while (running && (timeout < 0 || loop_now() < deadline));
+	running = 0;
+
+	return 0;
+}
+
+void loop_break(void)
+{
+	running = 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
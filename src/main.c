@@ -31,7 +31,10 @@
 
 #include "log.h"
 #include "ddns.h"
+#include "dns.h"
 #include "error.h"
+#include "loop.h"
+#include "netlink.h"
 #include "ssl.h"
 
 int    once = 0;
@@ -42,6 +45,9 @@ int    allow_ipv6 = 0;
 int    secure_ssl = 1;		/* Strict cert validation by default */
 int    broken_rtc = 0;		/* Validate certificate time by default */
 char  *ca_trust_file = NULL;	/* Custom CA trust file/bundle PEM format */
+int    persist_ssl_sessions = 0;	/* Save TLS sessions in cache dir */
+int    keepalive_timeout = HTTP_DEFAULT_KEEPALIVE;
+int    max_response_size = BUF_DEFAULT_MAX;
 int    verify_addr = 1;
 char  *prognm = NULL;
 char  *ident = PACKAGE_NAME;
@@ -79,26 +85,25 @@ static int alloc_context(ddns_t **pctx)
 		memset(ctx, 0, sizeof(ddns_t));
 
 		/* Alloc space for http_to_ip_server data */
-		ctx->work_buflen = DDNS_HTTP_RESPONSE_BUFFER_SIZE;
-		ctx->work_buf = (char *)malloc(ctx->work_buflen);
-		if (!ctx->work_buf) {
+		ctx->work = buf_get(BUF_DEFAULT_SIZE);
+		if (!ctx->work) {
 			rc = RC_OUT_OF_MEMORY;
 			break;
 		}
 
 		/* Alloc space for request data */
-		ctx->request_buflen = DDNS_HTTP_REQUEST_BUFFER_SIZE;
-		ctx->request_buf = (char *)malloc(ctx->request_buflen);
-		if (!ctx->request_buf) {
+		ctx->request = buf_get(DDNS_HTTP_REQUEST_BUFFER_SIZE);
+		if (!ctx->request) {
 			rc = RC_OUT_OF_MEMORY;
 			break;
 		}
+		ctx->request_buf    = ctx->request->data;
+		ctx->request_buflen = DDNS_HTTP_REQUEST_BUFFER_SIZE;
 
 		ctx->cmd = NO_CMD;
 		ctx->normal_update_period_sec = DDNS_DEFAULT_PERIOD;
-		ctx->update_period = DDNS_DEFAULT_PERIOD;
 		ctx->total_iterations = DDNS_DEFAULT_ITERATIONS;
-		ctx->cmd_check_period = DDNS_DEFAULT_CMD_CHECK_PERIOD;
+		ctx->concurrency = DDNS_DEFAULT_CONCURRENCY;
 
 		ctx->initialized = 0;
 	}
@@ -106,11 +111,8 @@ static int alloc_context(ddns_t **pctx)
 
 	if (rc) {
 
-		if (ctx->work_buf)
-			free(ctx->work_buf);
-
-		if (ctx->request_buf)
-			free(ctx->request_buf);
+		buf_put(ctx->work);
+		buf_put(ctx->request);
 
 		free(ctx);
 		*pctx = NULL;
@@ -124,15 +126,12 @@ static void free_context(ddns_t *ctx)
 	if (!ctx)
 		return;
 
-	if (ctx->work_buf) {
-		free(ctx->work_buf);
-		ctx->work_buf = NULL;
-	}
+	buf_put(ctx->work);
+	ctx->work = NULL;
 
-	if (ctx->request_buf) {
-		free(ctx->request_buf);
-		ctx->request_buf = NULL;
-	}
+	buf_put(ctx->request);
+	ctx->request     = NULL;
+	ctx->request_buf = NULL;
 
 	conf_info_cleanup();
 	free(ctx);
@@ -558,6 +557,13 @@ int main(int argc, char *argv[])
 	if (rc)
 		goto leave;
 
+	/* Main event loop, survives SIGHUP */
+	rc = loop_init();
+	if (rc) {
+		ssl_exit();
+		goto leave;
+	}
+
 	do {
 		restart = 0;
 
@@ -582,11 +588,18 @@ int main(int argc, char *argv[])
 		if (rc == RC_RESTART)
 			restart = 1;
 
+		/* Servers and settings may change on reload */
+		http_pool_flush();
+
 		free_context(ctx);
 		cfg_free(cfg);
 	} while (restart);
 
+	netlink_exit();
+	dns_flush();
+	loop_exit();
 	ssl_exit();
+	buf_flush();
 leave:
 	if (rc)
 		logit(LOG_ERR, "Error code %d: %s", rc, error_str(rc));
@@ -0,0 +1,287 @@
+/* Multi-pattern string matcher, for classifying provider responses
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * Patterns, e.g. "good", "nochg", or "badauth", are compiled into an
+ * Aho-Corasick automaton, a DFA over all patterns at once.  Bytes not
+ * in any pattern share one column in the transition table, and each
+ * state knows the first added pattern ending there, also via suffix
+ * links.  So a response is classified in one pass, whatever the number
+ * of patterns, with the first added pattern found in the text winning.
+ */
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "log.h"
+#include "match.h"
+
+#define NONE INT_MAX
+
+struct rule {
+	char          *pattern;
+	size_t         len;
+	int            result;
+};
+
+struct match {
+	int            flags;
+
+	struct rule   *rule;
+	size_t         num;
+	size_t         max;
+
+	/* Compiled automaton, next[state * nclass + class[byte]] */
+	unsigned char  class[256];
+	size_t         nclass;
+	size_t         nstate;
+	int           *next;
+	int           *best;	/* First rule ending in state, or NONE */
+};
+
+struct match *match_new(int flags)
+{
+	struct match *m;
+
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		return NULL;
+
+	m->flags = flags;
+
+	return m;
+}
+
+static void reset(struct match *m)
+{
+	free(m->next);
+	free(m->best);
+	m->next   = NULL;
+	m->best   = NULL;
+	m->nstate = 0;
+}
+
+void match_free(struct match *m)
+{
+	size_t i;
+
+	if (!m)
+		return;
+
+	for (i = 0; i < m->num; i++)
+		free(m->rule[i].pattern);
+	free(m->rule);
+	reset(m);
+	free(m);
+}
+
+/**
+ * match_add - Add pattern
+ * @m:       Matcher
+ * @pattern: Substring to look for, an empty pattern matches any text
+ * @result:  Returned by match_find() when @pattern is the first added
+ *           pattern found in the text
+ *
+ * The matcher must be compiled again before use.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on error.
+ */
+int match_add(struct match *m, const char *pattern, int result)
+{
+	struct rule *r;
+
+	if (m->num == m->max) {
+		size_t max = m->max ? 2 * m->max : 8;
+
+		r = realloc(m->rule, max * sizeof(*r));
+		if (!r)
+			return RC_OUT_OF_MEMORY;
+
+		m->rule = r;
+		m->max  = max;
+	}
+
+	r = &m->rule[m->num];
+	r->pattern = strdup(pattern);
+	if (!r->pattern)
+		return RC_OUT_OF_MEMORY;
+	r->len    = strlen(pattern);
+	r->result = result;
+	m->num++;
+
+	reset(m);
+
+	return 0;
+}
+
+/* Columns of the transition table, all other bytes share column 0 */
+static void classify(struct match *m)
+{
+	size_t i, j;
+
+	memset(m->class, 0, sizeof(m->class));
+	m->nclass = 1;
+
+	for (i = 0; i < m->num; i++) {
+		for (j = 0; j < m->rule[i].len; j++) {
+			unsigned char c = m->rule[i].pattern[j];
+
+			if (m->flags & MATCH_NOCASE)
+				c = tolower(c);
+			if (m->class[c])
+				continue;
+
+			m->class[c] = m->nclass;
+			if (m->flags & MATCH_NOCASE)
+				m->class[toupper(c)] = m->nclass;
+			m->nclass++;
+		}
+	}
+}
+
+/**
+ * match_compile - Compile added patterns
+ * @m: Matcher
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on error.
+ */
+int match_compile(struct match *m)
+{
+	size_t max = 1, num = 1, head = 0, tail = 0;
+	int *fail = NULL, *queue = NULL;
+	size_t i, j, c;
+	int rc = RC_OUT_OF_MEMORY;
+
+	reset(m);
+	classify(m);
+
+	for (i = 0; i < m->num; i++)
+		max += m->rule[i].len;
+
+	m->next = calloc(max * m->nclass, sizeof(int));
+	m->best = malloc(max * sizeof(int));
+	fail    = calloc(max, sizeof(int));
+	queue   = malloc(max * sizeof(int));
+	if (!m->next || !m->best || !fail || !queue)
+		goto done;
+
+	for (i = 0; i < max; i++)
+		m->best[i] = NONE;
+
+	/* Trie of all patterns, state 0 is the root, 0 is also "no edge" */
+	for (i = 0; i < m->num; i++) {
+		int s = 0;
+
+		for (j = 0; j < m->rule[i].len; j++) {
+			int *next = &m->next[s * m->nclass + m->class[(unsigned char)m->rule[i].pattern[j]]];
+
+			if (!*next)
+				*next = num++;
+			s = *next;
+		}
+
+		if (m->best[s] == NONE)
+			m->best[s] = i;
+	}
+
+	/* Breadth first, fill in missing edges from the suffix link state */
+	for (c = 0; c < m->nclass; c++) {
+		if (m->next[c])
+			queue[tail++] = m->next[c];
+	}
+
+	while (head < tail) {
+		int s = queue[head++];
+
+		if (m->best[fail[s]] < m->best[s])
+			m->best[s] = m->best[fail[s]];
+
+		for (c = 0; c < m->nclass; c++) {
+			int *next = &m->next[s * m->nclass + c];
+			int  link = m->next[fail[s] * m->nclass + c];
+
+			if (*next) {
+				fail[*next] = link;
+				queue[tail++] = *next;
+			} else {
+				*next = link;
+			}
+		}
+	}
+
+	m->nstate = num;
+	rc = 0;
+done:
+	free(queue);
+	free(fail);
+	if (rc) {
+		logit(LOG_ERR, "Failed allocating memory for %zu response patterns", m->num);
+		reset(m);
+	}
+
+	return rc;
+}
+
+/**
+ * match_find - Find first added pattern in text
+ * @m:      Compiled matcher
+ * @text:   Text to search
+ * @result: Result of pattern found
+ *
+ * Returns:
+ * One if a pattern is found, otherwise zero.
+ */
+int match_find(const struct match *m, const char *text, int *result)
+{
+	const unsigned char *p = (const unsigned char *)text;
+	int s = 0, best;
+
+	if (!m || !m->nstate)
+		return 0;
+
+	/* Nothing can beat the first rule, stop early */
+	best = m->best[0];
+	while (*p && best > 0) {
+		s = m->next[s * m->nclass + m->class[*p++]];
+		if (m->best[s] < best)
+			best = m->best[s];
+	}
+
+	if (best == NONE)
+		return 0;
+
+	*result = m->rule[best].result;
+
+	return 1;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -1,13 +1,215 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mbedtls/version.h>
+
 #include "log.h"
 #include "http.h"
+#include "session.h"
 #include "ssl.h"
 
 #define xstr(s) str(s)
 #define str(s) #s
 
-int ssl_init(void) { return 0; }
+/*
+ * Client config and CA store, shared by all connections.  Rebuilt when
+ * ca-trust-file changes, connections already opened keep a reference
+ * to the previous one, it is freed when the last of them is closed.
+ */
+struct tls_conf {
+	int                 refcnt;
+	char               *ca_file;
+	mbedtls_ssl_config  conf;
+	mbedtls_x509_crt    cacert;
+};
+
+static struct tls_conf *shared;
+static pthread_mutex_t  conf_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The RNG is seeded once, and serialized since it is not thread safe */
+static mbedtls_ctr_drbg_context ctr_drbg;
+static mbedtls_entropy_context  entropy;
+static pthread_mutex_t          rng_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int rng(void *arg, unsigned char *buf, size_t len)
+{
+	int rc;
+
+	pthread_mutex_lock(&rng_lock);
+	rc = mbedtls_ctr_drbg_random(arg, buf, len);
+	pthread_mutex_unlock(&rng_lock);
+
+	return rc;
+}
+
+static void conf_free(struct tls_conf *tls)
+{
+	mbedtls_x509_crt_free  (&tls->cacert);
+	mbedtls_ssl_config_free(&tls->conf);
+	free(tls->ca_file);
+	free(tls);
+}
+
+static struct tls_conf *conf_new(void)
+{
+	struct tls_conf *tls;
+	int rc;
+
+	tls = calloc(1, sizeof(*tls));
+	if (!tls)
+		return NULL;
+
+	mbedtls_x509_crt_init  (&tls->cacert);
+	mbedtls_ssl_config_init(&tls->conf);
+
+	/* A user defined CA PEM bundle overrides any built-ins or fall-backs */
+	if (ca_trust_file) {
+		tls->ca_file = strdup(ca_trust_file);
+		if (!tls->ca_file) {
+			conf_free(tls);
+			return NULL;
+		}
+
+		logit(LOG_DEBUG, "Using CA PEM bundle: %s", ca_trust_file);
+		rc = mbedtls_x509_crt_parse_file(&tls->cacert, ca_trust_file);
+	} else {
+		rc = mbedtls_x509_crt_parse_file(&tls->cacert, CAFILE1);
+		if (rc)
+			rc = mbedtls_x509_crt_parse_file(&tls->cacert, CAFILE2);
+	}
+	if (rc) {
+		logit(LOG_DEBUG, "mbedtls_x509_crt_parse_file: %d", rc);
+		conf_free(tls);
+		return NULL;
+	}
+
+	rc = mbedtls_ssl_config_defaults(&tls->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+	if (rc) {
+		logit(LOG_DEBUG, "mbedtls_ssl_config_defaults:%d", rc);
+		conf_free(tls);
+		return NULL;
+	}
+
+	mbedtls_ssl_conf_ca_chain(&tls->conf, &tls->cacert, 0);
+	mbedtls_ssl_conf_rng(&tls->conf, rng, &ctr_drbg);
+
+	return tls;
+}
+
+static int same_file(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return !strcmp(a, b);
+}
+
+/*
+ * Take a reference to the shared config, building it on first use or
+ * if ca-trust-file has changed since, e.g., on SIGHUP.
+ */
+static struct tls_conf *conf_get(void)
+{
+	struct tls_conf *tls;
+
+	pthread_mutex_lock(&conf_lock);
+	if (!shared || !same_file(shared->ca_file, ca_trust_file)) {
+		tls = conf_new();
+		if (!tls)
+			goto done;
+
+		if (shared && --shared->refcnt == 0)
+			conf_free(shared);
+		shared = tls;
+		shared->refcnt = 1;
+	}
+
+	tls = shared;
+	tls->refcnt++;
+done:
+	pthread_mutex_unlock(&conf_lock);
 
-void ssl_exit(void) {}
+	return tls;
+}
+
+static void conf_put(struct tls_conf *tls)
+{
+	if (!tls)
+		return;
+
+	pthread_mutex_lock(&conf_lock);
+	if (--tls->refcnt == 0)
+		conf_free(tls);
+	pthread_mutex_unlock(&conf_lock);
+}
+
+int ssl_init(void)
+{
+	int rc;
+
+	mbedtls_ctr_drbg_init(&ctr_drbg);
+	mbedtls_entropy_init (&entropy);
+
+	rc = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, (const unsigned char *)PACKAGE_STRING, strlen(PACKAGE_STRING));
+	if (rc) {
+		logit(LOG_DEBUG, "mbedtls_ctr_drbg_seed:%d", rc);
+		return RC_HTTPS_OUT_OF_MEMORY;
+	}
+
+	return 0;
+}
+
+void ssl_exit(void)
+{
+	pthread_mutex_lock(&conf_lock);
+	if (shared && --shared->refcnt == 0)
+		conf_free(shared);
+	shared = NULL;
+	pthread_mutex_unlock(&conf_lock);
+
+	session_flush();
+	mbedtls_ctr_drbg_free(&ctr_drbg);
+	mbedtls_entropy_free (&entropy);
+}
+
+/* Session (de)serialization is available since mbedTLS 2.19 */
+#if MBEDTLS_VERSION_NUMBER >= 0x02130000
+static void ssl_load_session(http_t *client)
+{
+	mbedtls_ssl_session session;
+	void *data;
+	size_t len;
+
+	if (session_get(client->tcp.remote_host, client->tcp.port, &data, &len))
+		return;
+
+	mbedtls_ssl_session_init(&session);
+	if (!mbedtls_ssl_session_load(&session, data, len))
+		mbedtls_ssl_set_session(&client->ssl, &session);
+	mbedtls_ssl_session_free(&session);
+	free(data);
+}
+
+/*
+ * With TLS 1.3 the ticket arrives after the handshake, so the session
+ * is saved when closing, after the last response has been read.
+ */
+static void ssl_save_session(http_t *client)
+{
+	unsigned char data[SESSION_MAX_LEN];
+	mbedtls_ssl_session session;
+	size_t len;
+
+	mbedtls_ssl_session_init(&session);
+	if (!mbedtls_ssl_get_session(&client->ssl, &session) &&
+	    !mbedtls_ssl_session_save(&session, data, sizeof(data), &len))
+		session_put(client->tcp.remote_host, client->tcp.port, data, len);
+	mbedtls_ssl_session_free(&session);
+}
+#else
+#define ssl_load_session(client)
+#define ssl_save_session(client)
+#endif
 
 int ssl_open(http_t *client, char *msg, int force)
 {
@@ -28,24 +230,9 @@ int ssl_open(http_t *client, char *msg, int force)
 
 	mbedtls_ssl_init       (&client->ssl);
 	mbedtls_net_init       (&client->server_fd);
-	mbedtls_x509_crt_init  (&client->cacert);
-	mbedtls_ssl_config_init(&client->conf);
-	mbedtls_ctr_drbg_init  (&client->ctr_drbg);
-	mbedtls_entropy_init   (&client->entropy);
-
-	rc = mbedtls_ctr_drbg_seed(&client->ctr_drbg, mbedtls_entropy_func, &client->entropy, PACKAGE_STRING, strlen(PACKAGE_STRING));
-	if (rc) {
-		logit(LOG_DEBUG, "mbedtls_ctr_drbg_seed:%d", rc);
-		ssl_close(client);
-		return RC_HTTPS_OUT_OF_MEMORY;
-	}
 
-	rc = mbedtls_x509_crt_parse_file(&client->cacert, CAFILE1);
-	if (rc) {
-		rc = mbedtls_x509_crt_parse_file(&client->cacert, CAFILE2);
-	}
-	if (rc) {
-		logit(LOG_DEBUG, "mbedtls_x509_crt_parse_file: %d", rc);
+	client->tls = conf_get();
+	if (!client->tls) {
 		ssl_close(client);
 		return RC_HTTPS_NO_TRUSTED_CA_STORE;
 	}
@@ -57,17 +244,7 @@ int ssl_open(http_t *client, char *msg, int force)
 		return RC_TCP_CONNECT_FAILED;
 	}
 
-	rc = mbedtls_ssl_config_defaults(&client->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
-	if (rc) {
-		logit(LOG_DEBUG, "mbedtls_ssl_config_defaults:%d", rc);
-		ssl_close(client);
-		return RC_HTTPS_OUT_OF_MEMORY;
-	}
-
-	mbedtls_ssl_conf_ca_chain(&client->conf, &client->cacert, 0);
-	mbedtls_ssl_conf_rng(&client->conf, mbedtls_ctr_drbg_random, &client->ctr_drbg);
-
-	rc = mbedtls_ssl_setup(&client->ssl, &client->conf);
+	rc = mbedtls_ssl_setup(&client->ssl, &client->tls->conf);
 	if (rc) {
 		logit(LOG_DEBUG, "mbedtls_ssl_setup:%d", rc);
 		ssl_close(client);
@@ -83,6 +260,9 @@ int ssl_open(http_t *client, char *msg, int force)
 
 	mbedtls_ssl_set_bio(&client->ssl, &client->server_fd, mbedtls_net_send, mbedtls_net_recv, 0);
 
+	/* Resume last session with this server, if any */
+	ssl_load_session(client);
+
 	while (1) {
 		rc = mbedtls_ssl_handshake(&client->ssl);
 		if (!rc) { break; }
@@ -102,14 +282,14 @@ int ssl_open(http_t *client, char *msg, int force)
 int ssl_close(http_t *client)
 {
 	if (client->ssl_enabled) {
-		if (client->connected)
+		if (client->connected) {
+			ssl_save_session(client);
 			mbedtls_ssl_close_notify(&client->ssl);
+		}
 		mbedtls_ssl_free       (&client->ssl      );
 		mbedtls_net_free       (&client->server_fd);
-		mbedtls_x509_crt_free  (&client->cacert   );
-		mbedtls_ssl_config_free(&client->conf     );
-		mbedtls_ctr_drbg_free  (&client->ctr_drbg );
-		mbedtls_entropy_free   (&client->entropy  );
+		conf_put(client->tls);
+		client->tls = NULL;
 	}
 	client->connected = 0;
 
@@ -136,31 +316,63 @@ int ssl_send(http_t *client, const char *buf, int len)
 	return 0;
 }
 
+/* No gather write in MbedTLS, coalesce into as few records as possible */
+int ssl_sendv(http_t *client, const struct iovec *iov, int iovcnt)
+{
+	char buf[4096];
+	size_t len = 0;
+	int i;
+
+	if (!client->ssl_enabled)
+		return tcp_sendv(&client->tcp, iov, iovcnt);
+
+	for (i = 0; i < iovcnt; i++) {
+		const char *ptr = iov[i].iov_base;
+		size_t left = iov[i].iov_len;
+
+		while (left > 0) {
+			size_t num = sizeof(buf) - len;
+
+			if (num > left)
+				num = left;
+			memcpy(&buf[len], ptr, num);
+			len  += num;
+			ptr  += num;
+			left -= num;
+
+			if (len == sizeof(buf)) {
+				DO(ssl_send(client, buf, len));
+				len = 0;
+			}
+		}
+	}
+
+	if (len)
+		return ssl_send(client, buf, len);
+
+	return 0;
+}
+
 int ssl_recv(http_t *client, char *buf, int buf_len, int *recv_len)
 {
-	int err, len = 0;
+	int err;
 
 	if (!client->ssl_enabled)
 		return tcp_recv(&client->tcp, buf, buf_len, recv_len);
 
 	do {
-		err = mbedtls_ssl_read(&client->ssl, buf + len, buf_len - len);
-		if (err == 0 || err == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
-			err = 0;
-			client->connected = 0;
-			break;
-		}
-		if (err > 0)
-			len += err;
-	} while (err > 0 || err == MBEDTLS_ERR_SSL_WANT_READ);
+		err = mbedtls_ssl_read(&client->ssl, (unsigned char *)buf, buf_len);
+	} while (err == MBEDTLS_ERR_SSL_WANT_READ);
 
-	if (err < 0) {
-		return RC_HTTPS_RECV_ERROR;
+	if (err == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+		client->connected = 0;
+		err = 0;
 	}
 
-	*recv_len = len;
+	if (err < 0)
+		return RC_HTTPS_RECV_ERROR;
 
-	logit(LOG_DEBUG, "Successfully received HTTPS response (%d/%d bytes)!", *recv_len, buf_len);
+	*recv_len = err;
 
 	return 0;
 }
@@ -0,0 +1,415 @@
+/* Netlink monitor, keeps a table of interface addresses up to date
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "compat.h"
+#include "log.h"
+#include "netlink.h"
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+#include <fcntl.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "loop.h"
+#include "queue.h"
+
+#define NETLINK_SYNC_TIMEOUT 2	/* sec */
+
+struct addr {
+	TAILQ_ENTRY(addr) link;
+	unsigned int      gen;
+
+	int               ifindex;
+	char              ifname[IF_NAMESIZE];
+	int               family;
+	char              host[INET6_ADDRSTRLEN];
+};
+
+/* Address table, kept in kernel order, also read by worker threads */
+static TAILQ_HEAD(, addr) addrs = TAILQ_HEAD_INITIALIZER(addrs);
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int          sd = -1;
+static unsigned int seq;
+static unsigned int gen;	/* Generation of last dump, for pruning */
+static int          dumping;
+static int          resync;
+
+static netlink_change_fn_t change_cb;
+static void               *change_arg;
+
+static void changed(const char *ifname)
+{
+	logit(LOG_DEBUG, "Address change on interface %s", ifname);
+	if (change_cb)
+		change_cb(ifname, change_arg);
+}
+
+/* Request all addresses, used at startup and to recover lost events */
+static int request_dump(void)
+{
+	struct {
+		struct nlmsghdr  nh;
+		struct ifaddrmsg ifa;
+	} req;
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len   = NLMSG_LENGTH(sizeof(req.ifa));
+	req.nh.nlmsg_type  = RTM_GETADDR;
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nh.nlmsg_seq   = ++seq;
+	req.ifa.ifa_family = AF_UNSPEC;
+
+	if (send(sd, &req, req.nh.nlmsg_len, 0) < 0) {
+		logit(LOG_WARNING, "Failed requesting interface addresses: %s", strerror(errno));
+		return 1;
+	}
+
+	gen++;
+	dumping = 1;
+
+	return 0;
+}
+
+/* Drop addresses not seen in the last dump */
+static void prune(void)
+{
+	struct addr *entry, *tmp;
+
+	TAILQ_FOREACH_SAFE(entry, &addrs, link, tmp) {
+		if (entry->gen == gen)
+			continue;
+
+		TAILQ_REMOVE(&addrs, entry, link);
+		changed(entry->ifname);
+		free(entry);
+	}
+}
+
+/*
+ * Add, refresh, or remove an address.  Tentative addresses, and those
+ * that failed duplicate address detection, are not usable yet.  Only
+ * additions and removals are reported, not lifetime refreshes.
+ */
+static void update(struct nlmsghdr *nh)
+{
+	struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+	struct rtattr *rta;
+	struct addr *entry;
+	void *local = NULL, *address = NULL;
+	char host[INET6_ADDRSTRLEN];
+	int len = IFA_PAYLOAD(nh);
+	int add;
+
+	if (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6)
+		return;
+
+	for (rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == IFA_LOCAL)
+			local = RTA_DATA(rta);
+		else if (rta->rta_type == IFA_ADDRESS)
+			address = RTA_DATA(rta);
+	}
+
+	/* On point-to-point links IFA_ADDRESS is the peer's address */
+	if (local)
+		address = local;
+	if (!address || !inet_ntop(ifa->ifa_family, address, host, sizeof(host)))
+		return;
+
+	add = nh->nlmsg_type == RTM_NEWADDR &&
+		!(ifa->ifa_flags & (IFA_F_TENTATIVE | IFA_F_DADFAILED));
+
+	TAILQ_FOREACH(entry, &addrs, link) {
+		if (entry->ifindex == (int)ifa->ifa_index &&
+		    entry->family  == ifa->ifa_family && !strcmp(entry->host, host))
+			break;
+	}
+
+	if (entry) {
+		if (add) {
+			entry->gen = gen;
+			return;
+		}
+
+		TAILQ_REMOVE(&addrs, entry, link);
+		changed(entry->ifname);
+		free(entry);
+		return;
+	}
+
+	if (!add)
+		return;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		logit(LOG_WARNING, "Out of memory adding address %s to table", host);
+		return;
+	}
+
+	if (!if_indextoname(ifa->ifa_index, entry->ifname)) {
+		free(entry);
+		return;
+	}
+
+	entry->gen     = gen;
+	entry->ifindex = ifa->ifa_index;
+	entry->family  = ifa->ifa_family;
+	strlcpy(entry->host, host, sizeof(entry->host));
+	TAILQ_INSERT_TAIL(&addrs, entry, link);
+
+	changed(entry->ifname);
+}
+
+/* Read and handle one datagram, returns non-zero when there is no more */
+static int receive(void)
+{
+	union {
+		struct nlmsghdr nh;
+		char            buf[8192];
+	} u;
+	struct nlmsghdr *nh;
+	ssize_t len;
+
+	len = recv(sd, u.buf, sizeof(u.buf), 0);
+	if (len < 0) {
+		if (errno == EINTR)
+			return 0;
+
+		/* Socket buffer overrun, events lost, resync table */
+		if (errno == ENOBUFS) {
+			logit(LOG_WARNING, "Lost netlink events, resynchronizing interface addresses");
+			if (dumping)
+				resync = 1;
+			else
+				request_dump();
+			return 0;
+		}
+
+		return 1;
+	}
+
+	pthread_mutex_lock(&lock);
+	for (nh = &u.nh; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+		switch (nh->nlmsg_type) {
+		case NLMSG_DONE:
+			if (nh->nlmsg_seq != seq)
+				break;
+
+			prune();
+			dumping = 0;
+			if (resync) {
+				resync = 0;
+				request_dump();
+			}
+			break;
+
+		case NLMSG_ERROR:
+			if (nh->nlmsg_seq != seq)
+				break;
+
+			logit(LOG_WARNING, "Failed reading interface addresses");
+			dumping = 0;
+			break;
+
+		case RTM_NEWADDR:
+		case RTM_DELADDR:
+			update(nh);
+			break;
+
+		default:
+			break;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+
+	return 0;
+}
+
+static void netlink_cb(int fd, void *arg)
+{
+	while (!receive())
+		;
+}
+
+/**
+ * netlink_init - Start monitoring interface addresses
+ *
+ * Subscribes to address changes and reads the current addresses of all
+ * interfaces.  Safe to call more than once, e.g., after SIGHUP.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero if the monitor could not be started.
+ */
+int netlink_init(void)
+{
+	struct sockaddr_nl sa;
+	struct timeval tv = { NETLINK_SYNC_TIMEOUT, 0 };
+
+	if (sd != -1)
+		return 0;
+
+	sd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (sd < 0)
+		goto fail;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+	if (bind(sd, (struct sockaddr *)&sa, sizeof(sa)))
+		goto fail;
+
+	/* Initial table is read synchronously, before first address check */
+	setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	if (request_dump())
+		goto fail;
+	while (dumping) {
+		if (receive())
+			goto fail;
+	}
+
+	if (fcntl(sd, F_SETFL, O_NONBLOCK) || loop_add(sd, netlink_cb, NULL))
+		goto fail;
+
+	logit(LOG_DEBUG, "Monitoring interface address changes");
+
+	return 0;
+fail:
+	logit(LOG_WARNING, "Failed starting netlink monitor, polling interfaces: %s", strerror(errno));
+	netlink_exit();
+
+	return 1;
+}
+
+void netlink_exit(void)
+{
+	struct addr *entry;
+
+	if (sd != -1) {
+		loop_del(sd);
+		close(sd);
+		sd = -1;
+	}
+
+	pthread_mutex_lock(&lock);
+	while ((entry = TAILQ_FIRST(&addrs))) {
+		TAILQ_REMOVE(&addrs, entry, link);
+		free(entry);
+	}
+	pthread_mutex_unlock(&lock);
+
+	dumping = resync = 0;
+	change_cb = NULL;
+}
+
+/**
+ * netlink_notify - Set callback for address changes
+ * @cb:  Callback, or %NULL to disable
+ * @arg: Argument to callback
+ *
+ * The callback is called from the main loop, with the address table
+ * locked, it must not call netlink_foreach().
+ */
+void netlink_notify(netlink_change_fn_t cb, void *arg)
+{
+	change_cb  = cb;
+	change_arg = arg;
+}
+
+/**
+ * netlink_foreach - Iterate over the addresses of an interface
+ * @ifname: Interface name
+ * @cb:     Callback for each address
+ * @arg:    Argument to callback
+ *
+ * Safe to call from worker threads.
+ *
+ * Returns:
+ * Number of addresses, or -1 if the monitor is not running, in which
+ * case the caller must query the kernel itself.
+ */
+int netlink_foreach(const char *ifname, netlink_addr_fn_t cb, void *arg)
+{
+	struct addr *entry;
+	int num = 0;
+
+	if (sd == -1)
+		return -1;
+
+	pthread_mutex_lock(&lock);
+	TAILQ_FOREACH(entry, &addrs, link) {
+		if (strcmp(entry->ifname, ifname))
+			continue;
+
+		cb(entry->family, entry->host, arg);
+		num++;
+	}
+	pthread_mutex_unlock(&lock);
+
+	return num;
+}
+
+#else /* !HAVE_LINUX_RTNETLINK_H */
+
+int netlink_init(void)
+{
+	return 1;
+}
+
+void netlink_exit(void)
+{
+}
+
+void netlink_notify(netlink_change_fn_t cb, void *arg)
+{
+	(void)cb;
+	(void)arg;
+}
+
+int netlink_foreach(const char *ifname, netlink_addr_fn_t cb, void *arg)
+{
+	(void)ifname;
+	(void)cb;
+	(void)arg;
+
+	return -1;
+}
+
+#endif /* HAVE_LINUX_RTNETLINK_H */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -19,10 +19,23 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <pthread.h>
+
 #include "log.h"
+#include "loop.h"
 #include "http.h"
+#include "session.h"
 #include "ssl.h"
 
+/*
+ * Client context and trust store, shared by all connections.  Rebuilt
+ * when ca-trust-file changes, connections already opened keep their own
+ * reference to the previous one, released in SSL_free().
+ */
+static SSL_CTX        *ctx;
+static char           *ctx_ca_file;
+static pthread_mutex_t ctx_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int ssl_init(void)
 {
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
@@ -36,6 +49,16 @@ int ssl_init(void)
 
 void ssl_exit(void)
 {
+	pthread_mutex_lock(&ctx_lock);
+	if (ctx)
+		SSL_CTX_free(ctx);
+	ctx = NULL;
+	free(ctx_ca_file);
+	ctx_ca_file = NULL;
+	pthread_mutex_unlock(&ctx_lock);
+
+	session_flush();
+
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 	ERR_free_strings();
 	EVP_cleanup();
@@ -91,21 +114,22 @@ static int verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
 	return 1;
 }
 
-static int ssl_set_ca_location(http_t *client)
+static int ssl_set_ca_location(SSL_CTX *ssl_ctx)
 {
 	int ret;
 
 	/* A user defined CA PEM bundle overrides any built-ins or fall-backs */
 	if (ca_trust_file) {
-		ret = SSL_CTX_load_verify_locations(client->ssl_ctx, ca_trust_file, NULL);
+		logit(LOG_DEBUG, "Using CA PEM bundle: %s", ca_trust_file);
+		ret = SSL_CTX_load_verify_locations(ssl_ctx, ca_trust_file, NULL);
 		goto done;
 	}
 
-	ret = SSL_CTX_set_default_verify_paths(client->ssl_ctx);
+	ret = SSL_CTX_set_default_verify_paths(ssl_ctx);
 	if (ret < 1)
-		ret = SSL_CTX_load_verify_locations(client->ssl_ctx, CAFILE1, NULL);
+		ret = SSL_CTX_load_verify_locations(ssl_ctx, CAFILE1, NULL);
 	if (ret < 1)
-		ret = SSL_CTX_load_verify_locations(client->ssl_ctx, CAFILE2, NULL);
+		ret = SSL_CTX_load_verify_locations(ssl_ctx, CAFILE2, NULL);
 done:
 	if (ret < 1)
 		return 1;
@@ -138,14 +162,147 @@ static int ssl_fail(http_t *client, int rc)
 	if (!client)
 		return rc;
 
-	if (!client->ssl_ctx)
-		tcp_exit(&client->tcp);
-	else
-		ssl_close(client);
+	ssl_close(client);
 
 	return rc;
 }
 
+static int same_file(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return !strcmp(a, b);
+}
+
+static SSL_CTX *ssl_ctx_new(void)
+{
+	SSL_CTX *ssl_ctx;
+
+	ssl_ctx = SSL_CTX_new(SSLv23_client_method());
+	if (!ssl_ctx)
+		return NULL;
+
+	/* POODLE, only allow TLSv1.x or later */
+#ifndef OPENSSL_NO_EC
+	SSL_CTX_set_options(ssl_ctx, SSL_OP_SINGLE_ECDH_USE | SSL_OP_SINGLE_DH_USE | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
+#else
+	SSL_CTX_set_options(ssl_ctx, SSL_OP_SINGLE_DH_USE | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
+#endif
+	/* verify should be optional. routers might not have accurate time setting */
+	SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_PEER, verify_callback);
+	SSL_CTX_set_verify_depth(ssl_ctx, 150);
+
+	return ssl_ctx;
+}
+
+/*
+ * Create a connection from the shared context, (re)building it on first
+ * use or if ca-trust-file has changed since, e.g., on SIGHUP.
+ */
+static int ssl_new(http_t *client)
+{
+	char *file = NULL;
+	SSL_CTX *ssl_ctx;
+	int rc = 0;
+
+	pthread_mutex_lock(&ctx_lock);
+	if (ctx && same_file(ctx_ca_file, ca_trust_file))
+		goto done;
+
+	ssl_ctx = ssl_ctx_new();
+	if (!ssl_ctx) {
+		rc = RC_HTTPS_OUT_OF_MEMORY;
+		goto done;
+	}
+
+	/* Try to figure out location of trusted CA certs on system */
+	if (ssl_set_ca_location(ssl_ctx)) {
+		SSL_CTX_free(ssl_ctx);
+		rc = RC_HTTPS_NO_TRUSTED_CA_STORE;
+		goto done;
+	}
+
+	if (ca_trust_file) {
+		file = strdup(ca_trust_file);
+		if (!file) {
+			SSL_CTX_free(ssl_ctx);
+			rc = RC_OUT_OF_MEMORY;
+			goto done;
+		}
+	}
+
+	if (ctx)
+		SSL_CTX_free(ctx);
+	free(ctx_ca_file);
+	ctx = ssl_ctx;
+	ctx_ca_file = file;
+done:
+	if (!rc) {
+		client->ssl = SSL_new(ctx);
+		if (!client->ssl)
+			rc = RC_HTTPS_OUT_OF_MEMORY;
+	}
+	pthread_mutex_unlock(&ctx_lock);
+
+	return rc;
+}
+
+static void ssl_load_session(http_t *client, const char *sn)
+{
+	const unsigned char *ptr;
+	SSL_SESSION *session;
+	void *data;
+	size_t len;
+
+	if (session_get(sn, client->tcp.port, &data, &len))
+		return;
+
+	ptr = data;
+	session = d2i_SSL_SESSION(NULL, &ptr, len);
+	if (session) {
+		SSL_set_session(client->ssl, session);
+		SSL_SESSION_free(session);
+	}
+	free(data);
+}
+
+/*
+ * With TLS 1.3 the ticket arrives after the handshake, so the session
+ * is saved when closing, after the last response has been read.
+ */
+static void ssl_save_session(http_t *client)
+{
+	unsigned char *data, *ptr;
+	SSL_SESSION *session;
+	const char *sn;
+	int len;
+
+	session = SSL_get1_session(client->ssl);
+	if (!session)
+		return;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+	if (!SSL_SESSION_is_resumable(session))
+		goto done;
+#endif
+
+	len = i2d_SSL_SESSION(session, NULL);
+	if (len <= 0 || len > SESSION_MAX_LEN)
+		goto done;
+
+	data = ptr = malloc(len);
+	if (!data)
+		goto done;
+
+	if (i2d_SSL_SESSION(session, &ptr) == len) {
+		http_get_remote_name(client, &sn);
+		session_put(sn, client->tcp.port, data, len);
+	}
+	free(data);
+done:
+	SSL_SESSION_free(session);
+}
+
 int ssl_open(http_t *client, char *msg, int force)
 {
 	const char *sn;
@@ -163,33 +320,18 @@ int ssl_open(http_t *client, char *msg, int force)
 	DO(tcp_init(&client->tcp, msg, force));
 
 	logit(LOG_INFO, "%s, initiating HTTPS ...", msg);
-	client->ssl_ctx = SSL_CTX_new(SSLv23_client_method());
-	if (!client->ssl_ctx)
-		return ssl_fail(client, RC_HTTPS_OUT_OF_MEMORY);
-
-	/* POODLE, only allow TLSv1.x or later */
-#ifndef OPENSSL_NO_EC
-	SSL_CTX_set_options(client->ssl_ctx, SSL_OP_SINGLE_ECDH_USE | SSL_OP_SINGLE_DH_USE | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
-#else
-	SSL_CTX_set_options(client->ssl_ctx, SSL_OP_SINGLE_DH_USE | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
-#endif
-	/* verify should be optional. routers might not have accurate time setting */
-	SSL_CTX_set_verify(client->ssl_ctx, SSL_VERIFY_PEER, verify_callback);
-	SSL_CTX_set_verify_depth(client->ssl_ctx, 150);
-
-	/* Try to figure out location of trusted CA certs on system */
-	if (ssl_set_ca_location(client))
-		return ssl_fail(client, RC_HTTPS_NO_TRUSTED_CA_STORE);
-
-	client->ssl = SSL_new(client->ssl_ctx);
-	if (!client->ssl)
-		return ssl_fail(client, RC_HTTPS_OUT_OF_MEMORY);
+	rc = ssl_new(client);
+	if (rc)
+		return ssl_fail(client, rc);
 
 	/* SSL SNI support: tell the servername we want to speak to */
 	http_get_remote_name(client, &sn);
 	if (!SSL_set_tlsext_host_name(client->ssl, sn))
 		return ssl_fail(client, RC_HTTPS_SNI_ERROR);
 
+	/* Resume last session with this server, if any */
+	ssl_load_session(client, sn);
+
 	SSL_set_fd(client->ssl, client->tcp.socket);
 	rc = SSL_connect(client->ssl);
 	if (rc < 0) {
@@ -199,6 +341,8 @@ int ssl_open(http_t *client, char *msg, int force)
 
 	client->connected = 1;
 	logit(LOG_INFO, "SSL connection using %s", SSL_get_cipher(client->ssl));
+	if (SSL_session_reused(client->ssl))
+		logit(LOG_DEBUG, "Resumed TLS session with %s", sn);
 
 	cert = SSL_get_peer_certificate(client->ssl);
 	if (!cert)
@@ -222,17 +366,15 @@ int ssl_close(http_t *client)
 	if (client->ssl_enabled) {
 		if (client->ssl) {
 			/* SSL/TLS close_notify */
-			if (client->connected)
+			if (client->connected) {
+				ssl_save_session(client);
 				SSL_shutdown(client->ssl);
+			}
 
 			/* Clean up. */
 			SSL_free(client->ssl);
 			client->ssl = NULL;
 		}
-		if (client->ssl_ctx) {
-			SSL_CTX_free(client->ssl_ctx);
-			client->ssl_ctx = NULL;
-		}
 	}
 	client->connected = 0;
 
@@ -263,32 +405,65 @@ int ssl_send(http_t *client, const char *buf, int len)
 	return 0;
 }
 
+/* No gather write in OpenSSL, coalesce into as few records as possible */
+int ssl_sendv(http_t *client, const struct iovec *iov, int iovcnt)
+{
+	char buf[4096];
+	size_t len = 0;
+	int i;
+
+	if (!client->ssl_enabled)
+		return tcp_sendv(&client->tcp, iov, iovcnt);
+
+	for (i = 0; i < iovcnt; i++) {
+		const char *ptr = iov[i].iov_base;
+		size_t left = iov[i].iov_len;
+
+		while (left > 0) {
+			size_t num = sizeof(buf) - len;
+
+			if (num > left)
+				num = left;
+			memcpy(&buf[len], ptr, num);
+			len  += num;
+			ptr  += num;
+			left -= num;
+
+			if (len == sizeof(buf)) {
+				DO(ssl_send(client, buf, len));
+				len = 0;
+			}
+		}
+	}
+
+	if (len)
+		return ssl_send(client, buf, len);
+
+	return 0;
+}
+
 int ssl_recv(http_t *client, char *buf, int buf_len, int *recv_len)
 {
-	int rc, err, len = 0;
+	long long deadline;
+	int rc, err;
 
 	if (!client->ssl_enabled)
 		return tcp_recv(&client->tcp, buf, buf_len, recv_len);
 
-	err = SSL_ERROR_NONE;
+	/* Retry non-data records, but not the socket receive timeout */
+	deadline = loop_now() + client->tcp.timeout;
 	do {
 		ERR_clear_error();
-		rc = SSL_read(client->ssl, buf + len, buf_len - len);
-		if (rc > 0) {
-			len += rc;
-		} else {
-			err = SSL_get_error(client->ssl, rc);
-		}
-	} while (rc > 0 || err == SSL_ERROR_WANT_READ);
+		rc = SSL_read(client->ssl, buf, buf_len);
+		err = rc < 0 ? SSL_get_error(client->ssl, rc) : SSL_ERROR_NONE;
+	} while (err == SSL_ERROR_WANT_READ && loop_now() < deadline);
 
 	if (rc < 0) {
 		ssl_check_error();
 		return RC_HTTPS_RECV_ERROR;
 	}
 
-	*recv_len = len;
-
-	logit(LOG_DEBUG, "Successfully received HTTPS response (%d/%d bytes)!", *recv_len, buf_len);
+	*recv_len = rc;
 
 	return 0;
 }
@@ -28,10 +28,9 @@
 #include <stdlib.h>		/* atoi() */
 
 #include "log.h"
+#include "loop.h"
 #include "cache.h"
 
-static void *param = NULL;
-
 
 /**
  * Execute shell script on successful update.
@@ -80,21 +79,17 @@ int os_shell_execute(char *cmd, char *ip, char *name, char *event, int error)
 }
 
 /**
- * unix_signal_handler - Signal handler
+ * os_signal_cb - Signal callback
  * @signo: Signal number
+ * @arg:   Client context
  *
- * Handler for registered/known signals. Most others will terminate the
- * daemon.
- *
- * NOTE:
- * Since printf() is one of the possible back-ends of logit(), and
- * printf() is not one of the safe syscalls to be used, according to
- * POSIX signal(7). The calls are commented, since they are most likely
- * also only needed for debugging.
+ * Handler for registered/known signals, called from the main event
+ * loop, i.e., not from signal context.  Any command is acted upon as
+ * soon as it arrives, so we break out of the loop here.
  */
-static void unix_signal_handler(int signo)
+static void os_signal_cb(int signo, void *arg)
 {
-	ddns_t *ctx = (ddns_t *)param;
+	ddns_t *ctx = (ddns_t *)arg;
 
 	if (ctx == NULL)
 		return;
@@ -118,8 +113,10 @@ static void unix_signal_handler(int signo)
 		break;
 
 	default:
-		break;
+		return;
 	}
+
+	loop_break();
 }
 
 static int signal_ignore(int signo)
@@ -160,38 +157,25 @@ static int os_install_child_handler(void)
 }
 
 /**
- * Install signal handler for signals HUP, INT, TERM and USR1
+ * Install signal handler for signals HUP, INT, TERM, USR1 and USR2
  *
- * Also block exactly the handled signals, only for the duration
- * of the handler.  All other signals are left alone.
+ * The signals are caught by the main event loop, which wakes up and
+ * calls os_signal_cb() immediately.  Called at every (re)start, with
+ * the new context.
  */
 int os_install_signal_handler(void *ctx)
 {
 	static int installed = 0;
-	int rc = 0;
+	int rc;
 
-	if (!installed) {
-		struct sigaction sa;
-
-		memset(&sa, 0, sizeof(sa));
-#ifdef SA_RESTART
-		sa.sa_flags |= SA_RESTART;
-#endif
-		sa.sa_handler = unix_signal_handler;
-
-		rc = (sigemptyset(&sa.sa_mask)        ||
-		      sigaddset(&sa.sa_mask, SIGHUP)  ||
-		      sigaddset(&sa.sa_mask, SIGINT)  ||
-		      sigaddset(&sa.sa_mask, SIGTERM) ||
-		      sigaddset(&sa.sa_mask, SIGUSR1) ||
-		      sigaddset(&sa.sa_mask, SIGUSR2) ||
-		      sigaction(SIGHUP,  &sa, NULL)   ||
-		      sigaction(SIGINT,  &sa, NULL)   ||
-		      sigaction(SIGUSR1, &sa, NULL)   ||
-		      sigaction(SIGUSR2, &sa, NULL)   ||
-		      sigaction(SIGTERM, &sa, NULL)   ||
-		      signal_ignore(SIGPIPE)); /* get EPIPE instead in read() */
+	rc = (loop_signal(SIGHUP,  os_signal_cb, ctx) ||
+	      loop_signal(SIGINT,  os_signal_cb, ctx) ||
+	      loop_signal(SIGTERM, os_signal_cb, ctx) ||
+	      loop_signal(SIGUSR1, os_signal_cb, ctx) ||
+	      loop_signal(SIGUSR2, os_signal_cb, ctx));
 
+	if (!installed) {
+		rc |= signal_ignore(SIGPIPE); /* get EPIPE instead in read() */
 		installed = 1;
 	}
 
@@ -203,7 +187,6 @@ int os_install_signal_handler(void *ctx)
 		return RC_OS_INSTALL_SIGHANDLER_FAILED;
 	}
 
-	param = ctx;
 	return 0;
 }
 
@@ -32,6 +32,131 @@
 static char *plugpath = NULL;   /* Set by first load. */
 static TAILQ_HEAD(, ddns_system) plugins = TAILQ_HEAD_INITIALIZER(plugins);
 
+/*
+ * Hash indexes, open addressing, over all names and aliases, and over
+ * their domain part, e.g., dyndns.org, for loose matching.  The first
+ * registered plugin wins, like when searching the list.  Keys point to
+ * the plugin's own strings, so no allocation is needed.
+ */
+#define PLUGIN_HASH_SIZE 512	/* Power of two, > 2 * names and aliases */
+
+struct plugin_key {
+	const char    *key;
+	size_t         len;
+	ddns_system_t *system;
+};
+
+static struct plugin_key exact_index[PLUGIN_HASH_SIZE];
+static struct plugin_key loose_index[PLUGIN_HASH_SIZE];
+static int               loose_valid;	/* Built on first loose search */
+static int               overflow;	/* Index full, search list instead */
+
+static ddns_system_t *search_plugin(const char *name, size_t len, int loose);
+
+/* Slot of @key, or free slot where it belongs, NULL if index is full */
+static struct plugin_key *key_slot(struct plugin_key *index, const char *key, size_t len)
+{
+	size_t mask = PLUGIN_HASH_SIZE - 1;
+	size_t pos = string_hash(key, len) & mask;
+	size_t i;
+
+	for (i = 0; i < PLUGIN_HASH_SIZE; i++, pos = (pos + 1) & mask) {
+		struct plugin_key *k = &index[pos];
+
+		if (!k->key)
+			return k;
+		if (k->len == len && !strncasecmp(k->key, key, len))
+			return k;
+	}
+
+	return NULL;
+}
+
+static void key_add(struct plugin_key *index, const char *key, ddns_system_t *system)
+{
+	struct plugin_key *k;
+	size_t len = strlen(key);
+
+	k = key_slot(index, key, len);
+	if (!k) {
+		overflow = 1;
+		return;
+	}
+
+	if (k->key)
+		return;
+
+	k->key    = key;
+	k->len    = len;
+	k->system = system;
+}
+
+static void index_add(ddns_system_t *plugin)
+{
+	key_add(exact_index, plugin->name, plugin);
+	if (plugin->alias)
+		key_add(exact_index, plugin->alias, plugin);
+	loose_valid = 0;
+}
+
+static void index_rebuild(void)
+{
+	ddns_system_t *p, *tmp;
+
+	memset(exact_index, 0, sizeof(exact_index));
+	overflow = 0;
+
+	PLUGIN_ITERATOR(p, tmp)
+		index_add(p);
+}
+
+/* Domain part of plugin name, e.g., default@dyndns.org => dyndns.org */
+static const char *domain(const char *name)
+{
+	const char *ptr = strchr(name, '@');
+
+	return ptr ? ptr + 1 : name;
+}
+
+/*
+ * Precompute loose matches for the domain part of all plugin names and
+ * aliases, the most common loose name in .conf files, using the same
+ * substring search as for any other loose name.
+ */
+static void loose_build(void)
+{
+	ddns_system_t *p, *tmp;
+
+	memset(loose_index, 0, sizeof(loose_index));
+	PLUGIN_ITERATOR(p, tmp) {
+		const char *key[] = { p->name, p->alias };
+		size_t i;
+
+		for (i = 0; i < NELEMS(key); i++) {
+			struct plugin_key *k;
+			const char *dom;
+
+			if (!key[i])
+				continue;
+
+			dom = domain(key[i]);
+			k = key_slot(loose_index, dom, strlen(dom));
+			if (!k) {
+				overflow = 1;
+				continue;
+			}
+			if (k->key)
+				continue;
+
+			k->key    = dom;
+			k->len    = strlen(dom);
+			k->system = search_plugin(dom, k->len, -1);
+		}
+	}
+
+	loose_valid = 1;
+}
+
 int plugin_register(ddns_system_t *plugin, const char *req)
 {
 	if (!plugin) {
@@ -49,6 +174,7 @@ int plugin_register(ddns_system_t *plugin, const char *req)
 
 	plugin->server_req = req;
 	TAILQ_INSERT_TAIL(&plugins, plugin, link);
+	index_add(plugin);
 
 	return 0;
 }
@@ -85,9 +211,12 @@ int plugin_unregister(ddns_system_t *plugin)
 		sprintf(name, "ipv6%s", plugin->name + 7);
 
 	TAILQ_REMOVE(&plugins, plugin, link);
+	index_rebuild();
+
 	plugin_v6 = plugin_find(name, 0);
 	if (plugin_v6 && plugin_v6->cloned) {
 		TAILQ_REMOVE(&plugins, plugin_v6, link);
+		index_rebuild();
 		free(plugin_v6->name);
 		free(plugin_v6);
 	}
@@ -97,15 +226,22 @@ int plugin_unregister(ddns_system_t *plugin)
 	return 0;
 }
 
-static ddns_system_t *search_plugin(const char *name, int loose)
+/* Search list for the first @len chars of @name, substring if @loose */
+static ddns_system_t *search_list(const char *name, size_t len, int loose)
 {
 	ddns_system_t *p, *tmp;
+	char buf[128];
+
+	if (len >= sizeof(buf))
+		return NULL;
+	memcpy(buf, name, len);
+	buf[len] = 0;
 
 	if (loose) {
 		PLUGIN_ITERATOR(p, tmp) {
-			if (strcasestr(p->name, name))
+			if (strcasestr(p->name, buf))
 				return p;
-			if (p->alias && strcasestr(p->alias, name))
+			if (p->alias && strcasestr(p->alias, buf))
 				return p;
 		}
 
@@ -113,15 +249,42 @@ static ddns_system_t *search_plugin(const char *name, int loose)
 	}
 
 	PLUGIN_ITERATOR(p, tmp) {
-		if (!strcasecmp(p->name, name))
+		if (!strcasecmp(p->name, buf))
 			return p;
-		if (p->alias && !strcasecmp(p->alias, name))
+		if (p->alias && !strcasecmp(p->alias, buf))
 			return p;
 	}
 
 	return NULL;
 }
 
+/*
+ * Exact names are always in the index, unless it is full.  Loose names
+ * not in the precomputed table fall back to searching the list.  With
+ * @loose < 0 the list is always searched, used to build the table.
+ */
+static ddns_system_t *search_plugin(const char *name, size_t len, int loose)
+{
+	struct plugin_key *k;
+
+	if (loose < 0 || overflow)
+		return search_list(name, len, loose);
+
+	if (!loose) {
+		k = key_slot(exact_index, name, len);
+		return k && k->key ? k->system : NULL;
+	}
+
+	if (!loose_valid)
+		loose_build();
+
+	k = key_slot(loose_index, name, len);
+	if (k && k->key)
+		return k->system;
+
+	return search_list(name, len, loose);
+}
+
 /**
  * plugin_list - List all plugins
  *
@@ -233,55 +396,41 @@ int plugin_show(char *name)
  */
 ddns_system_t *plugin_find(const char *name, int loose)
 {
-	char *tmp, *ptr;
 	ddns_system_t *p;
+	size_t len;
 
 	if (!name) {
 		errno = EINVAL;
 		return NULL;
 	}
 
-	/* Check for multiple instances of plugin */
-	tmp = strdup(name);
-	if (!tmp)
-		return NULL;
-
-	ptr = strchr(tmp, ':');
-	if (ptr)
-		*ptr = 0;
-	name = tmp;
+	/* Check for multiple instances of plugin, name:N */
+	len = strcspn(name, ":");
 
-	p = search_plugin(name, loose);
-	if (p) {
-		free(tmp);
+	p = search_plugin(name, len, loose);
+	if (p)
 		return p;
-	}
 
 	if (plugpath && name[0] != '/') {
 		int noext;
 		char *path;
-		size_t len = strlen(plugpath) + strlen(name) + 5;
+		size_t max = strlen(plugpath) + len + 5;
 
-		path = malloc(len);
-		if (!path) {
-			free(tmp);
+		path = malloc(max);
+		if (!path)
 			return NULL;
-		}
 
-		noext = strcmp(name + strlen(name) - 3, ".so");
-		snprintf(path, len, "%s%s%s%s", plugpath,
+		noext = len < 3 || strncmp(name + len - 3, ".so", 3);
+		snprintf(path, max, "%s%s%.*s%s", plugpath,
 			 plugpath[strlen(plugpath) - 1] == '/' ? "" : "/",
-			 name, noext ? ".so" : "");
+			 (int)len, name, noext ? ".so" : "");
 
-		p = search_plugin(path, loose);
+		p = search_plugin(path, strlen(path), loose);
 		free(path);
-		if (p) {
-			free(tmp);
+		if (p)
 			return p;
-		}
 	}
 
-	free(tmp);
 	errno = ENOENT;
 
 	return NULL;
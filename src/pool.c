@@ -0,0 +1,241 @@
+/* Worker thread pool, runs blocking transactions off the main loop
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "log.h"
+#include "loop.h"
+#include "pool.h"
+#include "queue.h"
+
+struct job {
+	TAILQ_ENTRY(job) link;
+	pool_work_fn_t   work;
+	pool_done_fn_t   done;
+	void            *arg;
+};
+
+static TAILQ_HEAD(, job) queued    = TAILQ_HEAD_INITIALIZER(queued);
+static TAILQ_HEAD(, job) completed = TAILQ_HEAD_INITIALIZER(completed);
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t threads[POOL_MAX_THREADS];
+static int       num_threads;
+static int       stopping;
+static int       notify[2] = { -1, -1 };
+
+static void *worker(void *arg)
+{
+	struct job *job;
+	ssize_t rc;
+
+	while (1) {
+		pthread_mutex_lock(&lock);
+		while (!stopping && TAILQ_EMPTY(&queued))
+			pthread_cond_wait(&cond, &lock);
+		if (stopping) {
+			pthread_mutex_unlock(&lock);
+			break;
+		}
+
+		job = TAILQ_FIRST(&queued);
+		TAILQ_REMOVE(&queued, job, link);
+		pthread_mutex_unlock(&lock);
+
+		job->work(job->arg);
+
+		pthread_mutex_lock(&lock);
+		TAILQ_INSERT_TAIL(&completed, job, link);
+		pthread_mutex_unlock(&lock);
+
+		/* Wake up main loop, if the pipe is full it's already pending */
+		rc = write(notify[1], "", 1);
+		(void)rc;
+	}
+
+	return NULL;
+}
+
+/* Called from the main loop, run @done callbacks for completed jobs */
+static void dispatch(int fd, void *arg)
+{
+	TAILQ_HEAD(, job) list = TAILQ_HEAD_INITIALIZER(list);
+	struct job *job;
+	char buf[32];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	pthread_mutex_lock(&lock);
+	TAILQ_CONCAT(&list, &completed, link);
+	pthread_mutex_unlock(&lock);
+
+	while ((job = TAILQ_FIRST(&list))) {
+		TAILQ_REMOVE(&list, job, link);
+		job->done(job->arg, 1);
+		free(job);
+	}
+}
+
+/**
+ * pool_init - Start worker threads
+ * @num: Number of threads, i.e., max number of concurrent jobs
+ *
+ * All signals are blocked in the worker threads, they are handled by
+ * the main thread's event loop.
+ *
+ * Returns:
+ * %RC_OK, or %RC_OS_EVENT_LOOP_FAILED.
+ */
+int pool_init(int num)
+{
+	sigset_t all, old;
+	int i, rc;
+
+	if (num < 1)
+		num = 1;
+	if (num > POOL_MAX_THREADS)
+		num = POOL_MAX_THREADS;
+
+	if (pipe(notify))
+		goto fail;
+	for (i = 0; i < 2; i++) {
+		if (fcntl(notify[i], F_SETFL, O_NONBLOCK) || fcntl(notify[i], F_SETFD, FD_CLOEXEC))
+			goto fail;
+	}
+	if (loop_add(notify[0], dispatch, NULL))
+		goto fail;
+
+	stopping = 0;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (num_threads = 0; num_threads < num; num_threads++) {
+		rc = pthread_create(&threads[num_threads], NULL, worker, NULL);
+		if (rc) {
+			errno = rc;
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (!num_threads)
+		goto fail;
+
+	logit(LOG_DEBUG, "Started %d worker threads", num_threads);
+
+	return 0;
+fail:
+	logit(LOG_ERR, "Failed starting worker threads: %s", strerror(errno));
+	pool_exit();
+
+	return RC_OS_EVENT_LOOP_FAILED;
+}
+
+/**
+ * pool_exit - Stop worker threads
+ *
+ * Waits for running jobs to complete, and calls their @done callback.
+ * Jobs that have not yet started are cancelled.
+ */
+void pool_exit(void)
+{
+	struct job *job;
+	int i;
+
+	pthread_mutex_lock(&lock);
+	stopping = 1;
+	while ((job = TAILQ_FIRST(&queued))) {
+		TAILQ_REMOVE(&queued, job, link);
+		pthread_mutex_unlock(&lock);
+
+		job->done(job->arg, 0);
+		free(job);
+
+		pthread_mutex_lock(&lock);
+	}
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+	num_threads = 0;
+
+	if (notify[0] != -1) {
+		dispatch(notify[0], NULL);
+		loop_del(notify[0]);
+		close(notify[0]);
+	}
+	if (notify[1] != -1)
+		close(notify[1]);
+	notify[0] = notify[1] = -1;
+}
+
+/**
+ * pool_submit - Queue job for a worker thread
+ * @work: Callback to run in worker thread
+ * @done: Callback to run in main thread when @work is done
+ * @arg:  Argument to both callbacks
+ *
+ * Returns:
+ * %RC_OK, %RC_OUT_OF_MEMORY, or %RC_ERROR if the pool is not running.
+ */
+int pool_submit(pool_work_fn_t work, pool_done_fn_t done, void *arg)
+{
+	struct job *job;
+
+	if (!work || !done)
+		return RC_INVALID_POINTER;
+	if (!num_threads)
+		return RC_ERROR;
+
+	job = calloc(1, sizeof(*job));
+	if (!job)
+		return RC_OUT_OF_MEMORY;
+
+	job->work = work;
+	job->done = done;
+	job->arg  = arg;
+
+	pthread_mutex_lock(&lock);
+	TAILQ_INSERT_TAIL(&queued, job, link);
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
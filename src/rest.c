@@ -0,0 +1,137 @@
+/* Helpers for REST API style plugins
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * Plugins for providers with a REST API first look up the id of the
+ * record to update, then send the update.  The lookups run over the
+ * same client as the updates, reusing any persistent connection, and
+ * the ids are cached per hostname in the state store.  A plugin drops
+ * the id when the provider responds that the record is not found, so
+ * it is looked up again on retry.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "rest.h"
+#include "state.h"
+
+#define REST_STATE_KEY    "record"
+
+/**
+ * rest_call - Send API request in ctx->request_buf to provider
+ * @ctx:   Context, response is read into ctx->work
+ * @info:  Provider, its update client is used
+ * @msg:   Log message, e.g., "Sending record list query"
+ * @trans: Transaction to fill in, for status and response body
+ * @len:   Length of request
+ *
+ * Returns:
+ * Result of HTTP transaction, the HTTP status is not checked.
+ */
+int rest_call(ddns_t *ctx, ddns_info_t *info, const char *msg, http_trans_t *trans, int len)
+{
+	http_t *client = &info->server;
+	int rc;
+
+	if (len < 0 || (size_t)len >= ctx->request_buflen)
+		return RC_BUFFER_OVERFLOW;
+
+	memset(trans, 0, sizeof(*trans));
+	trans->req     = ctx->request_buf;
+	trans->req_len = len;
+	trans->buf     = ctx->work;	/* Grows for large responses */
+
+	client->ssl_enabled = info->ssl_enabled;
+	client->keepalive   = info->system->keepalive;
+	rc = http_init(client, (char *)msg, ddns_get_tcp_force(info));
+	if (rc)
+		return rc;
+
+	logit(LOG_DEBUG, "API request:\n%s", ctx->request_buf);
+	rc = http_transaction(client, trans);
+	http_exit(client);
+	if (rc) {
+		logit(LOG_WARNING, "%s failed, error %d: %s", msg, rc, error_str(rc));
+		return rc;
+	}
+	logit(LOG_DEBUG, "API response:\n%s", trans->rsp);
+
+	return 0;
+}
+
+/**
+ * rest_id_get - Get cached record id of hostname
+ * @info:  Provider
+ * @alias: Hostname
+ * @key:   Settings the id depends on, e.g., domain and record type
+ * @id:    Buffer for id
+ * @len:   Size of @id
+ *
+ * Returns:
+ * Zero if an id is cached for the same @key.
+ */
+int rest_id_get(ddns_info_t *info, ddns_alias_t *alias, const char *key, char *id, size_t len)
+{
+	char buf[STATE_MAX_VALUE];
+	size_t klen = strlen(key);
+
+	if (state_get(info->system->name, alias->name, REST_STATE_KEY, buf, sizeof(buf)))
+		return 1;
+
+	if (strncmp(buf, key, klen) || buf[klen] != '/' || !buf[klen + 1])
+		return 1;
+
+	if (strlcpy(id, &buf[klen + 1], len) >= len)
+		return 1;
+
+	logit(LOG_DEBUG, "Using cached record id %s for %s", id, alias->name);
+
+	return 0;
+}
+
+/* Cache record id of hostname, saved to disk at next state commit */
+int rest_id_set(ddns_info_t *info, ddns_alias_t *alias, const char *key, const char *id)
+{
+	char buf[STATE_MAX_VALUE];
+
+	if (snprintf(buf, sizeof(buf), "%s/%s", key, id) >= (int)sizeof(buf))
+		return RC_BUFFER_OVERFLOW;
+
+	logit(LOG_DEBUG, "Caching record id %s for %s", id, alias->name);
+
+	return state_set(info->system->name, alias->name, REST_STATE_KEY, buf);
+}
+
+/* Drop record id of hostname, e.g., when the record is not found */
+void rest_id_drop(ddns_info_t *info, ddns_alias_t *alias)
+{
+	state_del(info->system->name, alias->name, REST_STATE_KEY);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,262 @@
+/* TLS session cache for resumed HTTPS handshakes
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "log.h"
+#include "queue.h"
+#include "session.h"
+#include "ssl.h"
+
+/*
+ * Serialized sessions, or TLS 1.3 tickets, of the last connection to
+ * each server.  Entries are kept across SIGHUP, and if enabled they are
+ * also saved in the cache directory, to survive a restart.
+ */
+struct entry {
+	LIST_ENTRY(entry) link;
+	char             *host;
+	int               port;
+	time_t            saved;
+
+	size_t            len;
+	unsigned char     data[];
+};
+
+/* Shared by all worker threads */
+static LIST_HEAD(, entry) cache = LIST_HEAD_INITIALIZER(cache);
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct entry *find(const char *host, int port)
+{
+	struct entry *entry;
+
+	LIST_FOREACH(entry, &cache, link) {
+		if (entry->port == port && !strcasecmp(entry->host, host))
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void drop(struct entry *entry)
+{
+	LIST_REMOVE(entry, link);
+	free(entry->host);
+	free(entry);
+}
+
+static struct entry *add(const char *host, int port, time_t saved, const void *data, size_t len)
+{
+	struct entry *entry;
+
+	entry = calloc(1, sizeof(*entry) + len);
+	if (!entry)
+		return NULL;
+
+	entry->host = strdup(host);
+	if (!entry->host) {
+		free(entry);
+		return NULL;
+	}
+	entry->port  = port;
+	entry->saved = saved;
+	entry->len   = len;
+	memcpy(entry->data, data, len);
+	LIST_INSERT_HEAD(&cache, entry, link);
+
+	return entry;
+}
+
+static char *filename(const char *host, int port, char *buf, size_t len)
+{
+	if (!persist_ssl_sessions || !cache_dir || strchr(host, '/'))
+		return NULL;
+
+	if (snprintf(buf, len, "%s/%s-%d.tls", cache_dir, host, port) >= (int)len)
+		return NULL;
+
+	return buf;
+}
+
+/* Session secrets, only readable by us */
+static void save(const char *host, int port, const void *data, size_t len)
+{
+	char file[256], tmp[264];
+	ssize_t num;
+	int fd;
+
+	if (!filename(host, port, file, sizeof(file)))
+		return;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		goto fail;
+
+	num = write(fd, data, len);
+	if (close(fd) || num != (ssize_t)len || rename(tmp, file)) {
+		unlink(tmp);
+		goto fail;
+	}
+
+	return;
+fail:
+	logit(LOG_DEBUG, "Failed saving TLS session to %s: %s", file, strerror(errno));
+}
+
+static struct entry *load(const char *host, int port)
+{
+	unsigned char buf[SESSION_MAX_LEN];
+	struct entry *entry = NULL;
+	char file[256];
+	struct stat st;
+	ssize_t len;
+	int fd;
+
+	if (!filename(host, port, file, sizeof(file)))
+		return NULL;
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) || st.st_size <= 0 || st.st_size > (off_t)sizeof(buf))
+		goto done;
+
+	len = read(fd, buf, st.st_size);
+	if (len != st.st_size)
+		goto done;
+
+	entry = add(host, port, st.st_mtime, buf, len);
+	if (entry)
+		logit(LOG_DEBUG, "Loaded TLS session for %s:%d from %s", host, port, file);
+done:
+	close(fd);
+
+	return entry;
+}
+
+/**
+ * session_get - Look up the last session with a server
+ * @host: Server hostname, also used for SNI
+ * @port: Server port
+ * @data: Pointer to copy of serialized session, free() after use
+ * @len:  Length of @data
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero if there is no session, or it has expired.
+ */
+int session_get(const char *host, int port, void **data, size_t *len)
+{
+	struct entry *entry;
+	int rc = 1;
+
+	if (!host)
+		return 1;
+
+	pthread_mutex_lock(&lock);
+	entry = find(host, port);
+	if (!entry)
+		entry = load(host, port);
+	if (!entry)
+		goto done;
+
+	if (time(NULL) - entry->saved > SESSION_LIFETIME) {
+		drop(entry);
+		goto done;
+	}
+
+	*data = malloc(entry->len);
+	if (!*data)
+		goto done;
+
+	memcpy(*data, entry->data, entry->len);
+	*len = entry->len;
+	rc = 0;
+done:
+	pthread_mutex_unlock(&lock);
+
+	return rc;
+}
+
+/**
+ * session_put - Save session, or ticket, of a connection for later resumption
+ * @host: Server hostname, also used for SNI
+ * @port: Server port
+ * @data: Serialized session
+ * @len:  Length of @data
+ *
+ * Replaces any previous session with the same server.
+ */
+void session_put(const char *host, int port, const void *data, size_t len)
+{
+	struct entry *entry;
+
+	if (!host || !data || !len || len > SESSION_MAX_LEN)
+		return;
+
+	pthread_mutex_lock(&lock);
+	entry = find(host, port);
+	if (entry) {
+		/* Same session as before, e.g., resumed with TLS 1.2 session ID */
+		if (entry->len == len && !memcmp(entry->data, data, len)) {
+			entry->saved = time(NULL);
+			goto done;
+		}
+		drop(entry);
+	}
+
+	if (add(host, port, time(NULL), data, len))
+		save(host, port, data, len);
+done:
+	pthread_mutex_unlock(&lock);
+}
+
+/* Forget all sessions, files in the cache directory are kept */
+void session_flush(void)
+{
+	struct entry *entry;
+
+	pthread_mutex_lock(&lock);
+	while ((entry = LIST_FIRST(&cache)))
+		drop(entry);
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
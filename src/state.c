@@ -0,0 +1,679 @@
+/* Persistent state store, an append-only journal with compaction
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * All persistent state, e.g., the last address sent and the time of
+ * each update, is kept in a single journal in the cache directory:
+ *
+ *     # inadyn state v1
+ *     S <system> <alias> <key> <value>
+ *     D <system> <alias> <key>
+ *     C <num> <crc32>
+ *
+ * Changes are kept in memory and appended as one transaction of set
+ * (S) and delete (D) records by state_commit(), with a trailing commit
+ * (C) record holding the number of records and a CRC32 over them.  At
+ * startup the journal is mapped and replayed, any trailing incomplete
+ * transaction, e.g., from a power loss, is discarded.  When the journal
+ * has grown to many times the live state it is compacted, by writing a
+ * new file and renaming it over the old one.
+ */
+
+#include "config.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "compat.h"
+#include "error.h"
+#include "log.h"
+#include "state.h"
+
+#define STATE_HEADER      "# inadyn state v1\n"
+#define STATE_MAX_LINE    (3 * 256 + STATE_MAX_VALUE + 8)
+#define STATE_COMPACT_MIN 16384		/* Never compact smaller journals */
+#define STATE_COMPACT_PCT 400		/* Compact when 4x the live state */
+
+struct entry {
+	char *id;			/* "<system> <alias> <key>" */
+	char *value;			/* NULL when deleted */
+	int   dirty;
+};
+
+/* Shared by all worker threads */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct entry   *table;
+static size_t          table_size;	/* Power of two */
+static size_t          table_num;
+static char           *path;
+static int             fd = -1;
+static off_t           journal_size;
+
+static uint32_t crc32(uint32_t crc, const char *buf, size_t len)
+{
+	crc = ~crc;
+	while (len--) {
+		int i;
+
+		crc ^= (unsigned char)*buf++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+
+	return ~crc;
+}
+
+/* Fields are separated by space, so must not contain any */
+static int valid(const char *str, size_t max)
+{
+	size_t len;
+
+	if (!str || !str[0])
+		return 0;
+
+	for (len = 0; str[len]; len++) {
+		if (isspace((unsigned char)str[len]) || len + 1 >= max)
+			return 0;
+	}
+
+	return 1;
+}
+
+static int make_id(char *buf, size_t len, const char *sysname, const char *alias, const char *key)
+{
+	if (!valid(sysname, len) || !valid(alias, len) || !valid(key, len))
+		return RC_INVALID_POINTER;
+
+	if (snprintf(buf, len, "%s %s %s", sysname, alias, key) >= (int)len)
+		return RC_BUFFER_OVERFLOW;
+
+	return 0;
+}
+
+/* Slot of @id, or the free slot where it belongs */
+static struct entry *slot(const char *id)
+{
+	size_t mask = table_size - 1;
+	size_t pos = string_hash(id, -1) & mask;
+
+	while (table[pos].id) {
+		if (!strcmp(table[pos].id, id))
+			break;
+		pos = (pos + 1) & mask;
+	}
+
+	return &table[pos];
+}
+
+static int grow(void)
+{
+	struct entry *old = table;
+	size_t i, num = table_size;
+
+	table = calloc(num ? num * 2 : 64, sizeof(*table));
+	if (!table) {
+		table = old;
+		return RC_OUT_OF_MEMORY;
+	}
+	table_size = num ? num * 2 : 64;
+
+	for (i = 0; i < num; i++) {
+		if (old[i].id)
+			*slot(old[i].id) = old[i];
+	}
+	free(old);
+
+	return 0;
+}
+
+static struct entry *lookup(const char *id)
+{
+	struct entry *e;
+
+	if (!table_size)
+		return NULL;
+
+	e = slot(id);
+	if (!e->id || !e->value)
+		return NULL;
+
+	return e;
+}
+
+static int update(const char *id, const char *value, int dirty)
+{
+	struct entry *e;
+	char *str = NULL;
+
+	if ((table_num + 1) * 2 > table_size && grow())
+		return RC_OUT_OF_MEMORY;
+
+	e = slot(id);
+	if (!e->id) {
+		if (!value)
+			return 0;
+
+		e->id = strdup(id);
+		if (!e->id)
+			return RC_OUT_OF_MEMORY;
+		table_num++;
+	} else if (!e->value && !value) {
+		return 0;
+	} else if (e->value && value && !strcmp(e->value, value)) {
+		return 0;
+	}
+
+	if (value) {
+		str = strdup(value);
+		if (!str)
+			return RC_OUT_OF_MEMORY;
+	}
+
+	free(e->value);
+	e->value = str;
+	e->dirty = dirty;
+
+	return 0;
+}
+
+/* Drop deleted entries, only when all changes are committed */
+static void prune(void)
+{
+	struct entry *old = table;
+	size_t i, num = table_size;
+
+	if (!num)
+		return;
+
+	table = calloc(num, sizeof(*table));
+	if (!table) {
+		table = old;
+		return;
+	}
+
+	table_num = 0;
+	for (i = 0; i < num; i++) {
+		if (!old[i].id)
+			continue;
+
+		if (!old[i].value) {
+			free(old[i].id);
+			continue;
+		}
+
+		*slot(old[i].id) = old[i];
+		table_num++;
+	}
+	free(old);
+}
+
+/* Parse, and optionally apply, one journal record, returns its type */
+static int record(const char *ptr, size_t len, int apply, uint32_t *num, uint32_t *crc)
+{
+	char line[STATE_MAX_LINE];
+	char *type, *f[4];
+	int i, n;
+
+	if (len >= sizeof(line))
+		return 0;
+
+	memcpy(line, ptr, len);
+	line[len] = 0;
+
+	type = strtok(line, " ");
+	for (n = 0; n < 4; n++) {
+		f[n] = strtok(NULL, " ");
+		if (!f[n])
+			break;
+	}
+	if (!type || strlen(type) != 1 || strtok(NULL, " "))
+		return 0;
+
+	switch (type[0]) {
+	case 'S':
+		if (n != 4)
+			return 0;
+		break;
+
+	case 'D':
+		if (n != 3)
+			return 0;
+		break;
+
+	case 'C':
+		if (n != 2 || !num || !crc)
+			return 0;
+		*num = strtoul(f[0], NULL, 10);
+		*crc = strtoul(f[1], NULL, 16);
+		return 'C';
+
+	default:
+		return 0;
+	}
+
+	if (apply) {
+		char id[STATE_MAX_LINE];
+
+		for (i = 0; i < 3; i++) {
+			if (!valid(f[i], sizeof(id)))
+				return 0;
+		}
+		snprintf(id, sizeof(id), "%s %s %s", f[0], f[1], f[2]);
+		if (update(id, type[0] == 'S' ? f[3] : NULL, 0))
+			return 0;
+	}
+
+	return type[0];
+}
+
+/*
+ * Replay all complete transactions in the journal, returns the offset
+ * of the end of the last one, or -1 if the journal is not ours.
+ */
+static off_t replay(const char *map, size_t size)
+{
+	size_t hlen = strlen(STATE_HEADER);
+	size_t txn, off, end;
+	uint32_t num = 0;
+
+	if (size < hlen || memcmp(map, STATE_HEADER, hlen))
+		return -1;
+
+	end = txn = off = hlen;
+	while (off < size) {
+		const char *eol = memchr(map + off, '\n', size - off);
+		size_t len;
+		uint32_t n, crc;
+		int type;
+
+		if (!eol)
+			break;
+		len = eol - (map + off);
+
+		type = record(map + off, len, 0, &n, &crc);
+		if (!type)
+			break;
+
+		if (type == 'C') {
+			const char *ptr = map + txn;
+
+			if (n != num || crc != crc32(0, map + txn, off - txn))
+				break;
+
+			while (ptr < map + off) {
+				const char *next = memchr(ptr, '\n', map + off - ptr);
+
+				record(ptr, next - ptr, 1, NULL, NULL);
+				ptr = next + 1;
+			}
+
+			num = 0;
+			end = txn = off + len + 1;
+		} else {
+			num++;
+		}
+
+		off += len + 1;
+	}
+
+	return end;
+}
+
+/* Size of journal after compaction */
+static size_t live_size(void)
+{
+	size_t i, len = strlen(STATE_HEADER) + 32;
+
+	for (i = 0; i < table_size; i++) {
+		if (table[i].id && table[i].value)
+			len += strlen(table[i].id) + strlen(table[i].value) + 4;
+	}
+
+	return len;
+}
+
+static int sync_dir(void)
+{
+	char *dir, *ptr;
+	int dfd;
+
+	dir = strdup(path);
+	if (!dir)
+		return -1;
+
+	ptr = strrchr(dir, '/');
+	if (ptr)
+		*ptr = 0;
+
+	dfd = open(ptr ? dir : ".", O_RDONLY | O_DIRECTORY);
+	free(dir);
+	if (dfd == -1)
+		return -1;
+
+	fsync(dfd);
+	close(dfd);
+
+	return 0;
+}
+
+/* Write all live state, as one transaction, to a new journal */
+static int compact(void)
+{
+	uint32_t num = 0, crc = 0;
+	size_t i;
+	char tmp[512];
+	FILE *fp;
+	int nfd;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+		logit(LOG_WARNING, "Too long path for state file: %s", path);
+		return RC_BUFFER_OVERFLOW;
+	}
+
+	fp = fopen(tmp, "w");
+	if (!fp)
+		goto fail;
+
+	fputs(STATE_HEADER, fp);
+	for (i = 0; i < table_size; i++) {
+		char line[STATE_MAX_LINE];
+		int len;
+
+		if (!table[i].id || !table[i].value)
+			continue;
+
+		len = snprintf(line, sizeof(line), "S %s %s\n", table[i].id, table[i].value);
+		crc = crc32(crc, line, len);
+		fputs(line, fp);
+		num++;
+	}
+	fprintf(fp, "C %u %08x\n", num, crc);
+
+	if (fflush(fp) || fsync(fileno(fp))) {
+		fclose(fp);
+		goto fail;
+	}
+	if (fclose(fp))
+		goto fail;
+
+	if (rename(tmp, path))
+		goto fail;
+	sync_dir();
+
+	nfd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+	if (nfd == -1) {
+		logit(LOG_WARNING, "Failed reopening %s: %s", path, strerror(errno));
+		return RC_FILE_IO_ACCESS_ERROR;
+	}
+	if (fd != -1)
+		close(fd);
+	fd = nfd;
+	journal_size = lseek(fd, 0, SEEK_END);
+
+	for (i = 0; i < table_size; i++)
+		table[i].dirty = 0;
+	prune();
+
+	return 0;
+fail:
+	logit(LOG_WARNING, "Failed compacting %s: %s", path, strerror(errno));
+	remove(tmp);
+
+	return RC_FILE_IO_ACCESS_ERROR;
+}
+
+/*
+ * Open and replay journal in @dir, created if missing.  Without write
+ * access the state is only kept in memory, and lost at exit.
+ */
+int state_open(const char *dir)
+{
+	struct stat st = { 0 };
+	off_t end = -1;
+	size_t len;
+	int rc = 0;
+
+	state_close();
+	if (!dir)
+		return RC_INVALID_POINTER;
+
+	pthread_mutex_lock(&lock);
+
+	len = strlen(dir) + strlen(STATE_FILE) + 2;
+	path = malloc(len);
+	if (!path) {
+		rc = RC_OUT_OF_MEMORY;
+		goto done;
+	}
+	snprintf(path, len, "%s/%s", dir, STATE_FILE);
+
+	fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		logit(LOG_WARNING, "Failed opening %s, state will not be saved: %s", path, strerror(errno));
+		goto done;
+	}
+
+	if (fstat(fd, &st))
+		st.st_size = 0;
+
+	if (st.st_size > 0) {
+		void *map;
+
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			logit(LOG_WARNING, "Failed reading %s: %s", path, strerror(errno));
+		} else {
+			end = replay(map, st.st_size);
+			munmap(map, st.st_size);
+		}
+
+		if (end == -1)
+			logit(LOG_WARNING, "Invalid state file %s, starting over.", path);
+		else if (end < st.st_size)
+			logit(LOG_WARNING, "Discarding %lld bytes of incomplete updates in %s",
+			      (long long)(st.st_size - end), path);
+		journal_size = end;
+	}
+
+	/* New, invalid, or large journal, start over with a compact one */
+	if (end == -1 || (end > STATE_COMPACT_MIN && (size_t)end * 100 > live_size() * STATE_COMPACT_PCT)) {
+		compact();
+	} else if (end < st.st_size && ftruncate(fd, end)) {
+		logit(LOG_WARNING, "Failed truncating %s: %s", path, strerror(errno));
+		compact();
+	}
+
+	logit(LOG_DEBUG, "Loaded %zu entries from %s", table_num, path);
+done:
+	pthread_mutex_unlock(&lock);
+
+	return rc;
+}
+
+/* Commit any pending changes, then drop all state */
+void state_close(void)
+{
+	size_t i;
+
+	state_commit();
+
+	pthread_mutex_lock(&lock);
+	for (i = 0; i < table_size; i++) {
+		free(table[i].id);
+		free(table[i].value);
+	}
+	free(table);
+	table = NULL;
+	table_size = table_num = 0;
+
+	if (fd != -1)
+		close(fd);
+	fd = -1;
+	journal_size = 0;
+
+	free(path);
+	path = NULL;
+	pthread_mutex_unlock(&lock);
+}
+
+/* Copy value of @key for @alias into @buf, returns non-zero if unset */
+int state_get(const char *sysname, const char *alias, const char *key, char *buf, size_t len)
+{
+	char id[STATE_MAX_LINE];
+	struct entry *e;
+	int rc;
+
+	rc = make_id(id, sizeof(id), sysname, alias, key);
+	if (rc)
+		return rc;
+
+	pthread_mutex_lock(&lock);
+	e = lookup(id);
+	if (e)
+		strlcpy(buf, e->value, len);
+	pthread_mutex_unlock(&lock);
+
+	return e ? 0 : RC_FILE_IO_MISSING_FILE;
+}
+
+/* Change is kept in memory until the next state_commit() */
+int state_set(const char *sysname, const char *alias, const char *key, const char *value)
+{
+	char id[STATE_MAX_LINE];
+	int rc;
+
+	rc = make_id(id, sizeof(id), sysname, alias, key);
+	if (rc)
+		return rc;
+	if (!valid(value, STATE_MAX_VALUE))
+		return RC_INVALID_POINTER;
+
+	pthread_mutex_lock(&lock);
+	rc = update(id, value, 1);
+	pthread_mutex_unlock(&lock);
+
+	return rc;
+}
+
+int state_del(const char *sysname, const char *alias, const char *key)
+{
+	char id[STATE_MAX_LINE];
+	int rc;
+
+	rc = make_id(id, sizeof(id), sysname, alias, key);
+	if (rc)
+		return rc;
+
+	pthread_mutex_lock(&lock);
+	rc = update(id, NULL, 1);
+	pthread_mutex_unlock(&lock);
+
+	return rc;
+}
+
+/*
+ * Append all changes since the last commit to the journal, as a single
+ * write followed by fdatasync().  Compacts the journal when it has grown
+ * too large.
+ */
+int state_commit(void)
+{
+	uint32_t num = 0, crc;
+	char *txn = NULL;
+	size_t i, len = 0;
+	FILE *fp;
+	int rc = 0;
+
+	pthread_mutex_lock(&lock);
+	for (i = 0; i < table_size; i++) {
+		if (table[i].dirty)
+			num++;
+	}
+	if (!num)
+		goto done;
+
+	if (fd == -1)
+		goto clean;
+
+	fp = open_memstream(&txn, &len);
+	if (!fp) {
+		rc = RC_OUT_OF_MEMORY;
+		goto done;
+	}
+
+	for (i = 0; i < table_size; i++) {
+		if (!table[i].dirty)
+			continue;
+
+		if (table[i].value)
+			fprintf(fp, "S %s %s\n", table[i].id, table[i].value);
+		else
+			fprintf(fp, "D %s\n", table[i].id);
+	}
+	fflush(fp);
+	crc = crc32(0, txn, len);
+	fprintf(fp, "C %u %08x\n", num, crc);
+	if (fclose(fp)) {
+		rc = RC_OUT_OF_MEMORY;
+		goto done;
+	}
+
+	if (write(fd, txn, len) != (ssize_t)len || fdatasync(fd)) {
+		logit(LOG_WARNING, "Failed saving state to %s: %s", path, strerror(errno));
+		if (ftruncate(fd, journal_size))
+			logit(LOG_WARNING, "Failed truncating %s: %s", path, strerror(errno));
+		rc = RC_FILE_IO_ACCESS_ERROR;
+		goto done;
+	}
+	journal_size += len;
+	logit(LOG_DEBUG, "Saved %u changes to %s", num, path);
+
+clean:
+	for (i = 0; i < table_size; i++)
+		table[i].dirty = 0;
+	prune();
+
+	if (fd != -1 && journal_size > STATE_COMPACT_MIN &&
+	    (size_t)journal_size * 100 > live_size() * STATE_COMPACT_PCT)
+		compact();
+done:
+	pthread_mutex_unlock(&lock);
+	free(txn);
+
+	return rc;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -21,6 +21,7 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,13 +30,13 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <arpa/nameser.h>
 #include <net/if.h>
 #include <netinet/in.h>
-#include <resolv.h>
 
+#include "dns.h"
 #include "http.h"
 #include "log.h"
+#include "loop.h"
 #include "tcp.h"
 
 int tcp_construct(tcp_sock_t *tcp)
@@ -72,27 +73,6 @@ static int soerror(int sd)
 	return errno = code;
 }
 
-/*
- * In the wonderful world of network programming the manual states that
- * EINPROGRESS is only a possible error on non-blocking sockets.  Real world
- * experience, however, suggests otherwise.  Simply poll() for completion and
- * then continue. --Joachim
- */
-static int check_error(int sd, int msec)
-{
-	struct pollfd pfd = { sd, POLLOUT, 0 };
-
-	if (EINPROGRESS == errno) {
-		logit(LOG_INFO, "Waiting (%d sec) for three-way handshake to complete ...", msec / 1000);
-		if (poll (&pfd, 1, msec) > 0 && !soerror(sd)) {
-			logit(LOG_INFO, "Connected.");
-			return 0;
-		}
-	}
-
-	return 1;
-}
-
 static void set_timeouts(int sd, int timeout)
 {
 	struct timeval sv;
@@ -116,108 +96,255 @@ static void set_params(tcp_sock_t *tcp)
 
 }
 
-int tcp_init(tcp_sock_t *tcp, char *msg, int force)
+static char *addrstr(struct addrinfo *ai, char *host, size_t len)
 {
-	int rc = 0;
+	if (getnameinfo(ai->ai_addr, ai->ai_addrlen, host, len, NULL, 0, NI_NUMERICHOST))
+		snprintf(host, len, "?");
 
-	ASSERT(tcp);
+	return host;
+}
 
-	if (tcp->initialized == 1)
-		return 0;
+/*
+ * Order addresses for connection racing, RFC 8305.  With a preferred
+ * @family, all its addresses go first, then those of the other family,
+ * which @primary marks the start of.  Otherwise alternate between the
+ * families, starting with the family of the first address, which is
+ * the one we last connected to.
+ */
+static size_t interleave(struct addrinfo *list, int family, struct addrinfo **order, size_t *primary)
+{
+	struct addrinfo *ai, *first[TCP_MAX_ATTEMPTS], *second[TCP_MAX_ATTEMPTS];
+	size_t i = 0, j = 0, n1 = 0, n2 = 0, num = 0;
+	int preferred = family != AF_UNSPEC;
+
+	for (ai = list; ai; ai = ai->ai_next) {
+		if (family == AF_UNSPEC)
+			family = ai->ai_family;
+
+		if (ai->ai_family == family) {
+			if (n1 < TCP_MAX_ATTEMPTS)
+				first[n1++] = ai;
+		} else if (n2 < TCP_MAX_ATTEMPTS)
+			second[n2++] = ai;
+	}
 
-	set_params(tcp);
-	do {
-		int s, sd, tries = 0;
-		char port[10];
-		char host[NI_MAXHOST];
-		struct addrinfo hints, *servinfo, *ai;
-		struct sockaddr *sa;
-		socklen_t len;
-
-		/* remote address */
-		if (!tcp->remote_host)
-			break;
+	if (preferred) {
+		while (i < n1)
+			order[num++] = first[i++];
+		*primary = num;
+		while (j < n2 && num < TCP_MAX_ATTEMPTS)
+			order[num++] = second[j++];
 
-		/* Clear DNS cache before calling getaddrinfo(). */
-		res_init();
+		return num;
+	}
 
-		/* Obtain address(es) matching host/port */
-		memset(&hints, 0, sizeof(struct addrinfo));
-		hints.ai_family = AF_UNSPEC;		/* Allow IPv4 or IPv6 */
-		if (force & TCP_FORCE_IPV6)
-			hints.ai_family = AF_INET6;		/* Force to use IPV6 */
+	while ((i < n1 || j < n2) && num < TCP_MAX_ATTEMPTS) {
+		if (i < n1)
+			order[num++] = first[i++];
+		if (j < n2 && num < TCP_MAX_ATTEMPTS)
+			order[num++] = second[j++];
+	}
+	*primary = num;
 
-		if (force & TCP_FORCE_IPV4)
-			hints.ai_family = AF_INET;		/* Force to use IPV4 */
+	return num;
+}
+
+/* Delay before attempt @next, longer before falling back to the other family */
+static long long attempt_delay(size_t next, size_t primary)
+{
+	if (next && next == primary)
+		return TCP_FALLBACK_DELAY;
 
-		hints.ai_socktype = SOCK_STREAM;	/* Stream socket */
-		hints.ai_flags = AI_NUMERICSERV;	/* No service name lookup */
-		snprintf(port, sizeof(port), "%d", tcp->port);
+	return TCP_ATTEMPT_DELAY;
+}
 
-		s = getaddrinfo(tcp->remote_host, port, &hints, &servinfo);
-		if (s != 0 || !servinfo) {
-			if (!force)
-				logit(LOG_WARNING, "Failed resolving hostname %s: %s", tcp->remote_host, gai_strerror(s));
-			rc = RC_TCP_INVALID_REMOTE_ADDR;
+/* Start non-blocking connect to @ai, returns socket or -1 */
+static int attempt(tcp_sock_t *tcp, struct addrinfo *ai, char *msg, int tries)
+{
+	char host[NI_MAXHOST];
+	int sd;
+
+	sd = socket(ai->ai_family, SOCK_STREAM, 0);
+	if (sd == -1) {
+		logit(LOG_ERR, "Error creating client socket: %s", strerror(errno));
+		return -1;
+	}
+
+	logit(LOG_INFO, "%s, %sconnecting to %s([%s]:%d)", msg, tries ? "re" : "",
+	      tcp->remote_host, addrstr(ai, host, sizeof(host)), tcp->port);
+
+	if (fcntl(sd, F_SETFL, O_NONBLOCK) ||
+	    (connect(sd, ai->ai_addr, ai->ai_addrlen) && errno != EINPROGRESS)) {
+		int err = errno;
+
+		logit(LOG_INFO, "Failed connecting to that server: %s", strerror(err));
+		close(sd);
+		errno = err;
+
+		return -1;
+	}
+
+	return sd;
+}
+
+/*
+ * Happy Eyeballs, RFC 8305: start a new connection attempt every 250
+ * msec, or as soon as the previous attempt fails, without waiting for
+ * earlier attempts to time out.  The first attempt at @primary, of the
+ * non-preferred family, waits longer.  The first socket to connect wins.
+ */
+static int race(tcp_sock_t *tcp, char *msg, struct addrinfo **order, size_t num, size_t primary)
+{
+	struct addrinfo *ai[TCP_MAX_ATTEMPTS], *winner = NULL;
+	struct pollfd pfd[TCP_MAX_ATTEMPTS];
+	long long start[TCP_MAX_ATTEMPTS], last = 0, now;
+	size_t next = 0, pending = 0, i;
+	int created = 0, err = ETIMEDOUT;
+	int sd = -1, timeout, flags;
+	char host[NI_MAXHOST];
+
+	while (sd == -1) {
+		now = loop_now();
+		if (next < num && (!pending || now - last >= attempt_delay(next, primary))) {
+			int fd = attempt(tcp, order[next], msg, next);
+
+			last = now;
+			if (fd == -1) {
+				err  = errno;
+				last = 0;	/* Failed at once, start next now */
+			} else {
+				pfd[pending].fd      = fd;
+				pfd[pending].events  = POLLOUT;
+				pfd[pending].revents = 0;
+				ai[pending]          = order[next];
+				start[pending++]     = now;
+				created++;
+			}
+			next++;
+			continue;
+		}
+
+		if (!pending)
+			break;
+
+		timeout = tcp->timeout;
+		for (i = 0; i < pending; i++) {
+			long long left = start[i] + tcp->timeout - now;
+
+			if (left < timeout)
+				timeout = left;
+		}
+		if (next < num && last + attempt_delay(next, primary) - now < timeout)
+			timeout = last + attempt_delay(next, primary) - now;
+		if (timeout < 0)
+			timeout = 0;
+
+		if (poll(pfd, pending, timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			err = errno;
 			break;
 		}
-		ai = servinfo;
-
-		while (1) {
-			sd = socket(ai->ai_family, SOCK_STREAM, 0);
-			if (sd == -1) {
-				if (!force)
-					logit(LOG_ERR, "Error creating client socket: %s", strerror(errno));
-				rc = RC_TCP_SOCKET_CREATE_ERROR;
-				break;
-			}
 
-			/* Now we try connecting to the server, on connect fail, try next DNS record */
-			sa  = ai->ai_addr;
-			len = ai->ai_addrlen;
-
-			if (getnameinfo(sa, len, host, sizeof(host), NULL, 0, NI_NUMERICHOST))
-				goto next;
-
-			set_timeouts(sd, tcp->timeout);
-
-			logit(LOG_INFO, "%s, %sconnecting to %s([%s]:%d)", msg, tries ? "re" : "",
-			      tcp->remote_host, host, tcp->port);
-			if (connect(sd, sa, len) && check_error(sd, tcp->timeout)) {
-			next:
-				tries++;
-
-				ai = ai->ai_next;
-				if (ai) {
-					if (!force)
-						logit(LOG_INFO, "Failed connecting to that server: %s",
-					    		errno != EINPROGRESS ? strerror(errno) : "retrying ...");
-					close(sd);
-					continue;
-				}
-
-				if (!force)
-					logit(LOG_WARNING, "Failed connecting to %s: %s", tcp->remote_host, strerror(errno));
-				close(sd);
-				rc = RC_TCP_CONNECT_FAILED;
+		now = loop_now();
+		for (i = 0; i < pending; ) {
+			if (pfd[i].revents && !soerror(pfd[i].fd)) {
+				sd     = pfd[i].fd;
+				winner = ai[i];
+			} else if (pfd[i].revents || now - start[i] >= tcp->timeout) {
+				err = pfd[i].revents ? errno : ETIMEDOUT;
+				logit(LOG_INFO, "Failed connecting to %s([%s]:%d): %s", tcp->remote_host,
+				      addrstr(ai[i], host, sizeof(host)), tcp->port, strerror(err));
+				close(pfd[i].fd);
+				last = 0;	/* Start next attempt now */
 			} else {
-				tcp->socket = sd;
-				tcp->initialized = 1;
+				i++;
+				continue;
 			}
 
-			break;
+			pending--;
+			pfd[i]   = pfd[pending];
+			ai[i]    = ai[pending];
+			start[i] = start[pending];
+			if (sd != -1)
+				break;
 		}
+	}
+
+	/* Cancel attempts still in progress */
+	for (i = 0; i < pending; i++)
+		close(pfd[i].fd);
+
+	if (sd == -1) {
+		logit(LOG_WARNING, "Failed connecting to %s: %s", tcp->remote_host, strerror(err));
+		return created ? RC_TCP_CONNECT_FAILED : RC_TCP_SOCKET_CREATE_ERROR;
+	}
 
-		freeaddrinfo(servinfo);
+	flags = fcntl(sd, F_GETFL);
+	if (flags != -1)
+		fcntl(sd, F_SETFL, flags & ~O_NONBLOCK);
+	set_timeouts(sd, tcp->timeout);
+
+	logit(LOG_DEBUG, "Connected to %s([%s]:%d)", tcp->remote_host,
+	      addrstr(winner, host, sizeof(host)), tcp->port);
+	dns_prefer(tcp->remote_host, winner->ai_addr);
+
+	tcp->socket = sd;
+	tcp->initialized = 1;
+
+	return 0;
+}
+
+/* Resolve and connect to addresses of either family, @family first */
+static int connect_family(tcp_sock_t *tcp, char *msg, int family)
+{
+	struct addrinfo *servinfo, *order[TCP_MAX_ATTEMPTS];
+	size_t num, primary;
+	int s, rc;
+
+	/* Obtain address(es) matching host/port, cached or pinned */
+	s = dns_resolve(tcp->remote_host, tcp->port, AF_UNSPEC, &servinfo);
+	if (s != 0 || !servinfo) {
+		logit(LOG_WARNING, "Failed resolving hostname %s: %s", tcp->remote_host, gai_strerror(s));
+		return RC_TCP_INVALID_REMOTE_ADDR;
 	}
-	while (0);
 
+	num = interleave(servinfo, family, order, &primary);
+	if (num)
+		rc = race(tcp, msg, order, num, primary);
+	else
+		rc = RC_TCP_INVALID_REMOTE_ADDR;
+	dns_free(servinfo);
+
+	return rc;
+}
+
+int tcp_init(tcp_sock_t *tcp, char *msg, int force)
+{
+	int family = AF_UNSPEC;		/* Allow IPv4 or IPv6 */
+	int rc;
+
+	ASSERT(tcp);
+
+	if (tcp->initialized == 1)
+		return 0;
+
+	set_params(tcp);
+
+	/* remote address */
+	if (!tcp->remote_host)
+		return 0;
+
+	if (force & TCP_FORCE_IPV6)
+		family = AF_INET6;	/* Force to use IPV6 */
+
+	if (force & TCP_FORCE_IPV4)
+		family = AF_INET;	/* Force to use IPV4 */
+
+	/* The other address family is the fallback, raced after a delay */
+	rc = connect_family(tcp, msg, family);
 	if (rc) {
 		tcp_exit(tcp);
-		if (force) {
-			/* fallback to auto mode which select ipv4 or ipv6 in case the previous mode failed */
-			return tcp_init(tcp, msg, TCP_AUTO); 
-		}
 		return rc;
 	}
 
@@ -260,50 +387,76 @@ again:
 	return 0;
 }
 
-int tcp_recv(tcp_sock_t *tcp, char *buf, int len, int *recv_len)
+/*
+ * Gather write, the request goes out in as few segments as possible.
+ * The rest of a partially written iovec is sent separately.
+ */
+int tcp_sendv(tcp_sock_t *tcp, const struct iovec *iov, int iovcnt)
 {
-	int rc = 0;
-	int remaining_bytes = len;
-	int total_bytes = 0;
-
 	ASSERT(tcp);
-	ASSERT(buf);
-	ASSERT(recv_len);
 
 	if (!tcp->initialized)
 		return RC_TCP_OBJECT_NOT_INITIALIZED;
 
-	while (remaining_bytes > 0) {
-		int bytes;
-		int err = 0;
-		int chunk_size = remaining_bytes > TCP_DEFAULT_READ_CHUNK_SIZE
-			? TCP_DEFAULT_READ_CHUNK_SIZE
-			: remaining_bytes;
+	while (iovcnt > 0) {
+		ssize_t num;
 
-		bytes = recv(tcp->socket, buf + total_bytes, chunk_size, 0);
-		err = errno;
-		if(bytes == -1 && (err == EAGAIN || err == EWOULDBLOCK)){
-			continue;
+		num = writev(tcp->socket, iov, iovcnt);
+		if (num == -1) {
+			if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+				continue;
+
+			logit(LOG_WARNING, "Network error while sending query/update: %s", strerror(errno));
+			return RC_TCP_SEND_ERROR;
 		}
-		if (bytes < 0) {
-			logit(LOG_WARNING, "Network error while waiting for reply: %s", strerror(errno));
-			rc = RC_TCP_RECV_ERROR;
-			break;
+
+		while (iovcnt > 0 && (size_t)num >= iov->iov_len) {
+			num -= iov->iov_len;
+			iov++;
+			iovcnt--;
 		}
 
-		if (bytes == 0) {
-			if (total_bytes == 0)
-				rc = RC_TCP_RECV_ERROR;
-			break;
+		if (iovcnt > 0 && num > 0) {
+			DO(tcp_send(tcp, (char *)iov->iov_base + num, iov->iov_len - num));
+			iov++;
+			iovcnt--;
 		}
+	}
 
-		total_bytes    += bytes;
-		remaining_bytes = len - total_bytes;
+	return 0;
+}
+
+/*
+ * Read what is available, at most @len bytes, waiting at most the
+ * timeout for something to arrive.  At end of stream @recv_len is 0.
+ */
+int tcp_recv(tcp_sock_t *tcp, char *buf, int len, int *recv_len)
+{
+	ssize_t bytes;
+
+	ASSERT(tcp);
+	ASSERT(buf);
+	ASSERT(recv_len);
+
+	if (!tcp->initialized)
+		return RC_TCP_OBJECT_NOT_INITIALIZED;
+
+	do {
+		bytes = recv(tcp->socket, buf, len, 0);
+	} while (bytes == -1 && errno == EINTR);
+
+	if (bytes < 0) {
+		int err = errno;
+
+		logit(LOG_WARNING, "Network error while waiting for reply: %s",
+		      err == EAGAIN || err == EWOULDBLOCK ? "timeout" : strerror(err));
+		errno = err;	/* For http_recv(), reset or timeout */
+		return RC_TCP_RECV_ERROR;
 	}
 
-	*recv_len = total_bytes;
+	*recv_len = bytes;
 
-	return rc;
+	return 0;
 }
 
 int tcp_set_port(tcp_sock_t *tcp, int port)
@@ -0,0 +1,464 @@
+/* Compiled HTTP request templates, see template.h for the format
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ddns.h"
+#include "md5.h"
+#include "template.h"
+
+#define MD5_DIGEST_BYTES  16
+
+static char tohex(char code)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	return hex[code & 15];
+}
+
+/* Used to check if user already URL encoded */
+static int ishex(const char *str)
+{
+	if (str[0] == '%' && isxdigit(str[1]) && isxdigit(str[2]))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Simple URL encoder, with exceptions for /, ?, =, and &, which should
+ * usually be encoded as well, but are here exposed raw to advanced
+ * end-users.  The destination must fit 3 * @len bytes.
+ */
+static size_t url_encode(char *dst, const char *str, size_t len)
+{
+	const char *end = str + len;
+	char *ptr = dst;
+
+	while (str < end) {
+		char ch = str[0];
+
+		if (end - str >= 3 && ishex(str)) {
+			*ptr++ = *str++;
+			*ptr++ = *str++;
+			*ptr++ = *str++;
+			continue;
+		}
+
+		if (isalnum(ch) || ch == '-' || ch == '_' || ch == '.' || ch == '~')
+			*ptr++ = ch;
+		else if (ch == '/' || ch == '?' || ch == '&' || ch == '=')
+			*ptr++ = ch;
+		else if (ch == ' ')
+			*ptr++ = '+';
+		else
+			*ptr++ = '%', *ptr++ = tohex(ch >> 4), *ptr++ = tohex(ch & 15);
+		str++;
+	}
+
+	return ptr - dst;
+}
+
+/* Append literal span, or placeholder, adjacent literals are merged */
+static int add(tmpl_t *t, size_t max, tmpl_type_t type, int encode, const char *str, size_t len)
+{
+	tmpl_seg_t *seg = t->num ? &t->seg[t->num - 1] : NULL;
+
+	if (type == TMPL_LITERAL) {
+		if (!len)
+			return 0;
+		if (t->len + (encode ? 3 * len : len) > max)
+			return RC_BUFFER_OVERFLOW;
+
+		if (encode)
+			len = url_encode(&t->text[t->len], str, len);
+		else
+			memcpy(&t->text[t->len], str, len);
+
+		if (seg && seg->type == TMPL_LITERAL) {
+			seg->len += len;
+			t->len   += len;
+			return 0;
+		}
+	}
+
+	if (t->num >= TMPL_MAX_SEGMENTS)
+		return RC_BUFFER_OVERFLOW;
+
+	seg = &t->seg[t->num++];
+	seg->type   = type;
+	seg->encode = encode;
+	seg->off    = t->len;
+	seg->len    = type == TMPL_LITERAL ? len : 0;
+	t->len     += seg->len;
+
+	return 0;
+}
+
+static int add_str(tmpl_t *t, size_t max, const char *str, int encode)
+{
+	return add(t, max, TMPL_LITERAL, encode, str, strlen(str));
+}
+
+/* Some providers want a hex digest of the password instead of the password */
+static int add_md5(tmpl_t *t, size_t max, const char *str)
+{
+	unsigned char digest[MD5_DIGEST_BYTES];
+	char buf[MD5_DIGEST_BYTES * 2 + 1];
+	int i;
+
+	md5((const unsigned char *)str, strlen(str), digest);
+	for (i = 0; i < MD5_DIGEST_BYTES; i++) {
+		buf[i * 2]     = tohex(digest[i] >> 4);
+		buf[i * 2 + 1] = tohex(digest[i] & 15);
+	}
+	buf[i * 2] = 0;
+
+	return add_str(t, max, buf, 0);
+}
+
+/*
+ * Custom provider's ddns-path, with % format specifiers
+ *
+ * %u - username
+ * %p - password, if HTTP basic auth is not used
+ * %h - hostname
+ * %i - IP address
+ *
+ * Static parts are expanded before URL encoding, like before, so
+ * users can still use %% to write their own URL encoded characters.
+ */
+static int compile_path(tmpl_t *t, size_t max, ddns_info_t *info)
+{
+	char buf[sizeof(info->server_url) + sizeof(info->creds.username) + sizeof(info->creds.password)];
+	const char *ptr = info->server_url, *pct;
+	int rc = 0;
+
+	/*
+	 * if the user has specified modifiers, then they probably know
+	 * how to append his hostname or IP, otherwise just append the
+	 * hostname or ip (depending on the append_myip option)
+	 */
+	if (!strchr(ptr, '%')) {
+		DO(add_str(t, max, ptr, 1));
+		return add(t, max, info->append_myip ? TMPL_ADDRESS : TMPL_HOSTNAME, 0, NULL, 0);
+	}
+
+	buf[0] = 0;
+	while (!rc && (pct = strchr(ptr, '%'))) {
+		size_t len = strlen(buf);
+
+		if (len + (pct - ptr) >= sizeof(buf))
+			return RC_BUFFER_OVERFLOW;
+		memcpy(&buf[len], ptr, pct - ptr);
+		buf[len + (pct - ptr)] = 0;
+		ptr = pct + 2;
+
+		switch (pct[1]) {
+		case 'u':
+			if (!info->creds.username[0])
+				logit(LOG_ERR, "Format specifier in ddns-path used: '%%u',"
+				      " but 'username' configuration option has not been specified!");
+			strlcat(buf, info->creds.username, sizeof(buf));
+			break;
+
+		case 'p':
+			if (!info->creds.password[0])
+				logit(LOG_ERR, "Format specifier in ddns-path used: '%%p',"
+				      " but 'password' configuration option has not been specified!");
+			strlcat(buf, info->creds.password, sizeof(buf));
+			break;
+
+		case 'h':
+		case 'i':
+			rc = add_str(t, max, buf, 1);
+			if (!rc)
+				rc = add(t, max, pct[1] == 'h' ? TMPL_HOSTNAME : TMPL_ADDRESS, 1, NULL, 0);
+			buf[0] = 0;
+			break;
+
+		case '%':
+			strlcat(buf, "%", sizeof(buf));
+			break;
+
+		default:
+			logit(LOG_ERR, "Unknown format specifier in ddns-path: '%c'", pct[1]);
+			logit(LOG_ERR, "Invalid server URL: %s", info->server_url);
+			ptr = pct;
+			goto done;
+		}
+	}
+done:
+	if (rc)
+		return rc;
+	strlcat(buf, ptr, sizeof(buf));
+
+	return add_str(t, max, buf, 1);
+}
+
+/*
+ * Compile the provider's request template, expanding everything that
+ * does not change between updates.  Providers with their own request
+ * composer callback do not use templates.
+ */
+int tmpl_compile(ddns_info_t *info)
+{
+	const char *fmt = info->system->server_req;
+	const char *ptr, *pct;
+	tmpl_t *t;
+	size_t max;
+	int rc = 0;
+
+	tmpl_free(info);
+	if (info->system->request || !fmt)
+		return 0;
+
+	max  = strlen(fmt) + strlen(info->server_name.name) + strlen(info->user_agent) + 32;
+	max += 3 * (sizeof(info->server_url) + sizeof(info->creds.username) + sizeof(info->creds.password));
+	max += sizeof(info->creds.username) + sizeof(info->creds.password) + 2 * MD5_DIGEST_BYTES;
+	if (info->creds.encoded_password)
+		max += strlen(info->creds.encoded_password);
+
+	t = calloc(1, sizeof(*t) + max);
+	if (!t)
+		return RC_OUT_OF_MEMORY;
+
+	for (ptr = fmt; !rc && (pct = strchr(ptr, '%')); ptr = pct + 2) {
+		rc = add(t, max, TMPL_LITERAL, 0, ptr, pct - ptr);
+		if (rc)
+			break;
+
+		switch (pct[1]) {
+		case 'U':
+			rc = add_str(t, max, info->server_url, 0);
+			break;
+
+		case 'P':
+			rc = compile_path(t, max, info);
+			break;
+
+		case 'S':
+			rc = add_str(t, max, info->server_name.name, 0);
+			break;
+
+		case 'C':
+			if (info->creds.encoded_password)
+				rc = add_str(t, max, info->creds.encoded_password, 0);
+			break;
+
+		case 'u':
+			rc = add_str(t, max, info->creds.username, 0);
+			break;
+
+		case 'p':
+			rc = add_str(t, max, info->creds.password, 0);
+			break;
+
+		case 'm':
+			rc = add_md5(t, max, info->creds.password);
+			break;
+
+		case 'A':
+			rc = add_str(t, max, info->user_agent, 0);
+			break;
+
+		case 'W':
+			if (info->wildcard)
+				rc = add_str(t, max, "&wildcard=ON", 0);
+			break;
+
+		case 'w':
+			rc = add_str(t, max, info->wildcard ? "ON" : "OFF", 0);
+			break;
+
+		case 'h':
+			rc = add(t, max, TMPL_HOSTNAME, 0, NULL, 0);
+			break;
+
+		case 'H':
+			rc = add(t, max, TMPL_SUBDOMAIN, 0, NULL, 0);
+			break;
+
+		case 'i':
+			rc = add(t, max, TMPL_ADDRESS, 0, NULL, 0);
+			break;
+
+		case '%':
+			rc = add_str(t, max, "%", 0);
+			break;
+
+		default:
+			logit(LOG_ERR, "Invalid request template in %s, unknown format specifier '%%%c'",
+			      info->system->name, pct[1]);
+			rc = RC_ERROR;
+			break;
+		}
+	}
+
+	if (!rc)
+		rc = add_str(t, max, ptr, 0);
+	if (rc) {
+		free(t);
+		return rc;
+	}
+
+	info->tmpl = t;
+
+	return 0;
+}
+
+void tmpl_free(ddns_info_t *info)
+{
+	if (info->tmpl)
+		free(info->tmpl);
+	info->tmpl = NULL;
+}
+
+/* Point next iovec at @slen bytes of @str, URL encoded values are stored in @buf */
+static int value(struct iovec *iov, int *n, int max, const char *str, size_t slen, int encode,
+		 char *buf, size_t len, size_t *pos)
+{
+	if (*n >= max)
+		return 1;
+
+	if (encode) {
+		if (*pos + 3 * slen > len)
+			return 1;
+
+		iov[*n].iov_base = &buf[*pos];
+		slen = url_encode(&buf[*pos], str, slen);
+		*pos += slen;
+	} else {
+		iov[*n].iov_base = (char *)str;
+	}
+	iov[(*n)++].iov_len = slen;
+
+	return 0;
+}
+
+/* Length of @name without the provider's domain, from the plugin name */
+static size_t subdomain(ddns_info_t *info, const char *name)
+{
+	const char *domain = strchr(info->system->name, '@');
+	size_t len = strlen(name), dlen;
+
+	if (!domain)
+		return len;
+
+	dlen = strlen(++domain);
+	if (len > dlen + 1 && name[len - dlen - 1] == '.' && !strcasecmp(&name[len - dlen], domain))
+		return len - dlen - 1;
+
+	return len;
+}
+
+/*
+ * Render request for @num aliases, all to the same address, into at
+ * most *@iovcnt iovecs.  Literal spans point into the template, the
+ * hostname and address into the aliases, only URL encoded values are
+ * written to @buf.  Returns total length of request, or -1 if it does
+ * not fit.
+ */
+int tmpl_render(ddns_info_t *info, ddns_alias_t **alias, size_t num, char *buf, size_t len,
+		struct iovec *iov, int *iovcnt)
+{
+	tmpl_t *t = info->tmpl;
+	size_t i, j, pos = 0;
+	int n = 0, max = *iovcnt, total = 0;
+
+	if (!t || num < 1)
+		return -1;
+
+	for (i = 0; i < t->num; i++) {
+		tmpl_seg_t *seg = &t->seg[i];
+
+		switch (seg->type) {
+		case TMPL_LITERAL:
+			if (n >= max)
+				return -1;
+			iov[n].iov_base = &t->text[seg->off];
+			iov[n++].iov_len = seg->len;
+			break;
+
+		case TMPL_HOSTNAME:
+		case TMPL_SUBDOMAIN:
+			for (j = 0; j < num; j++) {
+				const char *name = alias[j]->name;
+				size_t nlen;
+
+				if (seg->type == TMPL_SUBDOMAIN)
+					nlen = subdomain(info, name);
+				else
+					nlen = strlen(name);
+
+				if (j > 0 && value(iov, &n, max, ",", 1, 0, buf, len, &pos))
+					return -1;
+				if (value(iov, &n, max, name, nlen, seg->encode, buf, len, &pos))
+					return -1;
+			}
+			break;
+
+		case TMPL_ADDRESS:
+			if (value(iov, &n, max, alias[0]->address, strlen(alias[0]->address),
+				  seg->encode, buf, len, &pos))
+				return -1;
+			break;
+		}
+	}
+
+	for (i = 0; i < (size_t)n; i++)
+		total += iov[i].iov_len;
+	*iovcnt = n;
+
+	return total;
+}
+
+/* Flatten rendered request into @buf, e.g., for logging, may truncate */
+int tmpl_copy(const struct iovec *iov, int iovcnt, char *buf, size_t len)
+{
+	size_t pos = 0;
+	int i;
+
+	if (!len)
+		return 0;
+
+	for (i = 0; i < iovcnt && pos < len - 1; i++) {
+		size_t num = iov[i].iov_len;
+
+		if (num > len - 1 - pos)
+			num = len - 1 - pos;
+		memcpy(&buf[pos], iov[i].iov_base, num);
+		pos += num;
+	}
+	buf[pos] = 0;
+
+	return pos;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */